@@ -0,0 +1,389 @@
+/* * * * * * *
+ * Module for the edit distance and alignment of long strings
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "align.h"
+
+#define WORD_BITS 64				// table cells in a column block
+#define HIGH_BIT ((uint64_t)1 << (WORD_BITS - 1))
+#define ALPHABET 256
+#define BASE_CELLS (1 << 16)	// tables this small are aligned directly
+
+#define MIN(X,Y) (((X)<(Y))? (X):(Y)) // finds the minimum value between X and Y
+
+// the runs of edits of a script, written out as they end
+typedef struct {
+	FILE *out;
+	const char *a;
+	const char *b;
+	char op;		// edit of the current run ('=', '-', '+', '~' or 't'), or 0
+	size_t from_a;	// where the run starts in 'a' and 'b'
+	size_t from_b;
+	size_t len;		// bytes of the run (of 'a', or 'b' for insertions)
+} Script;
+
+// the state of an alignment
+typedef struct {
+	const char *a;
+	const char *b;
+	char *ra;		// 'a' and 'b' reversed, for the backward tables
+	char *rb;
+	size_t n;
+	size_t m;
+	bool transpose;
+	long *fwd;		// last rows of the forward and backward tables, and
+	long *fwd_prev;	// the rows before them (for transpositions)
+	long *bwd;
+	long *bwd_prev;
+	Script script;
+} Aligner;
+
+/*----------------------------------------------------------------------*/
+/* HELPER FUNCTION PROTOTYPES */
+int advance_block(uint64_t *pv, uint64_t *mv, uint64_t *d0, uint64_t eq,
+	uint64_t tr, int hin, uint64_t out_bit);
+long bit_parallel(const char *a, size_t n, const char *b, size_t m,
+	bool transpose, long *row, long *prev);
+void column_distances(const uint64_t *pv, const uint64_t *mv, size_t m,
+	long top, long *out);
+char *reversed(const char *s, size_t n);
+void script_add(Script *script, char op, size_t at_a, size_t at_b,
+	size_t len);
+void script_flush(Script *script);
+void align_table(Aligner *aligner, size_t a0, size_t a1, size_t b0,
+	size_t b1);
+void align_halves(Aligner *aligner, size_t a0, size_t a1, size_t b0,
+	size_t b1);
+
+/*----------------------------------------------------------------------*/
+/* DISTANCE TABLES IN LINEAR SPACE */
+
+/* Moves a block of 64 cells of a column of the table one column on: 'pv'
+ * and 'mv' hold the rows where the block's cells go up and down by one
+ * from the cell above, 'eq' the rows matching this column's letter, 'tr'
+ * the rows a transposition ends on, and 'hin' how much the cell above the
+ * block went up from the last column. leaves the rows where the cells are
+ * the same as the ones up and to the left in 'd0', and returns how much
+ * the cell at 'out_bit' went up
+ */
+int advance_block(uint64_t *pv, uint64_t *mv, uint64_t *d0, uint64_t eq,
+		uint64_t tr, int hin, uint64_t out_bit) {
+	uint64_t hneg = hin < 0, hpos = hin > 0;
+	uint64_t x = eq | hneg;
+	uint64_t d = (((x & *pv) + *pv) ^ *pv) | x | *mv | tr;
+	uint64_t ph = *mv | ~(d | *pv);
+	uint64_t mh = *pv & d;
+	int hout = (ph & out_bit) ? 1 : (mh & out_bit) ? -1 : 0;
+	ph = ph << 1 | hpos;
+	mh = mh << 1 | hneg;
+	*pv = mh | ~(d | ph);
+	*mv = ph & d;
+	*d0 = d;
+	return hout;
+}
+
+/* Finds the edit distance between 'a' and 'b' a column of the table (over
+ * 'b') at a time, for each letter of 'a' (Hyyro's variant for optimal
+ * string alignment with 'transpose'). fills in 'row' with the distances of
+ * all of 'a' to each prefix of 'b', and 'prev' with those of all of 'a' but
+ * its last letter (each if it isn't NULL, and 'a' isn't empty for 'prev')
+ */
+long bit_parallel(const char *a, size_t n, const char *b, size_t m,
+		bool transpose, long *row, long *prev) {
+	size_t nblocks = (m + WORD_BITS - 1) / WORD_BITS, i, j;
+	long dist = m;
+
+	if (m == 0) {
+		if (row) {
+			row[0] = n;
+		}
+		if (prev && n > 0) {
+			prev[0] = n - 1;
+		}
+		return n;
+	}
+
+	// the rows of each letter of 'b', by letter
+	uint64_t *peq = calloc(ALPHABET * nblocks, sizeof(uint64_t));
+	uint64_t *pv = malloc(sizeof(uint64_t) * nblocks);
+	uint64_t *mv = calloc(nblocks, sizeof(uint64_t));
+	uint64_t *d0 = calloc(nblocks, sizeof(uint64_t));
+	assert(peq && pv && mv && d0);
+	for (j = 0; j < m; j++) {
+		peq[(unsigned char)b[j] * nblocks + j / WORD_BITS]
+			|= (uint64_t)1 << (j % WORD_BITS);
+	}
+	memset(pv, 0xFF, sizeof(uint64_t) * nblocks);
+
+	// the last block stops at the last letter of 'b'
+	uint64_t last = (uint64_t)1 << ((m - 1) % WORD_BITS);
+	for (i = 0; i < n; i++) {
+		if (prev && i == n - 1) {
+			column_distances(pv, mv, m, i, prev);
+		}
+		const uint64_t *eq = peq + (unsigned char)a[i] * nblocks;
+		const uint64_t *eq_prev = i > 0
+			? peq + (unsigned char)a[i-1] * nblocks : NULL;
+		uint64_t carry = 0, tr = 0;
+		int h = 1;
+		for (j = 0; j < nblocks; j++) {
+			// a transposition ends a row below a cell that differed from
+			// the one up and to its left, where both letters swap places
+			if (transpose && eq_prev) {
+				uint64_t swap = ~d0[j] & eq[j];
+				tr = (swap << 1 | carry) & eq_prev[j];
+				carry = swap >> (WORD_BITS - 1);
+			}
+			h = advance_block(&pv[j], &mv[j], &d0[j], eq[j], tr, h,
+				j == nblocks - 1 ? last : HIGH_BIT);
+		}
+		dist += h;
+	}
+	if (row) {
+		column_distances(pv, mv, m, n, row);
+	}
+
+	free(peq);
+	free(pv);
+	free(mv);
+	free(d0);
+	return dist;
+}
+
+// the distances down a column of the table, from the top one, 'top', and
+// the bits of where they go up ('pv') or down ('mv')
+void column_distances(const uint64_t *pv, const uint64_t *mv, size_t m,
+		long top, long *out) {
+	size_t j;
+	out[0] = top;
+	for (j = 1; j <= m; j++) {
+		uint64_t bit = (uint64_t)1 << ((j - 1) % WORD_BITS);
+		out[j] = out[j-1] + ((pv[(j - 1) / WORD_BITS] & bit) != 0)
+			- ((mv[(j - 1) / WORD_BITS] & bit) != 0);
+	}
+}
+
+long align_distance(const char *a, size_t n, const char *b, size_t m,
+		bool transpose) {
+	// the columns run along the shorter string
+	if (m > n) {
+		return align_distance(b, m, a, n, transpose);
+	}
+	return bit_parallel(a, n, b, m, transpose, NULL, NULL);
+}
+
+/*----------------------------------------------------------------------*/
+/* EDIT SCRIPTS */
+
+char *reversed(const char *s, size_t n) {
+	char *r = malloc(n + 1);
+	assert(r);
+	size_t i;
+	for (i = 0; i < n; i++) {
+		r[i] = s[n - 1 - i];
+	}
+	return r;
+}
+
+// add 'len' bytes of edit 'op' at 'at_a' in 'a' and 'at_b' in 'b'
+void script_add(Script *script, char op, size_t at_a, size_t at_b,
+		size_t len) {
+	if (op != script->op) {
+		script_flush(script);
+		script->op = op;
+		script->from_a = at_a;
+		script->from_b = at_b;
+		script->len = 0;
+	}
+	script->len += len;
+}
+
+// write out the current run, if there is one
+void script_flush(Script *script) {
+	const char *a = script->a + script->from_a;
+	const char *b = script->b + script->from_b;
+	size_t len = script->len;
+
+	if (script->op == '=') {
+		fprintf(script->out, "= %zu\n", len);
+	} else if (script->op == '-') {
+		fprintf(script->out, "- %zu ", len);
+		fwrite(a, 1, len, script->out);
+		fputc('\n', script->out);
+	} else if (script->op == '+') {
+		fprintf(script->out, "+ %zu ", len);
+		fwrite(b, 1, len, script->out);
+		fputc('\n', script->out);
+	} else if (script->op) {
+		fprintf(script->out, "%c %zu ", script->op, len);
+		fwrite(a, 1, len, script->out);
+		fputc(' ', script->out);
+		fwrite(b, 1, len, script->out);
+		fputc('\n', script->out);
+	}
+	script->op = 0;
+}
+
+/* Aligns a[a0..a1) with b[b0..b1) from their whole table, tracing an
+ * optimal path back from the end
+ */
+void align_table(Aligner *aligner, size_t a0, size_t a1, size_t b0,
+		size_t b1) {
+	const char *a = aligner->a + a0, *b = aligner->b + b0;
+	size_t n = a1 - a0, m = b1 - b0, i, j, w = m + 1;
+	long *edit = malloc(sizeof(long) * (n + 1) * w);
+	char *ops = malloc(n + m + 1);
+	assert(edit && ops);
+	size_t nops = 0;
+
+	for (i = 0; i <= n; i++) {
+		edit[i * w] = i;
+	}
+	for (j = 0; j <= m; j++) {
+		edit[j] = j;
+	}
+	for (i = 1; i <= n; i++) {
+		for (j = 1; j <= m; j++) {
+			long edist = MIN(edit[(i-1) * w + j-1] + (a[i-1] != b[j-1]),
+				MIN(edit[(i-1) * w + j] + 1, edit[i * w + j-1] + 1));
+			if (aligner->transpose && i > 1 && j > 1 && a[i-1] == b[j-2]
+					&& a[i-2] == b[j-1]) {
+				edist = MIN(edist, edit[(i-2) * w + j-2] + 1);
+			}
+			edit[i * w + j] = edist;
+		}
+	}
+
+	// back from the end, taking a step that the cell could have come from
+	i = n;
+	j = m;
+	while (i > 0 || j > 0) {
+		long here = edit[i * w + j];
+		if (i > 0 && j > 0 && a[i-1] == b[j-1]
+				&& edit[(i-1) * w + j-1] == here) {
+			ops[nops++] = '=';
+			i--, j--;
+		} else if (aligner->transpose && i > 1 && j > 1 && a[i-1] == b[j-2]
+				&& a[i-2] == b[j-1] && edit[(i-2) * w + j-2] + 1 == here) {
+			ops[nops++] = 't';
+			i -= 2, j -= 2;
+		} else if (i > 0 && j > 0 && edit[(i-1) * w + j-1] + 1 == here) {
+			ops[nops++] = '~';
+			i--, j--;
+		} else if (i > 0 && edit[(i-1) * w + j] + 1 == here) {
+			ops[nops++] = '-';
+			i--;
+		} else {
+			ops[nops++] = '+';
+			j--;
+		}
+	}
+
+	// and then forwards again
+	i = a0;
+	j = b0;
+	while (nops > 0) {
+		char op = ops[--nops];
+		size_t len = op == 't' ? 2 : 1;
+		script_add(&aligner->script, op, i, j, len);
+		i += op == '+' ? 0 : len;
+		j += op == '-' ? 0 : len;
+	}
+
+	free(edit);
+	free(ops);
+}
+
+/* Aligns a[a0..a1) with b[b0..b1): splits the first in half, finds where an
+ * optimal path crosses from one half to the other (through a cell of the
+ * middle row, or over it with a transposition), and aligns each side
+ */
+void align_halves(Aligner *aligner, size_t a0, size_t a1, size_t b0,
+		size_t b1) {
+	size_t n = a1 - a0, m = b1 - b0, j;
+
+	if (n <= 2 || m <= 2 || (n + 1) * (m + 1) <= BASE_CELLS) {
+		align_table(aligner, a0, a1, b0, b1);
+		return;
+	}
+
+	// the distances of the first half to each prefix of b[b0..b1), and of
+	// the second half to each suffix (from their tables backwards)
+	size_t mid = a0 + n / 2;
+	const char *a = aligner->a, *b = aligner->b;
+	bit_parallel(a + a0, mid - a0, b + b0, m, aligner->transpose,
+		aligner->fwd, aligner->fwd_prev);
+	bit_parallel(aligner->ra + (aligner->n - a1), a1 - mid,
+		aligner->rb + (aligner->m - b1), m, aligner->transpose,
+		aligner->bwd, aligner->bwd_prev);
+
+	long best = aligner->fwd[0] + aligner->bwd[m];
+	size_t split = 0;
+	bool swap = false;
+	for (j = 1; j <= m; j++) {
+		if (aligner->fwd[j] + aligner->bwd[m - j] < best) {
+			best = aligner->fwd[j] + aligner->bwd[m - j];
+			split = j;
+		}
+	}
+	// a path can also jump over the middle row, swapping a[mid-1..mid] for
+	// b[b0+j-1..b0+j]
+	for (j = 1; aligner->transpose && j < m; j++) {
+		if (a[mid-1] == b[b0 + j] && a[mid] == b[b0 + j - 1]
+				&& aligner->fwd_prev[j-1] + 1 + aligner->bwd_prev[m - j - 1]
+				< best) {
+			best = aligner->fwd_prev[j-1] + 1 + aligner->bwd_prev[m - j - 1];
+			split = j;
+			swap = true;
+		}
+	}
+
+	if (swap) {
+		align_halves(aligner, a0, mid - 1, b0, b0 + split - 1);
+		script_add(&aligner->script, 't', mid - 1, b0 + split - 1, 2);
+		align_halves(aligner, mid + 1, a1, b0 + split + 1, b1);
+	} else {
+		align_halves(aligner, a0, mid, b0, b0 + split);
+		align_halves(aligner, mid, a1, b0 + split, b1);
+	}
+}
+
+void print_alignment(const char *a, size_t n, const char *b, size_t m,
+		bool transpose, FILE *out) {
+	Aligner aligner = {
+		.a = a,
+		.b = b,
+		.ra = reversed(a, n),
+		.rb = reversed(b, m),
+		.n = n,
+		.m = m,
+		.transpose = transpose,
+		.script = { .out = out, .a = a, .b = b, .op = 0 },
+	};
+	aligner.fwd = malloc(sizeof(long) * (m + 1));
+	aligner.fwd_prev = malloc(sizeof(long) * (m + 1));
+	aligner.bwd = malloc(sizeof(long) * (m + 1));
+	aligner.bwd_prev = malloc(sizeof(long) * (m + 1));
+	assert(aligner.fwd && aligner.fwd_prev && aligner.bwd
+		&& aligner.bwd_prev);
+
+	fprintf(out, "%ld\n", align_distance(a, n, b, m, transpose));
+	align_halves(&aligner, 0, n, 0, m);
+	script_flush(&aligner.script);
+
+	free(aligner.ra);
+	free(aligner.rb);
+	free(aligner.fwd);
+	free(aligner.fwd_prev);
+	free(aligner.bwd);
+	free(aligner.bwd_prev);
+}
@@ -0,0 +1,40 @@
+/* * * * * * *
+ * Module for the edit distance and alignment of long strings (Task 1 on
+ * whole lines or files), in memory linear in their lengths
+ *
+ * the distance is found 64 table cells of a column at a time, as the bits
+ * of machine words (Myers' bit-parallel algorithm, in Hyyro's blocks, and
+ * with Hyyro's transpositions for optimal string alignment). the alignment
+ * splits the first string in half, finds where an optimal path crosses
+ * the middle from the last rows of the two halves' tables (the second one
+ * backwards), and aligns each side on its own (Hirschberg)
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#ifndef ALIGN_H
+#define ALIGN_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// the Levenshtein distance between the 'n' bytes at 'a' and the 'm' at
+// 'b' (optimal string alignment distance with 'transpose'), in O(n + m)
+// memory
+long align_distance(const char *a, size_t n, const char *b, size_t m,
+	bool transpose);
+
+// write the distance between 'a' and 'b' to 'out', and then a script of
+// edits turning 'a' into 'b', a line per run of the same edit:
+//   "= <count>"                  count bytes the same in both
+//   "- <count> <bytes>"          bytes of 'a' deleted
+//   "+ <count> <bytes>"          bytes of 'b' inserted
+//   "~ <count> <bytes> <bytes>"  bytes of 'a' substituted by those of 'b'
+//   "t <count> <bytes> <bytes>"  bytes of 'a' swapped in adjacent pairs
+//                                (transpose): count is in bytes, two per
+//                                swapped pair
+void print_alignment(const char *a, size_t n, const char *b, size_t m,
+	bool transpose, FILE *out);
+
+#endif
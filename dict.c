@@ -0,0 +1,1481 @@
+/* * * * * * * *
+ * Module for a dictionary index: every distinct dictionary word interned
+ * once, with its id as its rank, used to check and correct document words
+ *
+ * shared by Task 3 and Task 4 and the spelling daemon
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <assert.h>
+
+#include "dict.h"
+#include "strarena.h"
+#include "edits.h"
+#include "workers.h"
+#include "grams.h"
+#include "packed.h"
+#include "memo.h"
+#include "trigrams.h"
+
+// store important values of a possible corrected word, for Task 4
+typedef struct {
+	char *word;	
+	int pos;	// stores the position of the corrected word in the dictionary
+	int corr;	// flag that indicates whether a corrected word is found
+	int dist;	// edit distance of the corrected word
+} possibleword;
+
+struct dict {
+	StrArena *words;	// each distinct word, stored once: its id is its rank
+	Workers *workers;	// threads sharing a dictionary scan, or NULL
+	bool transpositions;	// a swap of adjacent letters is a single edit
+	EditSet *edits;		// scratch for the edits of one query at a time
+
+	// every n-gram of letters in the words, and the short lowercase words
+	// kept packed (with their edits). only corrections need them, so both
+	// are NULL until the first correction or suggestion
+	Grams *grams;
+	PackedTable *packed;
+	PackedSet *packed_edits;
+
+	// distance 3 candidates, from the trigrams of the words (or NULL), and
+	// the counts of one query
+	Trigrams *trigrams;
+	TrigramScratch *trigram_scratch;
+
+	// work budget, counted in probes (edits generated or looked up) and
+	// distance table cells. LONG_MAX means no limit
+	long word_budget;
+	long doc_budget;
+	long doc_used;		// work done since the budget was set
+	long work;			// work done on the current word
+	long limit;			// work the current word may do
+	bool degraded;		// the current word ran out of budget
+
+	Memo *memo;				// corrections from earlier runs, or NULL
+	uint64_t content_hash;	// of the distinct words, in rank order
+
+	bool view;			// the words belong to another index
+};
+
+// a dictionary scan shared between workers: each takes the next chunk of
+// ranks in turn, and all of them stop at ranks above the best match so far
+typedef struct {
+	StrArena *words;
+	char *wword;
+	int edist;
+	bool transpose;
+	uint32_t nwords;
+	uint32_t next;		// first rank of the next chunk to hand out
+	uint32_t best;		// lowest matching rank found, or STR_ARENA_NONE
+	long limit;			// distance table cells the scan may fill
+	long work;			// cells filled so far, by all workers
+	bool exhausted;		// the scan stopped early, out of budget
+} SharedScan;
+
+// a dictionary build split between workers (see dict_add_all()): the
+// words are hashed a chunk at a time, gathered into shards by hash, and
+// each shard keeps the first occurrence of its words. those are interned
+// in input order, and the indexes over them built alongside each other,
+// as the parts of a list of tasks
+typedef struct build Build;
+
+// one index over the new words, built in 'nparts' parts, each run on
+// whichever worker is free. a part may build its share of the index on its
+// own (in 'parts'), for 'finish' (if not NULL) to merge into the index
+typedef struct build_task BuildTask;
+struct build_task {
+	void (*run)(Build *build, BuildTask *task, int part);
+	void (*finish)(Build *build, BuildTask *task);
+	int nparts;
+	void **parts;
+};
+
+#define MAX_BUILD_TASKS 8
+
+struct build {
+	Dict *dict;
+	const char *const *words;
+	const size_t *lens;
+	uint32_t n;
+
+	uint64_t *hashes;		// of each word
+	uint32_t nchunks;
+	uint32_t nshards;
+	uint32_t *placed;		// words of each chunk in each shard, and then
+							// where the next of them goes in 'order'
+	uint32_t *order;		// the words, shard by shard, each in input order
+	uint32_t *shard_ends;	// where each shard ends in 'order'
+	bool *kept;				// the word is the first occurrence of its text
+
+	uint32_t first_rank;	// the new words: ranks [first_rank, end_rank)
+	uint32_t end_rank;
+
+	BuildTask tasks[MAX_BUILD_TASKS];
+	int ntasks;
+
+	uint32_t next;			// the next chunk, shard or part to hand out
+};
+
+// a bounded max-heap of the best suggestions found so far: the root is the
+// worst of them, and the first to be pushed out by a better one
+typedef struct {
+	Suggestion *items;
+	int n;
+	int k;
+} SuggestHeap;
+
+/*----------------------------------------------------------------------*/
+/* DEFINING FUNCTIONS */
+#define MIN(X,Y) (((X)<(Y))? (X):(Y)) // finds the minimum value between X and Y
+#define ABS(X) (((X)<0)? -(X):(X))
+
+#define MAX_WORD_LEN 256	// longest word the bounded distance handles
+#define PROBE_BATCH  64		// edited words looked up in the table at once
+#define SCAN_CHUNK   4096	// ranks a worker scans before taking more
+#define CANCEL_CHECK 64		// words scanned between checks of the best rank
+#define BUILD_CHUNK  16384	// words a worker hashes before taking more
+#define BUILD_SHARDS 8		// shards of a build per worker
+
+/*----------------------------------------------------------------------*/
+/* HELPER FUNCTION PROTOTYPES */
+Dict *init_dict(StrArena *words, PackedTable *packed, Grams *grams,
+	uint64_t content_hash);
+char *report_correction(possibleword *cword, int *rank, int *dist);
+void build_hash_job(void *arg, int worker);
+void build_scatter_job(void *arg, int worker);
+void build_dedup_job(void *arg, int worker);
+void add_build_task(Build *build, void (*run)(Build *, BuildTask *, int),
+	void (*finish)(Build *, BuildTask *), int nparts);
+void build_tasks_job(void *arg, int worker);
+void run_build_tasks(Build *build, Workers *workers);
+void build_content_hash(Build *build, BuildTask *task, int part);
+void build_packed(Build *build, BuildTask *task, int part);
+void build_grams(Build *build, BuildTask *task, int part);
+void merge_grams(Build *build, BuildTask *task);
+void build_trigrams(Build *build, BuildTask *task, int part);
+void merge_trigrams(Build *build, BuildTask *task);
+void build_correction_indexes(Dict *dict);
+void start_budget(Dict *dict);
+bool over_budget(Dict *dict, long work);
+uint32_t lookup_rank(Dict *dict, char *word);
+void correction_edits(Dict *dict, char *wword, possibleword *cword);
+void correction_packed(Dict *dict, PackedWord wword, char *word, int n,
+	possibleword *cword);
+void packed_correction_hash(Dict *dict, int from, int to,
+	const Grams *filter, char *verify, possibleword *cword);
+void correction_hash(Dict *dict, int from, int to, const Grams *filter,
+	char *verify, possibleword *cword);
+bool within_two(Dict *dict, char *verify, uint32_t id);
+void correction_lookup(Dict *dict, char *wword, possibleword *cword,
+	int edist);
+void shared_scan_job(void *arg, int worker);
+bool lookup_match(StrArena *words, uint32_t id, char *wword, int n, int edist,
+	bool transpose, long *cells);
+int bounded_distance(char *word1, char *word2, int bound, bool transpose,
+	long *cells);
+void suggest_from_edits(Dict *dict, EditSet *edits, int from, int to, int dist,
+	const Grams *filter, char *verify, SuggestHeap *heap);
+int plausible_batch(EditSet *edits, int from, int n, const Grams *filter,
+	char **batch);
+bool suggestion_worse(Suggestion *a, Suggestion *b);
+bool heap_accepts(SuggestHeap *heap, int dist, int rank);
+void heap_push(SuggestHeap *heap, Suggestion item);
+bool heap_has(SuggestHeap *heap, int rank);
+
+/*----------------------------------------------------------------------*/
+/* INDEX CREATION/DELETION */
+
+Dict *new_dict(int nwords) {
+	return init_dict(new_str_arena(nwords), NULL, NULL, MEMO_HASH_INIT);
+}
+
+// an index over the given words, with its own scratch space
+Dict *init_dict(StrArena *words, PackedTable *packed, Grams *grams,
+		uint64_t content_hash) {
+	Dict *dict = malloc(sizeof *dict);
+	assert(dict);
+	dict->words = words;
+	dict->workers = NULL;
+	dict->transpositions = false;
+	dict->edits = new_edit_set();
+	dict->grams = grams;
+	dict->packed = packed;
+	dict->packed_edits = new_packed_set();
+	dict->trigrams = NULL;
+	dict->trigram_scratch = NULL;
+	dict_set_budget(dict, 0, 0);
+	dict->memo = NULL;
+	dict->content_hash = content_hash;
+	dict->view = false;
+	return dict;
+}
+
+Dict *dict_view(Dict *dict) {
+	// lookups on the words must leave them as they are from now on, and
+	// the views can't build the indexes a correction needs on their own
+	str_arena_freeze(dict->words);
+	build_correction_indexes(dict);
+
+	Dict *view = init_dict(dict->words, dict->packed, dict->grams,
+		dict->content_hash);
+	view->view = true;
+	view->transpositions = dict->transpositions;
+	view->word_budget = dict->word_budget;
+	view->doc_budget = dict->doc_budget;
+	view->memo = dict->memo;
+	if (dict->trigrams) {
+		view->trigrams = dict->trigrams;
+		view->trigram_scratch = new_trigram_scratch();
+	}
+	dict_set_threads(view, dict->workers ? workers_count(dict->workers) : 1);
+	return view;
+}
+
+void free_dict(Dict *dict) {
+	assert(dict != NULL);
+	if (!dict->view) {
+		free_str_arena(dict->words);
+		if (dict->grams) {
+			free_grams(dict->grams);
+			free_packed_table(dict->packed);
+		}
+		if (dict->trigrams) {
+			free_trigrams(dict->trigrams);
+		}
+	}
+	if (dict->trigram_scratch) {
+		free_trigram_scratch(dict->trigram_scratch);
+	}
+	free_edit_set(dict->edits);
+	free_packed_set(dict->packed_edits);
+	if (dict->workers) {
+		free_workers(dict->workers);
+	}
+	free(dict);
+}
+
+void dict_set_threads(Dict *dict, int nthreads) {
+	if (dict->workers) {
+		free_workers(dict->workers);
+		dict->workers = NULL;
+	}
+	if (nthreads > 1) {
+		dict->workers = new_workers(nthreads);
+	}
+}
+
+void dict_set_transpositions(Dict *dict, bool transpositions) {
+	dict->transpositions = transpositions;
+}
+
+void dict_set_trigrams(Dict *dict, bool trigrams) {
+	uint32_t nwords = str_arena_count(dict->words);
+
+	if (trigrams && !dict->trigrams) {
+		assert(!dict->view);
+		dict->trigrams = new_trigrams();
+		dict->trigram_scratch = new_trigram_scratch();
+
+		// a shard of the trigrams on each of the dictionary's workers
+		Build build;
+		memset(&build, 0, sizeof build);
+		build.dict = dict;
+		build.end_rank = nwords;
+		add_build_task(&build, build_trigrams, merge_trigrams,
+			dict->workers ? workers_count(dict->workers) : 1);
+		run_build_tasks(&build, dict->workers);
+	} else if (!trigrams && dict->trigrams) {
+		assert(!dict->view);
+		free_trigrams(dict->trigrams);
+		free_trigram_scratch(dict->trigram_scratch);
+		dict->trigrams = NULL;
+		dict->trigram_scratch = NULL;
+	}
+}
+
+void dict_set_budget(Dict *dict, long word_budget, long doc_budget) {
+	dict->word_budget = word_budget > 0 ? word_budget : LONG_MAX;
+	dict->doc_budget = doc_budget > 0 ? doc_budget : LONG_MAX;
+	dict->doc_used = 0;
+	dict->work = 0;
+	dict->limit = LONG_MAX;
+	dict->degraded = false;
+}
+
+bool dict_degraded(Dict *dict) {
+	return dict->degraded;
+}
+
+void dict_set_memo(Dict *dict, Memo *memo) {
+	dict->memo = memo;
+}
+
+uint64_t dict_content_hash(Dict *dict) {
+	return dict->content_hash;
+}
+
+int dict_add(Dict *dict, const char *word, size_t len) {
+	assert(!dict->view);
+	if (dict->grams) {
+		grams_add_word(dict->grams, word, len);
+	}
+
+	// a repeated word keeps the rank of its first occurrence
+	int added;
+	uint32_t id = str_arena_intern(dict->words, word, len, &added);
+	if (added) {
+		// each word ends with a '\0', so that no two lists hash alike
+		dict->content_hash = memo_hash(dict->content_hash, word, len);
+		dict->content_hash = memo_hash(dict->content_hash, "", 1);
+		if (dict->trigrams) {
+			trigrams_add(dict->trigrams, id, word, len);
+		}
+	}
+
+	PackedWord packed;
+	if (dict->packed && pack_word(word, len, &packed)) {
+		packed_table_put(dict->packed, packed, id);
+	}
+	return id;
+}
+
+int dict_size(Dict *dict) {
+	return str_arena_count(dict->words);
+}
+
+/*----------------------------------------------------------------------*/
+/* PARALLEL BUILDS */
+
+void dict_add_all(Dict *dict, const char *const *words, const size_t *lens,
+		int n, int nthreads) {
+	uint32_t i, c, s, at;
+	assert(!dict->view);
+
+	// words already in the index would have to be looked up one at a time
+	if (nthreads <= 1 || dict_size(dict) > 0 || n < 1) {
+		for (i = 0; i < (uint32_t)n; i++) {
+			dict_add(dict, words[i], lens[i]);
+		}
+		return;
+	}
+
+	Workers *workers = new_workers(nthreads);
+	Build build;
+	memset(&build, 0, sizeof build);
+	build.dict = dict;
+	build.words = words;
+	build.lens = lens;
+	build.n = n;
+	build.nchunks = (build.n + BUILD_CHUNK - 1) / BUILD_CHUNK;
+	build.nshards = BUILD_SHARDS * nthreads;
+	build.hashes = malloc(sizeof(uint64_t) * build.n);
+	build.placed = calloc((size_t)build.nchunks * build.nshards,
+		sizeof(uint32_t));
+	build.order = malloc(sizeof(uint32_t) * build.n);
+	build.shard_ends = malloc(sizeof(uint32_t) * build.nshards);
+	build.kept = malloc(sizeof(bool) * build.n);
+	assert(build.hashes && build.placed && build.order && build.shard_ends
+		&& build.kept);
+
+	// hash the words, and count those of each chunk in each shard
+	workers_run(workers, build_hash_job, &build);
+
+	// lay the shards out one after the other, each chunk's words of a
+	// shard after the earlier chunks' ones, and put the words in place
+	at = 0;
+	for (s = 0; s < build.nshards; s++) {
+		for (c = 0; c < build.nchunks; c++) {
+			uint32_t count = build.placed[c * build.nshards + s];
+			build.placed[c * build.nshards + s] = at;
+			at += count;
+		}
+		build.shard_ends[s] = at;
+	}
+	build.next = 0;
+	workers_run(workers, build_scatter_job, &build);
+
+	// find the first occurrence of every word, one shard at a time
+	build.next = 0;
+	workers_run(workers, build_dedup_job, &build);
+
+	// intern the words kept, in input order: their ranks are the same as
+	// if they were added one at a time
+	const char **kept = malloc(sizeof(char *) * build.n);
+	size_t *kept_lens = malloc(sizeof(size_t) * build.n);
+	assert(kept && kept_lens);
+	uint32_t nkept = 0;
+	for (i = 0; i < build.n; i++) {
+		if (build.kept[i]) {
+			kept[nkept] = words[i];
+			kept_lens[nkept++] = lens[i];
+		}
+	}
+	build.first_rank = str_arena_add_all(dict->words, kept, kept_lens, nkept,
+		workers);
+	build.end_rank = build.first_rank + nkept;
+	free(kept);
+	free(kept_lens);
+
+	// then every index over them (but those only corrections need, until
+	// the first one). tasks of a single part go first, so the parts of the
+	// others fill in around them
+	if (dict->packed) {
+		add_build_task(&build, build_packed, NULL, 1);
+	}
+	add_build_task(&build, build_content_hash, NULL, 1);
+	if (dict->grams) {
+		add_build_task(&build, build_grams, merge_grams, nthreads);
+	}
+	if (dict->trigrams) {
+		add_build_task(&build, build_trigrams, merge_trigrams, nthreads);
+	}
+	run_build_tasks(&build, workers);
+
+	free(build.hashes);
+	free(build.placed);
+	free(build.order);
+	free(build.shard_ends);
+	free(build.kept);
+	free_workers(workers);
+}
+
+// the shard of a word with hash 'hash', from other bits than its slot
+#define BUILD_SHARD(BUILD, HASH) ((uint32_t)((HASH) >> 32) % (BUILD)->nshards)
+
+/* Hashes the words a chunk at a time, counting how many of each chunk fall
+ * in each shard
+ */
+void build_hash_job(void *arg, int worker) {
+	Build *build = arg;
+	uint32_t c, i;
+
+	while ((c = __atomic_fetch_add(&build->next, 1, __ATOMIC_RELAXED))
+			< build->nchunks) {
+		uint32_t *placed = build->placed + (size_t)c * build->nshards;
+		uint32_t end = MIN(build->n, (c + 1) * BUILD_CHUNK);
+		for (i = c * BUILD_CHUNK; i < end; i++) {
+			build->hashes[i] = memo_hash(MEMO_HASH_INIT, build->words[i],
+				build->lens[i]);
+			placed[BUILD_SHARD(build, build->hashes[i])]++;
+		}
+	}
+}
+
+/* Puts the words of each chunk in their places among their shards'
+ */
+void build_scatter_job(void *arg, int worker) {
+	Build *build = arg;
+	uint32_t c, i;
+
+	while ((c = __atomic_fetch_add(&build->next, 1, __ATOMIC_RELAXED))
+			< build->nchunks) {
+		uint32_t *placed = build->placed + (size_t)c * build->nshards;
+		uint32_t end = MIN(build->n, (c + 1) * BUILD_CHUNK);
+		for (i = c * BUILD_CHUNK; i < end; i++) {
+			build->order[placed[BUILD_SHARD(build, build->hashes[i])]++] = i;
+		}
+	}
+}
+
+/* Keeps the first occurrence of every word, a shard at a time: a shard's
+ * words are in input order, and go into a table of their own (open
+ * addressing, holding word + 1, or 0 if empty) unless they're there already
+ */
+void build_dedup_job(void *arg, int worker) {
+	Build *build = arg;
+	uint32_t s, j;
+
+	while ((s = __atomic_fetch_add(&build->next, 1, __ATOMIC_RELAXED))
+			< build->nshards) {
+		uint32_t start = s ? build->shard_ends[s - 1] : 0;
+		uint32_t end = build->shard_ends[s];
+		uint32_t nslots = 1;
+		while (nslots < 2 * (end - start)) {
+			nslots *= 2;
+		}
+		uint32_t *slots = calloc(nslots, sizeof(uint32_t));
+		assert(slots);
+
+		for (j = start; j < end; j++) {
+			uint32_t i = build->order[j], slot;
+			uint64_t hash = build->hashes[i];
+			build->kept[i] = true;
+			for (slot = hash & (nslots - 1); slots[slot];
+					slot = (slot + 1) & (nslots - 1)) {
+				uint32_t other = slots[slot] - 1;
+				if (build->hashes[other] == hash
+						&& build->lens[other] == build->lens[i]
+						&& memcmp(build->words[other], build->words[i],
+							build->lens[i]) == 0) {
+					build->kept[i] = false;
+					break;
+				}
+			}
+			if (build->kept[i]) {
+				slots[slot] = i + 1;
+			}
+		}
+		free(slots);
+	}
+}
+
+/* Adds an index to the tasks of a build, in 'nparts' parts
+ */
+void add_build_task(Build *build, void (*run)(Build *, BuildTask *, int),
+		void (*finish)(Build *, BuildTask *), int nparts) {
+	assert(build->ntasks < MAX_BUILD_TASKS);
+	BuildTask *task = &build->tasks[build->ntasks++];
+	task->run = run;
+	task->finish = finish;
+	task->nparts = nparts;
+	task->parts = calloc(nparts, sizeof(void *));
+	assert(task->parts);
+}
+
+/* Runs the next part of any task of a build, until there are none left
+ */
+void build_tasks_job(void *arg, int worker) {
+	Build *build = arg;
+	uint32_t part;
+	int t;
+
+	for (;;) {
+		part = __atomic_fetch_add(&build->next, 1, __ATOMIC_RELAXED);
+		for (t = 0; t < build->ntasks
+				&& part >= (uint32_t)build->tasks[t].nparts; t++) {
+			part -= build->tasks[t].nparts;
+		}
+		if (t == build->ntasks) {
+			return;
+		}
+		build->tasks[t].run(build, &build->tasks[t], part);
+	}
+}
+
+/* Runs every part of every task of a build on 'workers' (or the calling
+ * thread alone if NULL), and then finishes each task
+ */
+void run_build_tasks(Build *build, Workers *workers) {
+	int t;
+
+	build->next = 0;
+	if (workers) {
+		workers_run(workers, build_tasks_job, build);
+	} else {
+		build_tasks_job(build, 0);
+	}
+	for (t = 0; t < build->ntasks; t++) {
+		if (build->tasks[t].finish) {
+			build->tasks[t].finish(build, &build->tasks[t]);
+		}
+		free(build->tasks[t].parts);
+	}
+	build->ntasks = 0;
+}
+
+/* The content hash of the index, over the new words in rank order
+ */
+void build_content_hash(Build *build, BuildTask *task, int part) {
+	Dict *dict = build->dict;
+	uint32_t id;
+	for (id = build->first_rank; id < build->end_rank; id++) {
+		dict->content_hash = memo_hash(dict->content_hash,
+			str_arena_get(dict->words, id), str_arena_len(dict->words, id));
+		dict->content_hash = memo_hash(dict->content_hash, "", 1);
+	}
+}
+
+/* The packed table, in rank order: where a word goes depends on the words
+ * put before it
+ */
+void build_packed(Build *build, BuildTask *task, int part) {
+	Dict *dict = build->dict;
+	PackedWord batch[PROBE_BATCH];
+	uint32_t ranks[PROBE_BATCH], id;
+	int n = 0;
+
+	for (id = build->first_rank; id < build->end_rank; id++) {
+		if (pack_word(str_arena_get(dict->words, id),
+				str_arena_len(dict->words, id), &batch[n])) {
+			ranks[n++] = id;
+		}
+		if (n == PROBE_BATCH || id + 1 == build->end_rank) {
+			packed_table_put_batch(dict->packed, batch, ranks, n);
+			n = 0;
+		}
+	}
+}
+
+/* The n-gram filter of a range of the new words: part 0 fills the index's
+ * own filter, the others a filter each
+ */
+void build_grams(Build *build, BuildTask *task, int part) {
+	Dict *dict = build->dict;
+	uint32_t count = build->end_rank - build->first_rank, id;
+	uint32_t from = build->first_rank + (uint64_t)count*part / task->nparts;
+	uint32_t to = build->first_rank + (uint64_t)count*(part+1) / task->nparts;
+
+	Grams *grams = dict->grams;
+	if (part > 0) {
+		grams = task->parts[part] = new_grams();
+	}
+	for (id = from; id < to; id++) {
+		grams_add_word(grams, str_arena_get(dict->words, id),
+			str_arena_len(dict->words, id));
+	}
+}
+
+void merge_grams(Build *build, BuildTask *task) {
+	int part;
+	for (part = 1; part < task->nparts; part++) {
+		grams_merge(build->dict->grams, task->parts[part]);
+		free_grams(task->parts[part]);
+	}
+}
+
+/* A shard of the trigram index, over all of the new words: part 0 fills
+ * the index itself, the others an index each
+ */
+void build_trigrams(Build *build, BuildTask *task, int part) {
+	Dict *dict = build->dict;
+	uint32_t id;
+
+	Trigrams *trigrams = dict->trigrams;
+	if (part > 0) {
+		trigrams = task->parts[part] = new_trigrams();
+	}
+	for (id = build->first_rank; id < build->end_rank; id++) {
+		trigrams_add_shard(trigrams, id, str_arena_get(dict->words, id),
+			str_arena_len(dict->words, id), part, task->nparts);
+	}
+}
+
+void merge_trigrams(Build *build, BuildTask *task) {
+	int part;
+	for (part = 1; part < task->nparts; part++) {
+		trigrams_merge(build->dict->trigrams, task->parts[part]);
+	}
+}
+
+/* Builds the n-gram filter and the packed table over every word, on the
+ * dictionary's workers, if they aren't built yet: Task 3 never needs them,
+ * so they wait for the first correction
+ */
+void build_correction_indexes(Dict *dict) {
+	uint32_t nwords = str_arena_count(dict->words);
+
+	if (dict->grams) {
+		return;
+	}
+	assert(!dict->view);
+	dict->grams = new_grams();
+	dict->packed = new_packed_table(nwords);
+
+	Build build;
+	memset(&build, 0, sizeof build);
+	build.dict = dict;
+	build.end_rank = nwords;
+	add_build_task(&build, build_packed, NULL, 1);
+	add_build_task(&build, build_grams, merge_grams,
+		dict->workers ? workers_count(dict->workers) : 1);
+	run_build_tasks(&build, dict->workers);
+}
+
+/*----------------------------------------------------------------------*/
+/* BASE INDEX IMAGES */
+
+#define IMAGE_MAGIC "a2base1\n"	// first bytes of every base index image
+
+// the head of a base index image: the images of the word arena, of the
+// packed table and of the n-gram filter follow, in that order
+typedef struct {
+	char magic[8];
+	uint64_t content_hash;
+	uint64_t words_len;
+	uint64_t packed_len;
+	uint64_t grams_len;
+} ImageHead;
+
+bool dict_write(Dict *dict, FILE *file) {
+	ImageHead head;
+	build_correction_indexes(dict);
+	memset(&head, 0, sizeof head);
+	memcpy(head.magic, IMAGE_MAGIC, sizeof head.magic);
+	head.content_hash = dict->content_hash;
+
+	// the head is written again at the end, once the lengths are known
+	long start = ftell(file), at;
+	bool ok = start >= 0 && fwrite(&head, sizeof head, 1, file) == 1;
+	if (ok && (at = ftell(file)) >= 0 && str_arena_write(dict->words, file)) {
+		head.words_len = ftell(file) - at;
+	} else {
+		ok = false;
+	}
+	if (ok && (at = ftell(file)) >= 0
+			&& packed_table_write(dict->packed, file)) {
+		head.packed_len = ftell(file) - at;
+	} else {
+		ok = false;
+	}
+	if (ok && (at = ftell(file)) >= 0 && grams_write(dict->grams, file)) {
+		head.grams_len = ftell(file) - at;
+	} else {
+		ok = false;
+	}
+
+	return ok && fseek(file, start, SEEK_SET) == 0
+		&& fwrite(&head, sizeof head, 1, file) == 1
+		&& fseek(file, 0, SEEK_END) == 0;
+}
+
+bool dict_is_image(const char *data, size_t len) {
+	return len >= sizeof(ImageHead)
+		&& memcmp(data, IMAGE_MAGIC, strlen(IMAGE_MAGIC)) == 0;
+}
+
+Dict *dict_map(const char *data, size_t len) {
+	ImageHead head;
+	if (!dict_is_image(data, len)) {
+		return NULL;
+	}
+	memcpy(&head, data, sizeof head);
+	if (head.words_len > len || head.packed_len > len || head.grams_len > len
+			|| sizeof head + head.words_len + head.packed_len
+				+ head.grams_len > len) {
+		return NULL;
+	}
+
+	const char *at = data + sizeof head;
+	StrArena *words = str_arena_map(at, head.words_len);
+	at += head.words_len;
+	PackedTable *packed = packed_table_map(at, head.packed_len);
+	at += head.packed_len;
+	Grams *grams = grams_read(at, head.grams_len);
+	if (!words || !packed || !grams) {
+		if (words) {
+			free_str_arena(words);
+		}
+		if (packed) {
+			free_packed_table(packed);
+		}
+		if (grams) {
+			free_grams(grams);
+		}
+		return NULL;
+	}
+	return init_dict(words, packed, grams, head.content_hash);
+}
+
+/*----------------------------------------------------------------------*/
+/* CHECKING AND CORRECTING */
+
+bool dict_has(Dict *dict, char *word) {
+	return lookup_rank(dict, word) != STR_ARENA_NONE;
+}
+
+int dict_rank(Dict *dict, char *word) {
+	uint32_t id = lookup_rank(dict, word);
+	return id == STR_ARENA_NONE ? DICT_NONE : (int)id;
+}
+
+/* Attempts to correct 'wword' with a Levenshtein (or optimal string
+ * alignment) edit distance of 1, 2 or 3, trying the cheapest distance first
+ */
+char *dict_correct(Dict *dict, char *wword, int *rank, int *dist) {
+	StrArena *words = dict->words;
+	possibleword cword;
+
+	cword.corr=0;
+	cword.pos=str_arena_count(words);
+	cword.dist=0;
+
+	// the search stops early, at the best correction so far, once the
+	// word has used up its budget
+	start_budget(dict);
+
+	//--- CASE 1: Correctly spelled word ---//
+	uint32_t id = lookup_rank(dict, wword);
+	over_budget(dict, 1);
+	if (id != STR_ARENA_NONE) {
+		cword.word = str_arena_get(words, id);
+		cword.pos = id;
+		cword.corr = 1;
+		dict->degraded = false;
+		dict->doc_used += dict->work;
+		return report_correction(&cword, rank, dist);
+	}
+
+	// a misspelling corrected before, by this run or an earlier one
+	int memo_rank, memo_dist;
+	if (dict->memo && memo_find(dict->memo, wword, &memo_rank, &memo_dist)
+			&& memo_rank < cword.pos) {
+		if (memo_rank != DICT_NONE) {
+			cword.word = str_arena_get(words, memo_rank);
+			cword.pos = memo_rank;
+			cword.dist = memo_dist;
+			cword.corr = 1;
+		}
+		dict->degraded = false;
+		dict->doc_used += dict->work;
+		return report_correction(&cword, rank, dist);
+	}
+
+	// short lowercase words, whose edits all still pack, are searched on
+	// their packed form, without ever touching a string
+	build_correction_indexes(dict);
+	int n = strlen(wword);
+	PackedWord packed;
+	if (dict->degraded) {
+		// the document has used up its budget already
+	} else if (n <= PACKED_MAX_LEN - 2 && pack_word(wword, n, &packed)) {
+		correction_packed(dict, packed, wword, n, &cword);
+	} else {
+		correction_edits(dict, wword, &cword);
+	}
+
+	//--- CASE 4: Three edit-distance away ---//
+	if (!cword.corr && !dict->degraded) {
+		// perform a direct lookup
+		correction_lookup(dict, wword, &cword, 3);
+		if (cword.corr) {
+			cword.dist = 3;
+		}
+	}
+
+	dict->doc_used += dict->work;
+	char *found = report_correction(&cword, rank, dist);
+
+	// a search cut short by the budget may have missed the real answer
+	if (dict->memo && !dict->degraded) {
+		memo_add(dict->memo, wword, cword.pos, cword.dist,
+			found ? found : "");
+	}
+	return found;
+}
+
+/* Sets the work the next word may do: its own budget, or whatever is left
+ * of the document's, if that is less
+ */
+void start_budget(Dict *dict) {
+	dict->work = 0;
+	dict->degraded = false;
+	dict->limit = dict->word_budget;
+	if (dict->doc_budget != LONG_MAX) {
+		dict->limit = MIN(dict->limit, dict->doc_budget - dict->doc_used);
+	}
+}
+
+/* Counts 'work' more units of work on the current word. returns whether it
+ * has now gone over its budget, and marks it as degraded if so
+ */
+bool over_budget(Dict *dict, long work) {
+	dict->work += work;
+	if (dict->work > dict->limit) {
+		dict->degraded = true;
+	}
+	return dict->degraded;
+}
+
+/* Searches for the correction of 'wword' among its edits at distance 1,
+ * and then 2
+ */
+void correction_edits(Dict *dict, char *wword, possibleword *cword) {
+	EditSet *edits;
+	int i, first, nedits1;
+
+	// every word generated for this query goes into one set, so that no
+	// word is probed twice. the misspelled word itself is never a candidate
+	edits = dict->edits;
+	edit_set_clear(edits);
+	edit_set_add(edits, wword, strlen(wword));
+
+	//--- CASE 2: One edit-distance away ---//
+	// generate the set of 1 edit distance words. all of them are kept, as
+	// the starting points of distance 2, but only plausible ones are probed
+	nedits1 = 1 + add_edits(edits, wword, NULL, dict->transpositions);
+	over_budget(dict, nedits1);
+
+	// searches for the corrected version of the word
+	correction_hash(dict, 1, nedits1, dict->grams, NULL, cword);
+	cword->dist=1;
+
+	//--- CASE 3: Two edit-distance away ---//
+	if (!cword->corr && !dict->degraded) {
+		cword->dist=2;
+
+		// for each 1 edit dist word, search for another 1 edit dist words
+		// only plausible words not seen before are added, and then probed
+		// (a swap and then an edit inside it is 3 apart, so with
+		// transpositions every hit is checked against the word)
+		char *verify = dict->transpositions ? wword : NULL;
+		for (i=1; i<nedits1 && !dict->degraded; i++) {
+			first = edit_set_count(edits);
+			over_budget(dict, add_edits(edits, edit_set_word(edits, i),
+				dict->grams, dict->transpositions));
+			correction_hash(dict, first, edit_set_count(edits), NULL, verify,
+				cword);
+		}
+	}
+}
+
+/* The same search as correction_edits(), on the packed form 'wword' of
+ * 'word', of 'n' letters
+ */
+void correction_packed(Dict *dict, PackedWord wword, char *word, int n,
+		possibleword *cword) {
+	PackedSet *edits = dict->packed_edits;
+	int i, first, nedits1;
+
+	packed_set_clear(edits);
+	packed_set_add(edits, wword);
+
+	//--- CASE 2: One edit-distance away ---//
+	nedits1 = 1 + add_packed_edits(edits, wword, n, NULL,
+		dict->transpositions);
+	over_budget(dict, nedits1);
+	packed_correction_hash(dict, 1, nedits1, dict->grams, NULL, cword);
+	cword->dist=1;
+
+	//--- CASE 3: Two edit-distance away ---//
+	if (!cword->corr && !dict->degraded) {
+		cword->dist=2;
+		char *verify = dict->transpositions ? word : NULL;
+		for (i=1; i<nedits1 && !dict->degraded; i++) {
+			PackedWord edit = packed_set_word(edits, i);
+			first = packed_set_count(edits);
+			over_budget(dict, add_packed_edits(edits, edit, packed_len(edit),
+				dict->grams, dict->transpositions));
+			packed_correction_hash(dict, first, packed_set_count(edits), NULL,
+				verify, cword);
+		}
+	}
+}
+
+/* Hands the rank and edit distance of a correction back to the caller,
+ * if they asked for them, and returns the corrected word (or NULL)
+ */
+char *report_correction(possibleword *cword, int *rank, int *dist) {
+	if (!cword->corr) {
+		cword->word = NULL;
+		cword->pos = DICT_NONE;
+		cword->dist = DICT_NONE;
+	}
+	if (rank) {
+		*rank = cword->pos;
+	}
+	if (dist) {
+		*dist = cword->dist;
+	}
+	return cword->word;
+}
+
+/*----------------------------------------------------------------------*/
+/* TOP-K SUGGESTIONS */
+
+int compare_suggestions(const void *a, const void *b) {
+	Suggestion *sa = (Suggestion *)a, *sb = (Suggestion *)b;
+	if (sa->dist != sb->dist) {
+		return sa->dist - sb->dist;
+	}
+	return sa->rank - sb->rank;
+}
+
+/* Finds the 'k' best suggestions within 'maxdist' of 'wword', one distance
+ * at a time: distance 0, 1 and 2 by probing edits, then the rest by a scan
+ * of the dictionary. once k suggestions are in hand, a larger distance can
+ * no longer enter them, so the search stops
+ */
+int dict_suggest(Dict *dict, char *wword, int k, int maxdist, Suggestion *out) {
+	StrArena *words = dict->words;
+	SuggestHeap heap = { out, 0, k };
+	EditSet *edits;
+	int i, d, first, nedits1;
+
+	if (k < 1 || maxdist < 0) {
+		return 0;
+	}
+	build_correction_indexes(dict);
+
+	// distance 0: the word itself
+	uint32_t id = str_arena_find(words, wword);
+	if (id != STR_ARENA_NONE) {
+		Suggestion exact = { str_arena_get(words, id), id, 0 };
+		heap_push(&heap, exact);
+	}
+
+	// distance 1 and 2: probe the edits of the word, and their edits
+	// the edit set only yields each word once, at its smallest distance
+	if (heap.n < k && maxdist >= 1) {
+		edits = dict->edits;
+		edit_set_clear(edits);
+		edit_set_add(edits, wword, strlen(wword));
+		add_edits(edits, wword, NULL, dict->transpositions);
+		nedits1 = edit_set_count(edits);
+		suggest_from_edits(dict, edits, 1, nedits1, 1, dict->grams, NULL,
+			&heap);
+
+		if (heap.n < k && maxdist >= 2) {
+			char *verify = dict->transpositions ? wword : NULL;
+			for (i=1; i<nedits1; i++) {
+				first = edit_set_count(edits);
+				add_edits(edits, edit_set_word(edits, i), dict->grams,
+					dict->transpositions);
+				suggest_from_edits(dict, edits, first, edit_set_count(edits),
+					2, NULL, verify, &heap);
+			}
+		}
+	}
+
+	// distance 3 and up: scan the dictionary in rank order. a word can
+	// only get in at a strictly smaller distance than the worst suggestion
+	// of a full heap, since every later word has a larger rank
+	if (heap.n < k && maxdist >= 3) {
+		int n = strlen(wword);
+		int bound = maxdist;
+		int nwords = str_arena_count(words);
+
+		// only the words the trigram index can't rule out, if it can
+		const uint32_t *ranks = NULL;
+		long probes = 0;
+		if (dict->trigrams) {
+			int ncands = trigrams_candidates(dict->trigrams,
+				dict->trigram_scratch, wword, n, maxdist,
+				dict->transpositions, &ranks, &probes);
+			if (ncands >= 0) {
+				nwords = ncands;
+			}
+		}
+		for (i=0; i<nwords; i++) {
+			id = ranks ? ranks[i] : (uint32_t)i;
+			if (heap.n == k) {
+				bound = MIN(maxdist, heap.items[0].dist - 1);
+				if (bound < 3) {
+					// nothing left in the dictionary can get in
+					break;
+				}
+			}
+			char *word = str_arena_get(words, id);
+			if (ABS((int)str_arena_len(words, id) - n) > bound) {
+				continue;
+			}
+			d = bounded_distance(word, wword, bound, dict->transpositions,
+				NULL);
+			if (d >= 3 && d <= bound && !heap_has(&heap, id)) {
+				Suggestion found = { word, id, d };
+				heap_push(&heap, found);
+			}
+		}
+	}
+
+	qsort(out, heap.n, sizeof *out, compare_suggestions);
+	return heap.n;
+}
+
+/* Offers every dictionary word among edits [from, to) to the heap, as a
+ * suggestion at distance 'dist'. edits failing 'filter' (if not NULL) are
+ * skipped without a lookup, and words more than 2 edits from 'verify' (if
+ * not NULL) are left out
+ */
+void suggest_from_edits(Dict *dict, EditSet *edits, int from, int to, int dist,
+		const Grams *filter, char *verify, SuggestHeap *heap) {
+	char *batch[PROBE_BATCH];
+	uint32_t ids[PROBE_BATCH];
+	int i, j, n;
+
+	for (i=from; i<to; i+=PROBE_BATCH) {
+		n = plausible_batch(edits, i, MIN(PROBE_BATCH, to-i), filter, batch);
+		str_arena_find_batch(dict->words, batch, n, ids);
+
+		for (j=0; j<n; j++) {
+			uint32_t id = ids[j];
+			if (id != STR_ARENA_NONE && heap_accepts(heap, dist, id)
+					&& within_two(dict, verify, id)) {
+				Suggestion found = { str_arena_get(dict->words, id), id, dist };
+				heap_push(heap, found);
+			}
+		}
+	}
+}
+
+/* Returns whether suggestion 'a' should come after suggestion 'b'
+ */
+bool suggestion_worse(Suggestion *a, Suggestion *b) {
+	return a->dist > b->dist || (a->dist == b->dist && a->rank > b->rank);
+}
+
+/* Returns whether a suggestion would currently make it into the heap
+ */
+bool heap_accepts(SuggestHeap *heap, int dist, int rank) {
+	Suggestion candidate = { NULL, rank, dist };
+	return heap->n < heap->k || suggestion_worse(&heap->items[0], &candidate);
+}
+
+/* Returns whether the word of rank 'rank' is among the suggestions
+ */
+bool heap_has(SuggestHeap *heap, int rank) {
+	int i;
+	for (i=0; i<heap->n; i++) {
+		if (heap->items[i].rank == rank) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/* Adds a suggestion to the heap, pushing out the worst one if it is full
+ * and the new suggestion is better
+ */
+void heap_push(SuggestHeap *heap, Suggestion item) {
+	Suggestion *items = heap->items, tmp;
+	int i, child;
+
+	if (heap->n < heap->k) {
+		// sift the new item up from the bottom
+		i = heap->n++;
+		items[i] = item;
+		while (i > 0 && suggestion_worse(&items[i], &items[(i-1)/2])) {
+			tmp = items[i];
+			items[i] = items[(i-1)/2];
+			items[(i-1)/2] = tmp;
+			i = (i-1)/2;
+		}
+		return;
+	}
+	if (!suggestion_worse(&items[0], &item)) {
+		return;
+	}
+
+	// replace the root, and sift it down
+	items[0] = item;
+	i = 0;
+	while ((child = 2*i+1) < heap->n) {
+		if (child+1 < heap->n
+				&& suggestion_worse(&items[child+1], &items[child])) {
+			child++;
+		}
+		if (!suggestion_worse(&items[child], &items[i])) {
+			break;
+		}
+		tmp = items[i];
+		items[i] = items[child];
+		items[child] = tmp;
+		i = child;
+	}
+}
+
+/*----------------------------------------------------------------------*/
+/* SOME HELPER FUNCTIONS */
+
+
+/* Returns the rank of 'word', or STR_ARENA_NONE: from the packed table (if
+ * built) if the word packs, as no longer word can be in it
+ */
+uint32_t lookup_rank(Dict *dict, char *word) {
+	PackedWord packed;
+	if (dict->packed && pack_word(word, strlen(word), &packed)) {
+		uint32_t rank = packed_table_get(dict->packed, packed);
+		return rank == PACKED_NONE ? STR_ARENA_NONE : rank;
+	}
+	return str_arena_find(dict->words, word);
+}
+
+/* correction_hash() for packed edits [from, to) of the index's packed set
+ */
+void packed_correction_hash(Dict *dict, int from, int to,
+		const Grams *filter, char *verify, possibleword *cword) {
+	PackedWord batch[PROBE_BATCH];
+	uint32_t ranks[PROBE_BATCH];
+	int i, j, n, len;
+
+	for (i=from; i<to; i+=PROBE_BATCH) {
+		n = 0;
+		for (j=i; j<MIN(i+PROBE_BATCH, to); j++) {
+			PackedWord word = packed_set_word(dict->packed_edits, j);
+			len = packed_len(word);
+			if (!filter || grams_packed_plausible_at(filter, word, len, 0,
+					len-1)) {
+				batch[n++] = word;
+			}
+		}
+		packed_table_get_batch(dict->packed, batch, n, ranks);
+
+		for (j=0; j<n; j++) {
+			if (ranks[j] != PACKED_NONE && (int)ranks[j] <= cword->pos
+					&& within_two(dict, verify, ranks[j])) {
+				cword->word = str_arena_get(dict->words, ranks[j]);
+				cword->pos = ranks[j];
+				cword->corr=1;
+			}
+		}
+		if (over_budget(dict, n)) {
+			return;
+		}
+	}
+}
+
+/* Collects edits [from, from+n) of a set into 'batch', leaving out those
+ * holding an n-gram of letters no dictionary word has (if 'filter' is not
+ * NULL), and returns how many were kept
+ */
+int plausible_batch(EditSet *edits, int from, int n, const Grams *filter,
+		char **batch) {
+	int j, kept = 0;
+	for (j=0; j<n; j++) {
+		char *word = edit_set_word(edits, from+j);
+		if (!filter || grams_plausible(filter, word, strlen(word))) {
+			batch[kept++] = word;
+		}
+	}
+	return kept;
+}
+
+/* Finds the corrected word that shows first in the dictionary, by comparing 
+ * edited words [from, to) of the index's edit set to a hash table of
+ * dictionary words. edits failing 'filter' (if not NULL) are skipped
+ * without a lookup, and words more than 2 edits from 'verify' (if not NULL)
+ * are passed over. stops early if the word runs out of budget
+ */
+void correction_hash(Dict *dict, int from, int to, const Grams *filter,
+		char *verify, possibleword *cword) {
+	EditSet *edits = dict->edits;
+	StrArena *words = dict->words;
+	char *batch[PROBE_BATCH];
+	uint32_t ids[PROBE_BATCH];
+	int i, j, n;
+
+	// the edits are probed a batch at a time, so that their cache misses
+	// overlap instead of following one after the other
+	for (i=from; i<to; i+=PROBE_BATCH) {
+		n = plausible_batch(edits, i, MIN(PROBE_BATCH, to-i), filter, batch);
+		str_arena_find_batch(words, batch, n, ids);
+
+		for (j=0; j<n; j++) {
+			uint32_t id = ids[j];
+
+			// a corrected word is found, and it shows up first in the
+			// dictionary so far
+			if (id != STR_ARENA_NONE && (int)id <= cword->pos
+					&& within_two(dict, verify, id)) {
+				// store some values of the corrected word
+				cword->word = str_arena_get(words, id);
+				cword->pos = id;
+				cword->corr=1;
+			}
+		}
+		if (over_budget(dict, n)) {
+			return;
+		}
+	}
+}
+
+/* Returns whether the word of rank 'id' is within 2 edits of 'verify', or
+ * true if 'verify' is NULL: with transpositions, an edit of an edit may be
+ * 3 apart from the word it started from
+ */
+bool within_two(Dict *dict, char *verify, uint32_t id) {
+	return !verify || bounded_distance(str_arena_get(dict->words, id),
+		verify, 2, dict->transpositions, NULL) <= 2;
+}
+
+/* Finds the corrected word that shows first in the dictionary, by iterating 
+ * through the whole dictionary and comparing it to the wrong word,
+ * with a given specific edit distance
+ */
+void correction_lookup(Dict *dict, char *wword, possibleword *cword,
+		int edist) {
+	StrArena *words = dict->words;
+	int n=strlen(wword);
+	uint32_t id, nwords=str_arena_count(words);
+	long cells=0;
+	int i;
+
+	// verify only the words the trigram index can't rule out, if it can
+	if (dict->trigrams) {
+		const uint32_t *ranks;
+		int ncands = trigrams_candidates(dict->trigrams,
+			dict->trigram_scratch, wword, n, edist, dict->transpositions,
+			&ranks, &cells);
+		if (ncands >= 0) {
+			for (i=0; i<ncands; i++) {
+				if (i % CANCEL_CHECK == 0) {
+					if (over_budget(dict, cells)) {
+						return;
+					}
+					cells = 0;
+				}
+				if (lookup_match(words, ranks[i], wword, n, edist,
+						dict->transpositions, &cells)) {
+					cword->word = str_arena_get(words, ranks[i]);
+					cword->pos = ranks[i];
+					cword->corr=1;
+					break;
+				}
+			}
+			dict->work += cells;
+			return;
+		}
+	}
+
+	if (dict->workers) {
+		// split the scan between the workers
+		SharedScan scan = { words, wword, edist, dict->transpositions, nwords,
+			0, STR_ARENA_NONE, dict->limit - dict->work, 0, false };
+		workers_run(dict->workers, shared_scan_job, &scan);
+		dict->work += scan.work;
+		if (scan.exhausted) {
+			dict->degraded = true;
+		}
+		if (scan.best != STR_ARENA_NONE) {
+			cword->word = str_arena_get(words, scan.best);
+			cword->pos = scan.best;
+			cword->corr=1;
+		}
+		return;
+	}
+
+	// iterates through the whole dictionary, in rank order: the words
+	// are packed one after the other, so this streams through memory
+	for (id=0; id<nwords; id++) {
+		if (id % CANCEL_CHECK == 0) {
+			if (over_budget(dict, cells)) {
+				return;
+			}
+			cells = 0;
+		}
+		if (lookup_match(words, id, wword, n, edist, dict->transpositions,
+				&cells)) {
+			// a corrected word is found
+			cword->word = str_arena_get(words, id);
+			cword->pos = id;
+			cword->corr=1;
+			break;
+		}
+	}
+	dict->work += cells;
+}
+
+/* One worker's share of a dictionary scan. chunks are handed out in rank
+ * order, and a match only ever lowers the best rank, so a worker can stop
+ * as soon as it reaches a rank above the best: nothing there can win
+ */
+void shared_scan_job(void *arg, int worker) {
+	SharedScan *scan = arg;
+	int n=strlen(scan->wword);
+	uint32_t id, start, end, best;
+	long cells=0;
+
+	for (;;) {
+		start = __atomic_fetch_add(&scan->next, SCAN_CHUNK, __ATOMIC_RELAXED);
+		if (start >= scan->nwords
+				|| start > __atomic_load_n(&scan->best, __ATOMIC_RELAXED)) {
+			break;
+		}
+		end = MIN(start + SCAN_CHUNK, scan->nwords);
+
+		for (id=start; id<end; id++) {
+			if (id % CANCEL_CHECK == 0) {
+				if (id > __atomic_load_n(&scan->best, __ATOMIC_RELAXED)) {
+					// another worker already has a better match
+					break;
+				}
+				// all the workers share one budget
+				if (__atomic_add_fetch(&scan->work, cells, __ATOMIC_RELAXED)
+						> scan->limit) {
+					__atomic_store_n(&scan->exhausted, true, __ATOMIC_RELAXED);
+					return;
+				}
+				cells = 0;
+			}
+			if (lookup_match(scan->words, id, scan->wword, n, scan->edist,
+					scan->transpose, &cells)) {
+				// lower the best rank to 'id', unless it's lower already
+				best = __atomic_load_n(&scan->best, __ATOMIC_RELAXED);
+				while (id < best && !__atomic_compare_exchange_n(&scan->best,
+						&best, id, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+				}
+				// the rest of this worker's ranks are all higher
+				__atomic_add_fetch(&scan->work, cells, __ATOMIC_RELAXED);
+				return;
+			}
+		}
+		if (id < end) {
+			break;
+		}
+	}
+	__atomic_add_fetch(&scan->work, cells, __ATOMIC_RELAXED);
+}
+
+/* Returns whether dictionary word 'id' is exactly 'edist' edits from
+ * 'wword' (of length 'n'), adding the table cells filled to '*cells'
+ */
+bool lookup_match(StrArena *words, uint32_t id, char *wword, int n, int edist,
+		bool transpose, long *cells) {
+	if (ABS((int)str_arena_len(words, id) - n) > edist) {
+		// too long or too short to be a match
+		return false;
+	}
+
+	// compares it's edit distance
+	return bounded_distance(str_arena_get(words, id), wword, edist,
+		transpose, cells) == edist;
+}
+
+/* Finds the edit distance between 'word1' and 'word2', as long as it is at
+ * most 'bound'. keeps only a single row of the table, and gives up as soon
+ * as every entry of a row is above 'bound', returning 'bound'+1. with
+ * 'transpose', a swap of adjacent letters costs 1 (optimal string
+ * alignment), which needs the two rows before as well. if 'cells' is not
+ * NULL, the number of table cells filled is added to it
+ */
+int bounded_distance(char *word1, char *word2, int bound, bool transpose,
+		long *cells) {
+	int n=strlen(word1);
+	int m=strlen(word2);
+	int row[MAX_WORD_LEN+1];
+	int last[MAX_WORD_LEN+1], older[MAX_WORD_LEN+1];
+	int i, j, diag, above, rowmin;
+
+	if (ABS(n-m) > bound) {
+		return bound+1;
+	}
+	assert(m <= MAX_WORD_LEN);
+
+	for (j=0; j<m+1; j++) {
+		row[j]=j;
+	}
+	if (transpose) {
+		memcpy(last, row, sizeof(int)*(m+1));
+	}
+	for (i=1; i<n+1; i++) {
+		if (transpose) {
+			memcpy(older, last, sizeof(int)*(m+1));
+			memcpy(last, row, sizeof(int)*(m+1));
+		}
+		diag=row[0];
+		row[0]=i;
+		rowmin=i;
+		for (j=1; j<m+1; j++) {
+			above=row[j];
+			row[j] = MIN(diag + (word1[i-1]!=word2[j-1]),
+				MIN(above + 1, row[j-1] + 1));
+			if (transpose && i>1 && j>1 && word1[i-1]==word2[j-2]
+					&& word1[i-2]==word2[j-1]) {
+				row[j] = MIN(row[j], older[j-2] + 1);
+			}
+			diag=above;
+			rowmin=MIN(rowmin, row[j]);
+		}
+		if (cells) {
+			*cells += m;
+		}
+		if (rowmin > bound) {
+			return bound+1;
+		}
+	}
+	return MIN(row[m], bound+1);
+}
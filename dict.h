@@ -0,0 +1,127 @@
+/* * * * * * *
+ * Module for a dictionary index: every distinct dictionary word interned
+ * once along with its rank (the order of its first appearance in the
+ * dictionary), so that a document word can be checked or corrected without
+ * rebuilding anything
+ *
+ * shared by Task 3 and Task 4 and the spelling daemon
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#ifndef DICT_H
+#define DICT_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "memo.h"
+
+#define DICT_NONE (-1)	// rank or distance reported when there is no word
+
+// queries on one index run one at a time: they share its scratch space
+// (see dict_view() for queries on several threads)
+typedef struct dict Dict;
+
+// one ranked suggestion for a word
+typedef struct {
+	char *word;	// belongs to the index
+	int rank;
+	int dist;	// edit distance from the word
+} Suggestion;
+
+// create an empty index, with room for around 'nwords' words
+Dict *new_dict(int nwords);
+void free_dict(Dict *dict);
+
+// another index over the same words, with scratch space of its own: it
+// can answer queries on one thread while 'dict' (or another view) answers
+// them on another. it starts with the settings of 'dict'. no words can be
+// added to either from then on, and the view must be freed before 'dict'
+Dict *dict_view(Dict *dict);
+
+// add the next dictionary word ('len' bytes at 'word', not necessarily
+// '\0'-terminated), and return its rank. words may be added at any time:
+// a word already in the index keeps its rank
+int dict_add(Dict *dict, const char *word, size_t len);
+
+// add 'n' dictionary words at once ('lens[i]' bytes at 'words[i]'), with
+// the work split between 'nthreads' threads: the words are split into
+// shards by hash, each shard keeps the first occurrence of its words, and
+// the indexes over the words are built alongside each other. every word
+// gets the same rank as if added with dict_add() one at a time, in order
+void dict_add_all(Dict *dict, const char *const *words, const size_t *lens,
+	int n, int nthreads);
+
+// the number of distinct words in the index
+int dict_size(Dict *dict);
+
+// write the index to 'file' as a base index image (host byte order), from
+// which it can be used read-only in any number of processes at once
+// returns false on a write error
+bool dict_write(Dict *dict, FILE *file);
+
+// returns whether the 'len' bytes at 'data' start like a base index image
+bool dict_is_image(const char *data, size_t len);
+
+// an index over the image of 'len' bytes at 'data' (8-byte aligned, most
+// likely mapped from a file written by dict_write()). it answers queries
+// like the index the image was written from, but its words are read from
+// the image: none can be added, and the image must stay in place until
+// the index is freed. returns NULL if the image is malformed
+Dict *dict_map(const char *data, size_t len);
+
+// split each full dictionary scan (the distance 3 search) of a single
+// word between 'nthreads' threads. 1 scans on the calling thread alone
+void dict_set_threads(Dict *dict, int nthreads);
+
+// count a transposition of two adjacent letters as a single edit (optimal
+// string alignment distance) instead of two. off by default
+void dict_set_transpositions(Dict *dict, bool transpositions);
+
+// find the candidates of the distance 3 search (and of dict_suggest()'s
+// scan) in an index of the words' trigrams, built now (see trigrams.h),
+// instead of scanning every word. only words long enough for the count
+// filter to rule anything out use it. off by default
+void dict_set_trigrams(Dict *dict, bool trigrams);
+
+// limit the work dict_correct() does, counted in probes (edits generated
+// or looked up) and distance table cells: 'word_budget' for each word, and
+// 'doc_budget' for all words from now on (0 for no limit). a word that runs
+// out gets the best correction found so far, or none at all
+void dict_set_budget(Dict *dict, long word_budget, long doc_budget);
+
+// returns whether the last dict_correct() ran out of budget
+bool dict_degraded(Dict *dict);
+
+// look misspelled words up in 'memo' before searching for their
+// corrections, and add the corrections found to it (except those cut short
+// by the budget). NULL stops using a memo. the memo still belongs to the
+// caller, and must be keyed on dict_content_hash() and the settings
+void dict_set_memo(Dict *dict, Memo *memo);
+
+// a hash of the distinct words in rank order: two indexes with the same
+// hash correct every word the same way (under the same settings)
+uint64_t dict_content_hash(Dict *dict);
+
+// returns whether 'word' is a correctly spelled word
+bool dict_has(Dict *dict, char *word);
+
+// returns the rank of 'word', or DICT_NONE if it is misspelled
+int dict_rank(Dict *dict, char *word);
+
+// returns the correction of 'word': the word itself if it is in the
+// dictionary, otherwise the earliest-ranked word within the smallest
+// Levenshtein (or, with transpositions, optimal string alignment) edit
+// distance of 1, 2 or 3. returns NULL if there is none
+// the returned string belongs to the index. if 'rank' or 'dist' are not
+// NULL they receive the rank and edit distance of the correction
+char *dict_correct(Dict *dict, char *word, int *rank, int *dist);
+
+// finds the (up to) 'k' best suggestions for 'word' within edit distance
+// 'maxdist', ordered by distance and then by rank, and stores them in 'out'
+// (room for 'k'). returns the number of suggestions found
+int dict_suggest(Dict *dict, char *word, int k, int maxdist, Suggestion *out);
+
+#endif
@@ -0,0 +1,426 @@
+/* * * * * * *
+ * Module for enumerating the edits of a word without repeats
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "edits.h"
+#include "pool.h"
+#include "grams.h"
+
+#define ALPHABET     "abcdefghijklmnopqrstuvwxyz"
+#define ALPHABET_LEN 26
+#define MAX_EDIT_LEN 258	// longest word an edit can produce, plus '\0'
+
+#define MIN(A, B) ((A) < (B) ? (A) : (B))
+#define MAX(A, B) ((A) > (B) ? (A) : (B))
+
+#define INITIAL_SLOTS 1024	// must be a power of two
+#define TEXT_CHUNK    (64 << 10)
+
+struct edit_set {
+	Arena *text;		// every word, '\0'-terminated, reset per query
+
+	char **words;		// each word, in order added
+	int *lens;			// the length of each word
+	uint32_t *homes;	// the slot holding each word
+	int count;
+	int words_cap;
+
+	// open addressing: word index + 1. a slot only counts as full if the
+	// word it names is still in the set and lives in that very slot, so
+	// clearing the set never has to touch the slots
+	uint32_t *slots;
+	uint32_t nslots;	// a power of two, kept at least twice 'count'
+};
+
+/*----------------------------------------------------------------------*/
+/* SET CREATION/DELETION */
+
+EditSet *new_edit_set(void) {
+	EditSet *set = malloc(sizeof *set);
+	assert(set);
+
+	set->text = new_arena(TEXT_CHUNK, "edit words");
+	set->words_cap = INITIAL_SLOTS / 2;
+	set->words = malloc(sizeof(char *)*set->words_cap);
+	set->homes = malloc(sizeof(uint32_t)*set->words_cap);
+	set->lens = malloc(sizeof(int)*set->words_cap);
+	set->nslots = INITIAL_SLOTS;
+	set->slots = calloc(set->nslots, sizeof(uint32_t));
+	assert(set->words && set->homes && set->lens && set->slots);
+
+	set->count = 0;
+	return set;
+}
+
+void free_edit_set(EditSet *set) {
+	assert(set != NULL);
+	free_arena(set->text);
+	free(set->words);
+	free(set->homes);
+	free(set->lens);
+	free(set->slots);
+	free(set);
+}
+
+void edit_set_clear(EditSet *set) {
+	arena_reset(set->text);
+	set->count = 0;
+}
+
+/*----------------------------------------------------------------------*/
+/* ADDING AND ACCESSING WORDS */
+
+// FNV-1a: cheap, and good enough to spread words that differ in one letter
+uint32_t edit_hash(const char *word, int len) {
+	uint32_t h = 2166136261u;
+	int i;
+	for (i = 0; i < len; i++) {
+		h = (h ^ (unsigned char)word[i]) * 16777619u;
+	}
+	return h;
+}
+
+// the index of the word in 'slot', or -1 if the slot is free
+int slot_word(EditSet *set, uint32_t slot) {
+	uint32_t i = set->slots[slot] - 1;
+	if (i < (uint32_t)set->count && set->homes[i] == slot) {
+		return i;
+	}
+	return -1;
+}
+
+// double the number of slots, and re-place every word
+void grow_slots(EditSet *set) {
+	free(set->slots);
+	set->nslots *= 2;
+	set->slots = calloc(set->nslots, sizeof(uint32_t));
+	assert(set->slots);
+
+	int i;
+	for (i = 0; i < set->count; i++) {
+		uint32_t slot = edit_hash(set->words[i], set->lens[i])
+			& (set->nslots - 1);
+		while (set->slots[slot]) {
+			slot = (slot + 1) & (set->nslots - 1);
+		}
+		set->slots[slot] = i + 1;
+		set->homes[i] = slot;
+	}
+}
+
+bool edit_set_add(EditSet *set, const char *word, int len) {
+	uint32_t slot = edit_hash(word, len) & (set->nslots - 1);
+	int i;
+
+	// linear probing: stop at the word, or at the first free slot
+	while ((i = slot_word(set, slot)) >= 0) {
+		// (lengths first: a shorter word ends before 'len' bytes)
+		if (set->lens[i] == len && memcmp(set->words[i], word, len) == 0) {
+			return false;
+		}
+		slot = (slot + 1) & (set->nslots - 1);
+	}
+
+	// a new word: copy it into this query's text
+	if (set->count == set->words_cap) {
+		set->words_cap *= 2;
+		set->words = realloc(set->words, sizeof(char *)*set->words_cap);
+		set->homes = realloc(set->homes, sizeof(uint32_t)*set->words_cap);
+		set->lens = realloc(set->lens, sizeof(int)*set->words_cap);
+		assert(set->words && set->homes && set->lens);
+	}
+	char *copy = arena_alloc(set->text, len + 1);
+	memcpy(copy, word, len);
+	copy[len] = '\0';
+	set->words[set->count] = copy;
+	set->lens[set->count] = len;
+	set->homes[set->count] = slot;
+	set->slots[slot] = ++set->count;
+
+	if (2 * (uint32_t)set->count > set->nslots) {
+		grow_slots(set);
+	}
+	return true;
+}
+
+int edit_set_count(EditSet *set) {
+	return set->count;
+}
+
+char *edit_set_word(EditSet *set, int i) {
+	assert(i >= 0 && i < set->count);
+	return set->words[i];
+}
+
+/*----------------------------------------------------------------------*/
+/* GENERATING EDITS */
+
+bool add_plausible(EditSet *set, const char *edit, int len, int first,
+	int last, const Grams *filter);
+bool add_packed_plausible(PackedSet *set, PackedWord edit, int len,
+	int first, int last, const Grams *filter);
+
+int add_edits(EditSet *set, const char *word, const Grams *filter,
+		bool transpose) {
+	char edit[MAX_EDIT_LEN];
+	int i, j, added = 0;
+	int n = strlen(word);
+	int lo = -1, hi = n;
+	assert(n + 2 <= MAX_EDIT_LEN);
+
+	// an edit only changes the n-grams around it, so it has to fall within
+	// every unseen n-gram of the word for the result to pass the filter.
+	// this rules out whole neighbourhoods without generating any of them
+	// (a transposition spans two letters, so it can reach one further)
+	if (filter && grams_unseen(filter, word, &lo, &hi) &&
+			lo > hi + transpose) {
+		// no single edit touches all of them
+		return 0;
+	}
+
+	// through substitution, with any letter but the one already there
+	memcpy(edit, word, n + 1);
+	for (i = MAX(lo, 0); i <= MIN(hi, n - 1); i++) {
+		for (j = 0; j < ALPHABET_LEN; j++) {
+			if (ALPHABET[j] == word[i]) {
+				continue;
+			}
+			edit[i] = ALPHABET[j];
+			added += add_plausible(set, edit, n, i, i, filter);
+		}
+		edit[i] = word[i];
+	}
+
+	// through deletion, of the first letter of each run only: deleting any
+	// letter of a run gives the same word
+	for (i = MAX(lo, 0); i <= MIN(hi, n - 1); i++) {
+		if (i > 0 && word[i] == word[i-1]) {
+			continue;
+		}
+		memcpy(edit, word, i);
+		memcpy(edit + i, word + i + 1, n - i);
+		added += add_plausible(set, edit, n - 1, i - 1, i, filter);
+	}
+
+	// through insertion (between letters i-1 and i), never right after the
+	// same letter: inserting a letter before or after a copy of itself
+	// gives the same word
+	for (i = MAX(lo + 1, 0); i <= MIN(hi, n); i++) {
+		memcpy(edit, word, i);
+		memcpy(edit + i + 1, word + i, n - i + 1);
+		for (j = 0; j < ALPHABET_LEN; j++) {
+			if (i > 0 && ALPHABET[j] == word[i-1]) {
+				continue;
+			}
+			edit[i] = ALPHABET[j];
+			added += add_plausible(set, edit, n + 1, i, i, filter);
+		}
+	}
+
+	// through transposition of letters i and i+1, if asked for, as long as
+	// they differ
+	if (transpose) {
+		memcpy(edit, word, n + 1);
+		for (i = MAX(lo - 1, 0); i <= MIN(hi, n - 2); i++) {
+			if (word[i] == word[i+1]) {
+				continue;
+			}
+			edit[i] = word[i+1];
+			edit[i+1] = word[i];
+			added += add_plausible(set, edit, n, i, i + 1, filter);
+			edit[i] = word[i];
+			edit[i+1] = word[i+1];
+		}
+	}
+	return added;
+}
+
+// add an edit to the set, unless 'filter' (if not NULL) rules it out. the
+// edit changed letters 'first' to 'last' of the word: only the n-grams
+// around them need checking, as every other one was already seen
+bool add_plausible(EditSet *set, const char *edit, int len, int first,
+		int last, const Grams *filter) {
+	if (filter && !grams_plausible_at(filter, edit, len, first, last)) {
+		return false;
+	}
+	return edit_set_add(set, edit, len);
+}
+
+/*----------------------------------------------------------------------*/
+/* PACKED EDITS */
+
+// the same open addressing as an edit set, with the packed words standing
+// in for the text
+struct packed_set {
+	PackedWord *words;
+	uint32_t *homes;
+	int count;
+	int words_cap;
+
+	uint32_t *slots;
+	int bits;			// there are 2^bits slots, at least twice 'count'
+};
+
+PackedSet *new_packed_set(void) {
+	PackedSet *set = malloc(sizeof *set);
+	assert(set);
+
+	set->words_cap = INITIAL_SLOTS / 2;
+	set->words = malloc(sizeof(PackedWord)*set->words_cap);
+	set->homes = malloc(sizeof(uint32_t)*set->words_cap);
+	set->bits = 10;
+	set->slots = calloc(INITIAL_SLOTS, sizeof(uint32_t));
+	assert(set->words && set->homes && set->slots);
+
+	set->count = 0;
+	return set;
+}
+
+void free_packed_set(PackedSet *set) {
+	assert(set != NULL);
+	free(set->words);
+	free(set->homes);
+	free(set->slots);
+	free(set);
+}
+
+void packed_set_clear(PackedSet *set) {
+	set->count = 0;
+}
+
+// the index of the word in 'slot', or -1 if the slot is free
+int packed_slot_word(PackedSet *set, uint32_t slot) {
+	uint32_t i = set->slots[slot] - 1;
+	if (i < (uint32_t)set->count && set->homes[i] == slot) {
+		return i;
+	}
+	return -1;
+}
+
+void grow_packed_slots(PackedSet *set) {
+	free(set->slots);
+	set->bits++;
+	set->slots = calloc((size_t)1 << set->bits, sizeof(uint32_t));
+	assert(set->slots);
+
+	uint32_t mask = ((uint32_t)1 << set->bits) - 1;
+	int i;
+	for (i = 0; i < set->count; i++) {
+		uint32_t slot = PACKED_HASH(set->words[i], set->bits);
+		while (set->slots[slot]) {
+			slot = (slot + 1) & mask;
+		}
+		set->slots[slot] = i + 1;
+		set->homes[i] = slot;
+	}
+}
+
+bool packed_set_add(PackedSet *set, PackedWord word) {
+	uint32_t mask = ((uint32_t)1 << set->bits) - 1;
+	uint32_t slot = PACKED_HASH(word, set->bits);
+	int i;
+
+	while ((i = packed_slot_word(set, slot)) >= 0) {
+		if (set->words[i] == word) {
+			return false;
+		}
+		slot = (slot + 1) & mask;
+	}
+
+	if (set->count == set->words_cap) {
+		set->words_cap *= 2;
+		set->words = realloc(set->words, sizeof(PackedWord)*set->words_cap);
+		set->homes = realloc(set->homes, sizeof(uint32_t)*set->words_cap);
+		assert(set->words && set->homes);
+	}
+	set->words[set->count] = word;
+	set->homes[set->count] = slot;
+	set->slots[slot] = ++set->count;
+
+	if (2 * (uint32_t)set->count > mask + 1) {
+		grow_packed_slots(set);
+	}
+	return true;
+}
+
+int packed_set_count(PackedSet *set) {
+	return set->count;
+}
+
+PackedWord packed_set_word(PackedSet *set, int i) {
+	assert(i >= 0 && i < set->count);
+	return set->words[i];
+}
+
+// add a packed edit to the set, unless 'filter' (if not NULL) rules it out
+bool add_packed_plausible(PackedSet *set, PackedWord edit, int len,
+		int first, int last, const Grams *filter) {
+	if (filter && !grams_packed_plausible_at(filter, edit, len, first, last)) {
+		return false;
+	}
+	return packed_set_add(set, edit);
+}
+
+int add_packed_edits(PackedSet *set, PackedWord word, int len,
+		const Grams *filter, bool transpose) {
+	int i, added = 0;
+	int lo = -1, hi = len;
+	PackedWord c, letter, previous;
+	assert(len < PACKED_MAX_LEN);
+
+	if (filter && grams_packed_unseen(filter, word, len, &lo, &hi) &&
+			lo > hi + transpose) {
+		return 0;
+	}
+
+	// through substitution, with any letter but the one already there
+	for (i = MAX(lo, 0); i <= MIN(hi, len - 1); i++) {
+		letter = PACKED_LETTER(word, i);
+		for (c = 1; c <= ALPHABET_LEN; c++) {
+			if (c != letter) {
+				added += add_packed_plausible(set,
+					PACKED_SUBSTITUTE(word, i, c), len, i, i, filter);
+			}
+		}
+	}
+
+	// through deletion, of the first letter of each run only
+	for (i = MAX(lo, 0); i <= MIN(hi, len - 1); i++) {
+		if (i > 0 && PACKED_LETTER(word, i) == PACKED_LETTER(word, i-1)) {
+			continue;
+		}
+		added += add_packed_plausible(set, PACKED_DELETE(word, i), len - 1,
+			i - 1, i, filter);
+	}
+
+	// through insertion, never right after the same letter
+	for (i = MAX(lo + 1, 0); i <= MIN(hi, len); i++) {
+		previous = i > 0 ? PACKED_LETTER(word, i-1) : 0;
+		for (c = 1; c <= ALPHABET_LEN; c++) {
+			if (c != previous) {
+				added += add_packed_plausible(set,
+					PACKED_INSERT(word, i, c), len + 1, i, i, filter);
+			}
+		}
+	}
+
+	// through transposition, if asked for, of two different letters
+	for (i = MAX(lo - 1, 0); transpose && i <= MIN(hi, len - 2); i++) {
+		letter = PACKED_LETTER(word, i);
+		c = PACKED_LETTER(word, i+1);
+		if (c != letter) {
+			added += add_packed_plausible(set,
+				PACKED_SUBSTITUTE(PACKED_SUBSTITUTE(word, i, c), i + 1, letter),
+				len, i, i + 1, filter);
+		}
+	}
+	return added;
+}
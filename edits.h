@@ -0,0 +1,66 @@
+/* * * * * * *
+ * Module for enumerating the edits of a word without repeats: an edit set
+ * holds every distinct word generated for one query, packed into an arena
+ * that is released all at once when the next query starts, and drops a
+ * word it has already seen before it is ever probed against the dictionary
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#ifndef EDITS_H
+#define EDITS_H
+
+#include <stdbool.h>
+
+#include "grams.h"
+#include "packed.h"
+
+typedef struct edit_set EditSet;
+
+EditSet *new_edit_set(void);
+void free_edit_set(EditSet *set);
+
+// forget every word in O(1), keeping the memory for the next query
+void edit_set_clear(EditSet *set);
+
+// add the 'len' bytes at 'word' to the set
+// returns false (and adds nothing) if the word was already in the set
+bool edit_set_add(EditSet *set, const char *word, int len);
+
+// the number of words in the set, and the i-th word added
+int edit_set_count(EditSet *set);
+char *edit_set_word(EditSet *set, int i);
+
+// add every word one substitution, deletion or insertion away from 'word'
+// to the set, and one transposition of two adjacent letters away too if
+// 'transpose' is set. edits that would give the same word (substituting a
+// letter with itself, deleting or inserting within a run of one letter, or
+// swapping two equal letters) are only generated once. if 'filter' is not
+// NULL, only edits it finds plausible are added. returns the number of new
+// words added
+int add_edits(EditSet *set, const char *word, const Grams *filter,
+	bool transpose);
+
+
+/* * *
+ * PACKED EDITS
+ *
+ * the same, for words short enough to pack: the set holds packed words,
+ * and edits are made with bit operations on them
+ */
+
+typedef struct packed_set PackedSet;
+
+PackedSet *new_packed_set(void);
+void free_packed_set(PackedSet *set);
+void packed_set_clear(PackedSet *set);
+bool packed_set_add(PackedSet *set, PackedWord word);
+int packed_set_count(PackedSet *set);
+PackedWord packed_set_word(PackedSet *set, int i);
+
+// add_edits() for the packed word 'word' of 'len' letters, which must be
+// short enough for its insertions to still pack (len < PACKED_MAX_LEN)
+int add_packed_edits(PackedSet *set, PackedWord word, int len,
+	const Grams *filter, bool transpose);
+
+#endif
@@ -0,0 +1,187 @@
+/* * * * * * *
+ * Module for a letter n-gram filter over dictionary words
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "grams.h"
+
+#define NBYTES   256
+#define NSYMBOLS 32		// letters of a triple: see symbol()
+
+// one bit per pair of bytes (8 KB), and one per triple of symbols (4 KB):
+// small enough to stay in the cache while edits are generated
+struct grams {
+	uint32_t pairs[NBYTES * NBYTES / 32];
+	uint32_t triples[NSYMBOLS * NSYMBOLS * NSYMBOLS / 32];
+};
+
+#define PAIR(A, B) ((unsigned)(unsigned char)(A) * NBYTES + (unsigned char)(B))
+// the first letter in the lowest bits, as in a packed word
+#define TRIPLE(A, B, C) ((A) + ((B) + (C) * NSYMBOLS) * NSYMBOLS)
+
+// the triple centred on letter 'i' of a packed word: the 15 bits around
+// it, where the bits past the end are EDGE already
+#define PACKED_TRIPLE(W, I) ((I) == 0 ? ((W) << PACKED_BITS) & 0x7FFF \
+	: ((W) >> (PACKED_BITS * ((I) - 1))) & 0x7FFF)
+
+#define HAS_BIT(BITS, I) (((BITS)[(I) / 32] >> ((I) % 32)) & 1)
+#define SET_BIT(BITS, I) ((BITS)[(I) / 32] |= 1u << ((I) % 32))
+
+#define MIN(A, B) ((A) < (B) ? (A) : (B))
+#define MAX(A, B) ((A) > (B) ? (A) : (B))
+
+#define EDGE 0	// the symbol before the first and after the last letter
+
+/*----------------------------------------------------------------------*/
+/* FILTER CREATION/DELETION */
+
+Grams *new_grams(void) {
+	Grams *grams = calloc(1, sizeof *grams);
+	assert(grams);
+	return grams;
+}
+
+void free_grams(Grams *grams) {
+	assert(grams != NULL);
+	free(grams);
+}
+
+bool grams_write(const Grams *grams, FILE *file) {
+	return fwrite(grams, sizeof *grams, 1, file) == 1;
+}
+
+Grams *grams_read(const char *data, size_t len) {
+	if (len < sizeof(Grams)) {
+		return NULL;
+	}
+	Grams *grams = new_grams();
+	memcpy(grams, data, sizeof *grams);
+	return grams;
+}
+
+/*----------------------------------------------------------------------*/
+/* RECORDING AND CHECKING WORDS */
+
+// the symbol of letter 'i' of a 'len'-byte word: 1-26 for 'a'-'z' (the
+// same as their packed codes), 27 for any other byte, and EDGE just outside
+// the word
+unsigned symbol(const char *word, int len, int i) {
+	if (i < 0 || i >= len) {
+		return EDGE;
+	}
+	if (word[i] >= 'a' && word[i] <= 'z') {
+		return word[i] - 'a' + 1;
+	}
+	return 27;
+}
+
+// the triple centred on letter 'i'
+unsigned triple_at(const char *word, int len, int i) {
+	return TRIPLE(symbol(word, len, i-1), symbol(word, len, i),
+		symbol(word, len, i+1));
+}
+
+void grams_add_word(Grams *grams, const char *word, size_t len) {
+	int i, n = len;
+	for (i = 1; i < n; i++) {
+		SET_BIT(grams->pairs, PAIR(word[i-1], word[i]));
+	}
+	// one triple centred on each letter: the first and last take in the
+	// edges of the word
+	for (i = 0; i < n; i++) {
+		SET_BIT(grams->triples, triple_at(word, n, i));
+	}
+}
+
+void grams_merge(Grams *grams, const Grams *other) {
+	size_t i;
+	for (i = 0; i < NBYTES * NBYTES / 32; i++) {
+		grams->pairs[i] |= other->pairs[i];
+	}
+	for (i = 0; i < NSYMBOLS * NSYMBOLS * NSYMBOLS / 32; i++) {
+		grams->triples[i] |= other->triples[i];
+	}
+}
+
+bool grams_plausible(const Grams *grams, const char *word, int len) {
+	return grams_plausible_at(grams, word, len, 0, len - 1);
+}
+
+bool grams_plausible_at(const Grams *grams, const char *word, int len,
+		int first, int last) {
+	int i;
+	// pair i covers letters i-1 and i
+	for (i = MAX(first, 1); i <= MIN(last + 1, len - 1); i++) {
+		if (!HAS_BIT(grams->pairs, PAIR(word[i-1], word[i]))) {
+			return false;
+		}
+	}
+	// the triple centred on letter i covers letters i-1 to i+1
+	for (i = MAX(first - 1, 0); i <= MIN(last + 1, len - 1); i++) {
+		if (!HAS_BIT(grams->triples, triple_at(word, len, i))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int grams_unseen(const Grams *grams, const char *word, int *lo, int *hi) {
+	int i, unseen = 0, len = strlen(word);
+
+	// each unseen n-gram narrows down where the edit must fall
+	*lo = -1;
+	*hi = len;
+	for (i = 0; i < len; i++) {
+		if (i > 0 && !HAS_BIT(grams->pairs, PAIR(word[i-1], word[i]))) {
+			unseen++;
+			*lo = MAX(*lo, i-1);
+			*hi = MIN(*hi, i);
+		}
+		if (!HAS_BIT(grams->triples, triple_at(word, len, i))) {
+			unseen++;
+			*lo = MAX(*lo, i-1);
+			*hi = MIN(*hi, i+1);
+		}
+	}
+	return unseen;
+}
+
+/*----------------------------------------------------------------------*/
+/* CHECKING PACKED WORDS */
+
+// a packed word is all lowercase, and any pair of its letters is inside a
+// triple, so an unseen pair always comes with an unseen triple: only the
+// triples need checking
+
+bool grams_packed_plausible_at(const Grams *grams, PackedWord word, int len,
+		int first, int last) {
+	int i;
+	for (i = MAX(first - 1, 0); i <= MIN(last + 1, len - 1); i++) {
+		if (!HAS_BIT(grams->triples, PACKED_TRIPLE(word, i))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+int grams_packed_unseen(const Grams *grams, PackedWord word, int len,
+		int *lo, int *hi) {
+	int i, unseen = 0;
+	*lo = -1;
+	*hi = len;
+	for (i = 0; i < len; i++) {
+		if (!HAS_BIT(grams->triples, PACKED_TRIPLE(word, i))) {
+			unseen++;
+			*lo = MAX(*lo, i-1);
+			*hi = MIN(*hi, i+1);
+		}
+	}
+	return unseen;
+}
@@ -0,0 +1,62 @@
+/* * * * * * *
+ * Module for a letter n-gram filter: bitmaps of every pair of adjacent
+ * bytes, and of every triple of adjacent letters (counting the start and
+ * end of the word as letters, so they are positional at the edges), that
+ * occur in some dictionary word. a word holding any n-gram outside of them
+ * cannot be a dictionary word, so it can be thrown away before it is ever
+ * hashed, and a word holding unseen n-grams far apart cannot become one
+ * with a single edit either
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#ifndef GRAMS_H
+#define GRAMS_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "packed.h"
+
+typedef struct grams Grams;
+
+// an empty filter, which rejects every word
+Grams *new_grams(void);
+void free_grams(Grams *grams);
+
+// write the filter to 'file' as an image (a multiple of 8 bytes long), and
+// read one back from the 'len' bytes at 'data' (NULL if too short)
+bool grams_write(const Grams *grams, FILE *file);
+Grams *grams_read(const char *data, size_t len);
+
+// record every n-gram of the 'len' bytes at 'word'
+void grams_add_word(Grams *grams, const char *word, size_t len);
+
+// record every n-gram recorded by 'other' as well (so that several
+// filters can be filled at once, and then merged)
+void grams_merge(Grams *grams, const Grams *other);
+
+// returns whether every n-gram of the 'len' bytes at 'word' has been seen
+bool grams_plausible(const Grams *grams, const char *word, int len);
+
+// the same, but only for the n-grams taking in any of letters 'first' to
+// 'last' (the rest are known to have been seen)
+bool grams_plausible_at(const Grams *grams, const char *word, int len,
+	int first, int last);
+
+// returns the number of unseen n-grams in 'word'. if there are any, a
+// single edit can only get rid of them all if it falls within all of
+// them: 'lo' and 'hi' receive the positions it must fall between (the
+// start and end of the word count as positions -1 and strlen(word)).
+// lo > hi means no single edit can
+int grams_unseen(const Grams *grams, const char *word, int *lo, int *hi);
+
+// grams_plausible_at() and grams_unseen(), for a packed word of 'len'
+// letters
+bool grams_packed_plausible_at(const Grams *grams, PackedWord word, int len,
+	int first, int last);
+int grams_packed_unseen(const Grams *grams, PackedWord word, int len,
+	int *lo, int *hi);
+
+#endif
@@ -6,6 +6,12 @@
  *
  * modified by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
  * move-to-front technique added
+ * incremental resizing and deletion added
+ * tables sharing their keys with the caller added
+ * prefetched batch lookup added
+ * buckets allocated from a slab pool added
+ * frozen tables added
+ * bulk loading on worker threads added
  */
 
 #include <stdio.h>
@@ -16,10 +22,25 @@
 
 #include <string.h>
 #include "strhash.h"
+#include "pool.h"
 
 #define HASH_METHOD 'x' // XOR hash function used
 #define PRINT_LIMIT 10
 
+#define MAX_LOAD_FACTOR 2	// average chain length that triggers a resize
+#define GROWTH_FACTOR   2	// how much larger the resized bucket array is
+#define MIGRATE_STEP    4	// old buckets moved across per table operation
+
+#define BATCH_GROUP 16		// keys of a batched lookup with misses in flight
+#define BULK_CHUNK  4096	// keys a worker hashes before taking more
+
+// hint that 'addr' will be read soon, if the compiler supports it
+#ifdef __GNUC__
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
+
 
 /* * *
  * HELPER DATA STRUCTURE: LINKED LIST OF BUCKETS
@@ -32,14 +53,18 @@ struct bucket {
 	Bucket *next;
 };
 
-Bucket *new_bucket(char *key, int value) {
-	Bucket *bucket = malloc(sizeof *bucket);
-	assert(bucket);
-
-	// create own copy of key for storage in table
-	bucket->key = malloc((sizeof *bucket->key) * (strlen(key) + 1));
-	assert(bucket->key);
-	strcpy(bucket->key, key);
+Bucket *new_bucket(SlabPool *pool, char *key, int value, bool copy_key) {
+	Bucket *bucket = slab_alloc(pool);
+
+	if (copy_key) {
+		// create own copy of key for storage in table
+		bucket->key = malloc((sizeof *bucket->key) * (strlen(key) + 1));
+		assert(bucket->key);
+		strcpy(bucket->key, key);
+	} else {
+		// the caller keeps the key alive for as long as the table
+		bucket->key = key;
+	}
 	
 	bucket->value = value;
 	bucket->next = NULL;
@@ -48,15 +73,28 @@ Bucket *new_bucket(char *key, int value) {
 }
 
 // Warning: does not free bucket->next
-void free_bucket(Bucket *bucket) {
+void free_bucket(SlabPool *pool, Bucket *bucket, bool free_key) {
 	assert(bucket != NULL);
-	free(bucket->key);
-	free(bucket);
+	if (free_key) {
+		free(bucket->key);
+	}
+	slab_free(pool, bucket);
 }
 
 struct table {
-	int size;
+	int size;			// number of buckets in the (newest) bucket array
+	int nitems;			// number of keys stored across both bucket arrays
+	bool shared_keys;	// keys belong to the caller, not copied by the table
+	bool frozen;		// lookups leave the table exactly as it is
 	Bucket **buckets;
+	SlabPool *pool;		// every bucket of the table, freed all at once
+
+	// incremental resizing: while a resize is in progress, 'old_buckets'
+	// holds the previous bucket array. buckets [0, migrated) of it have
+	// already been moved into 'buckets', the rest still hold their keys
+	int old_size;
+	int migrated;
+	Bucket **old_buckets;
 };
 
 
@@ -64,35 +102,69 @@ struct table {
  * HASH TABLE CREATION/DELETION
  */
 
+Bucket **new_bucket_array(int size) {
+	Bucket **buckets = malloc(size * (sizeof *buckets));
+	assert(buckets);
+	int i;
+	for (i = 0; i < size; i++) {
+		buckets[i] = NULL;
+	}
+	return buckets;
+}
+
+// the buckets themselves go with the table's pool, so the chains only
+// need walking when the table owns its keys
+void free_bucket_array(Bucket **buckets, int size, bool free_keys) {
+	int i;
+	for (i = 0; free_keys && i < size; i++) {
+		Bucket *this_bucket;
+		for (this_bucket = buckets[i]; this_bucket;
+				this_bucket = this_bucket->next) {
+			free(this_bucket->key);
+		}
+	}
+	free(buckets);
+}
+
 HashTable *new_hash_table(int size) {
 	HashTable *table = malloc(sizeof *table);
 	assert(table);
 
-	table->size = size;
-	table->buckets = malloc(size * (sizeof *table->buckets));
-	assert(table->buckets);
-	int i;
-	for (i = 0; i < size; i++) {
-		table->buckets[i] = NULL;
+	// the table grows on demand, so an empty dictionary is fine
+	if (size < 1) {
+		size = 1;
 	}
 
+	table->size = size;
+	table->nitems = 0;
+	table->shared_keys = false;
+	table->frozen = false;
+	table->buckets = new_bucket_array(size);
+	table->pool = new_slab_pool(sizeof(Bucket), "buckets");
+
+	table->old_size = 0;
+	table->migrated = 0;
+	table->old_buckets = NULL;
+
+	return table;
+}
+
+HashTable *new_hash_table_shared_keys(int size) {
+	HashTable *table = new_hash_table(size);
+	table->shared_keys = true;
 	return table;
 }
 
 void free_hash_table(HashTable *table) { 
 	assert(table != NULL);
 
-	int i;
-	for (i = 0; i < table->size; i++) {
-		Bucket *this_bucket, *next_bucket;
-		this_bucket = table->buckets[i];
-		while (this_bucket) {
-			next_bucket = this_bucket->next;
-			free_bucket(this_bucket);
-			this_bucket = next_bucket;
-		}
+	bool free_keys = !table->shared_keys;
+	if (table->old_buckets) {
+		// buckets before 'migrated' are already empty
+		free_bucket_array(table->old_buckets, table->old_size, free_keys);
 	}
-	free(table->buckets);
+	free_bucket_array(table->buckets, table->size, free_keys);
+	free_slab_pool(table->pool);
 	free(table);
 }
 
@@ -110,58 +182,151 @@ bool equal(char *a, char *b) {
 
 
 /* * *
- * HASH TABLE FUNCTIONS
+ * INCREMENTAL RESIZING
+ * 
+ * once the load factor passes MAX_LOAD_FACTOR, a bucket array GROWTH_FACTOR
+ * times larger is allocated, and every following operation moves a further
+ * MIGRATE_STEP buckets of the old array across. there is never a single
+ * stop-the-world rehash of the whole table
  */
 
-void hash_table_put(HashTable *table, char *key, int value) {
-	assert(table != NULL);
-	assert(key != NULL);
-
-	int hash_value = h(key, table->size);
+// move the next 'nbuckets' chains of the old array into the new array
+void migrate_buckets(HashTable *table, int nbuckets) {
+	while (table->old_buckets && nbuckets > 0) {
+		Bucket *bucket = table->old_buckets[table->migrated];
+		table->old_buckets[table->migrated] = NULL;
+		while (bucket) {
+			Bucket *next = bucket->next;
+			int hash_value = h(bucket->key, table->size);
+			bucket->next = table->buckets[hash_value];
+			table->buckets[hash_value] = bucket;
+			bucket = next;
+		}
 
-	// iterate through the linked list of the bucket
-	Bucket *bucket = table->buckets[hash_value];
-	while (bucket) {
-		if (equal(key, bucket->key)) {
-			// if the same key is found, the value is overwritten
-			bucket->value = value;
-			return;
+		table->migrated++;
+		nbuckets--;
+		if (table->migrated == table->old_size) {
+			// every chain has moved, the old array can go
+			free(table->old_buckets);
+			table->old_buckets = NULL;
+			table->old_size = 0;
+			table->migrated = 0;
 		}
-		bucket = bucket->next;
 	}
+}
+
+// start growing the table if it has become too full
+void maybe_grow(HashTable *table) {
+	if (table->old_buckets || table->nitems <= table->size * MAX_LOAD_FACTOR) {
+		return;
+	}
+	table->old_buckets = table->buckets;
+	table->old_size = table->size;
+	table->migrated = 0;
 
-	// if key wasn't found, add it at front of list
-	Bucket *new = new_bucket(key, value);
-	new->next = table->buckets[hash_value];
-	table->buckets[hash_value] = new;
+	table->size = table->size * GROWTH_FACTOR;
+	table->buckets = new_bucket_array(table->size);
 }
 
-int hash_table_get_val(HashTable *table, char *key) {
-	assert(table != NULL);
-	assert(key != NULL);
+// find the chain that 'key' belongs to: its (not yet migrated) bucket of the
+// old array if a resize is in progress, otherwise its bucket of the new array
+Bucket **home_chain(HashTable *table, char *key) {
+	if (table->old_buckets) {
+		int old_hash_value = h(key, table->old_size);
+		if (old_hash_value >= table->migrated) {
+			return &table->old_buckets[old_hash_value];
+		}
+	}
+	return &table->buckets[h(key, table->size)];
+}
 
-	int hash_value = h(key, table->size);
+// find the bucket holding 'key', moving it to the front of its chain,
+// or return NULL if the key isn't in the table
+Bucket *find_bucket(HashTable *table, char *key) {
+	if (!table->frozen) {
+		migrate_buckets(table, MIGRATE_STEP);
+	}
+
+	Bucket **chain = home_chain(table, key);
 
 	// creates a back to back temporary node pointer
-	Bucket *curr_bucket = table->buckets[hash_value];
-	Bucket *prev_bucket = table->buckets[hash_value];
+	Bucket *curr_bucket = *chain;
+	Bucket *prev_bucket = NULL;
 	// iterate through the linked list of the bucket
 	while (curr_bucket) {
 		if (equal(key, curr_bucket->key)) {
-			// links the nodes before and after 
-			prev_bucket->next = curr_bucket->next;
-			
 			// moves the current node to the front of the list
-			if (curr_bucket != table->buckets[hash_value]) {
-				curr_bucket->next = table->buckets[hash_value];
-				table->buckets[hash_value] = curr_bucket;
+			if (prev_bucket && !table->frozen) {
+				// links the nodes before and after 
+				prev_bucket->next = curr_bucket->next;
+				curr_bucket->next = *chain;
+				*chain = curr_bucket;
 			}
-			return curr_bucket->value;
+			return curr_bucket;
 		}
 		prev_bucket = curr_bucket;
 		curr_bucket = curr_bucket->next;
 	}
 
+	// key doesn't exist!
+	return NULL;
+}
+
+
+/* * *
+ * HASH TABLE FUNCTIONS
+ */
+
+void hash_table_put(HashTable *table, char *key, int value) {
+	assert(table != NULL);
+	assert(key != NULL);
+	assert(!table->frozen);
+
+	Bucket *bucket = find_bucket(table, key);
+	if (bucket) {
+		// if the same key is found, the value is overwritten
+		bucket->value = value;
+		return;
+	}
+
+	// if key wasn't found, add it at front of list
+	Bucket **chain = home_chain(table, key);
+	Bucket *new = new_bucket(table->pool, key, value, !table->shared_keys);
+	new->next = *chain;
+	*chain = new;
+
+	table->nitems++;
+	maybe_grow(table);
+}
+
+bool hash_table_delete(HashTable *table, char *key) {
+	assert(table != NULL);
+	assert(key != NULL);
+	assert(!table->frozen);
+
+	// a found bucket is moved to the front of its chain, making it easy
+	// to unlink
+	Bucket *bucket = find_bucket(table, key);
+	if (!bucket) {
+		return false;
+	}
+	Bucket **chain = home_chain(table, key);
+	*chain = bucket->next;
+	free_bucket(table->pool, bucket, !table->shared_keys);
+
+	table->nitems--;
+	return true;
+}
+
+int hash_table_get_val(HashTable *table, char *key) {
+	assert(table != NULL);
+	assert(key != NULL);
+
+	Bucket *bucket = find_bucket(table, key);
+	if (bucket) {
+		return bucket->value;
+	}
+
 	// key doesn't exist!
 	fprintf(stderr, "error: key \"%s\" not found in table\n", key);
 	exit(1);
@@ -172,26 +337,9 @@ char *hash_table_get_key(HashTable *table, char *key) {
 	assert(table != NULL);
 	assert(key != NULL);
 
-	int hash_value = h(key, table->size);
-
-	// creates a back to back temporary node pointer
-	Bucket *curr_bucket = table->buckets[hash_value];
-	Bucket *prev_bucket = table->buckets[hash_value];
-	// iterate through the linked list of the bucket
-	while (curr_bucket) {
-		if (equal(key, curr_bucket->key)) {
-			// links the nodes before and after 
-			prev_bucket->next = curr_bucket->next;
-			
-			// moves the current node to the front of the list
-			if (curr_bucket != table->buckets[hash_value]) {
-				curr_bucket->next = table->buckets[hash_value];
-				table->buckets[hash_value] = curr_bucket;
-			}
-			return curr_bucket->key;
-		}
-		prev_bucket = curr_bucket;
-		curr_bucket = curr_bucket->next;
+	Bucket *bucket = find_bucket(table, key);
+	if (bucket) {
+		return bucket->key;
 	}
 
 	// key doesn't exist!
@@ -203,29 +351,179 @@ bool hash_table_has(HashTable *table, char *key) {
 	assert(table != NULL);
 	assert(key != NULL);
 
-	int hash_value = h(key, table->size);
+	return find_bucket(table, key) != NULL;
+}
 
-	// creates a back to back temporary node pointer
-	Bucket *curr_bucket = table->buckets[hash_value];
-	Bucket *prev_bucket = table->buckets[hash_value];
-	// iterate through the linked list of the bucket
-	while (curr_bucket) {
-		if (equal(key, curr_bucket->key)) {
-			prev_bucket->next = curr_bucket->next;
-			
-			// moves the current node to the front
-			if (curr_bucket != table->buckets[hash_value]) {
-				curr_bucket->next = table->buckets[hash_value];
-				table->buckets[hash_value] = curr_bucket;
+/* * *
+ * BATCHED LOOKUP
+ *
+ * looking keys up one at a time stalls on a cache miss for the bucket array
+ * and then another for the bucket itself. a batch is looked up in stages
+ * instead: hash every key and prefetch its bucket slot, then prefetch every
+ * first bucket, then every first key, and only then compare keys. all the
+ * misses of a stage are in flight at once
+ */
+
+void hash_table_get_batch(HashTable *table, char **keys, int nkeys,
+		int *values, int missing) {
+	assert(table != NULL);
+
+	Bucket **chains[BATCH_GROUP];
+	Bucket *first[BATCH_GROUP];
+	int i, j, n;
+
+	for (i = 0; i < nkeys; i += BATCH_GROUP) {
+		n = nkeys - i < BATCH_GROUP ? nkeys - i : BATCH_GROUP;
+
+		// stage 1: hash the keys, fetch their chain heads
+		for (j = 0; j < n; j++) {
+			chains[j] = home_chain(table, keys[i+j]);
+			PREFETCH(chains[j]);
+		}
+		// stage 2: fetch the first bucket of every chain
+		for (j = 0; j < n; j++) {
+			first[j] = *chains[j];
+			if (first[j]) {
+				PREFETCH(first[j]);
+			}
+		}
+		// stage 3: fetch the key of every first bucket
+		for (j = 0; j < n; j++) {
+			if (first[j]) {
+				PREFETCH(first[j]->key);
+			}
+		}
+		// stage 4: compare. this doesn't move buckets to the front, so a
+		// batch only ever reads the table
+		for (j = 0; j < n; j++) {
+			Bucket *bucket = first[j];
+			values[i+j] = missing;
+			while (bucket) {
+				if (equal(keys[i+j], bucket->key)) {
+					values[i+j] = bucket->value;
+					break;
+				}
+				bucket = bucket->next;
 			}
-			return true;
 		}
-		prev_bucket = curr_bucket;
-		curr_bucket = curr_bucket->next;
 	}
+}
 
-	// key doesn't exist!
-	return false;
+/* * *
+ * BULK LOADING
+ *
+ * the keys are hashed (and copied) a chunk at a time by whichever worker is
+ * free, then every worker walks all of their home buckets in order and
+ * links the keys of its own range of buckets. no two workers ever touch
+ * the same chain, and each chain is pushed onto in key order, just as a
+ * put at a time would
+ */
+
+typedef struct {
+	HashTable *table;
+	char **keys;
+	int nkeys;
+	int first_value;
+	Bucket *buckets;	// one for each key, in key order
+	int *homes;			// the bucket array index of each key
+	int next;			// first key of the next chunk to hash
+	int nworkers;
+} BulkPut;
+
+void bulk_hash_job(void *arg, int worker) {
+	BulkPut *bulk = arg;
+	HashTable *table = bulk->table;
+	int i, start, end;
+
+	for (;;) {
+		start = __atomic_fetch_add(&bulk->next, BULK_CHUNK, __ATOMIC_RELAXED);
+		if (start >= bulk->nkeys) {
+			break;
+		}
+		end = bulk->nkeys - start < BULK_CHUNK ? bulk->nkeys : start+BULK_CHUNK;
+		for (i = start; i < end; i++) {
+			Bucket *bucket = &bulk->buckets[i];
+			bucket->key = bulk->keys[i];
+			if (!table->shared_keys) {
+				bucket->key = malloc(strlen(bulk->keys[i]) + 1);
+				assert(bucket->key);
+				strcpy(bucket->key, bulk->keys[i]);
+			}
+			bucket->value = bulk->first_value + i;
+			bulk->homes[i] = h(bucket->key, table->size);
+		}
+	}
+}
+
+void bulk_link_job(void *arg, int worker) {
+	BulkPut *bulk = arg;
+	HashTable *table = bulk->table;
+	long lo = (long)table->size * worker / bulk->nworkers;
+	long hi = (long)table->size * (worker + 1) / bulk->nworkers;
+	int i;
+
+	for (i = 0; i < bulk->nkeys; i++) {
+		int home = bulk->homes[i];
+		if (home >= lo && home < hi) {
+			bulk->buckets[i].next = table->buckets[home];
+			table->buckets[home] = &bulk->buckets[i];
+		}
+	}
+}
+
+void hash_table_put_all(HashTable *table, char **keys, int nkeys,
+		int first_value, Workers *workers) {
+	assert(table != NULL);
+	assert(!table->frozen);
+	if (nkeys < 1) {
+		return;
+	}
+
+	// grow the table to its final size first, as puts one at a time would
+	// have, so that no key moves once it is linked
+	migrate_buckets(table, table->old_size);
+	int size = table->size;
+	while (table->nitems + nkeys > size * MAX_LOAD_FACTOR) {
+		size *= GROWTH_FACTOR;
+	}
+	if (size != table->size) {
+		table->old_buckets = table->buckets;
+		table->old_size = table->size;
+		table->migrated = 0;
+		table->size = size;
+		table->buckets = new_bucket_array(size);
+		migrate_buckets(table, table->old_size);
+	}
+
+	BulkPut bulk = { table, keys, nkeys, first_value, NULL, NULL, 0,
+		workers ? workers_count(workers) : 1 };
+	bulk.buckets = slab_alloc_many(table->pool, nkeys);
+	bulk.homes = malloc(sizeof(int) * nkeys);
+	assert(bulk.homes);
+	if (workers) {
+		workers_run(workers, bulk_hash_job, &bulk);
+		workers_run(workers, bulk_link_job, &bulk);
+	} else {
+		bulk_hash_job(&bulk, 0);
+		bulk_link_job(&bulk, 0);
+	}
+	free(bulk.homes);
+	table->nitems += nkeys;
+}
+
+/* * *
+ * FREEZING
+ */
+
+void hash_table_freeze(HashTable *table) {
+	assert(table != NULL);
+	migrate_buckets(table, table->old_size);
+	table->frozen = true;
+}
+
+int hash_table_count(HashTable *table) {
+	assert(table != NULL);
+	return table->nitems;
 }
 
 
@@ -241,6 +539,9 @@ void print_hash_table(HashTable *table) {
 void fprint_hash_table(FILE *file, HashTable *table) {
 	assert(table != NULL);
 
+	// show every key in its final position
+	migrate_buckets(table, table->old_size);
+
 	// max width of a table row label
 	int width = snprintf(NULL, 0, "%d", table->size-1);
 
@@ -6,19 +6,53 @@
  *
  * modified by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
  * move-to-front technique added
+ * incremental resizing and deletion added
+ * tables sharing their keys with the caller added
+ * prefetched batch lookup added
+ * frozen tables added
+ * bulk loading on worker threads added
  */
 
 #include <stdbool.h>
+#include "workers.h"
 
 typedef struct table HashTable;
 
 HashTable *new_hash_table(int size);
+
+// added to create a table that stores the caller's key pointers instead of
+// copies: each key must stay unchanged for as long as it is in the table
+HashTable *new_hash_table_shared_keys(int size);
 void free_hash_table(HashTable *table);
 
 void hash_table_put(HashTable *table, char *key, int value);
 int  hash_table_get_val(HashTable *table, char *key);
 bool hash_table_has(HashTable *table, char *key);
 
+// added to put 'nkeys' keys at once, none of them in the table yet nor
+// repeated, with values numbered from 'first_value' up. the chains are
+// linked by 'workers' (or the calling thread alone if NULL), each taking a
+// range of buckets, and come out the same as after putting the keys in order
+void hash_table_put_all(HashTable *table, char **keys, int nkeys,
+	int first_value, Workers *workers);
+
+// added to remove a key from the table, returns false if it wasn't there
+bool hash_table_delete(HashTable *table, char *key);
+
+// added to look up a batch of keys at once, with their memory accesses
+// overlapped: values[i] receives the value of keys[i], or 'missing' if it
+// isn't in the table. the table isn't modified (no move-to-front)
+void hash_table_get_batch(HashTable *table, char **keys, int nkeys,
+	int *values, int missing);
+
+// added to stop a table changing under lookups (no move-to-front, and any
+// resize in progress is finished now), so that it can be read by several
+// threads at once. no keys can be put into or deleted from a frozen table
+void hash_table_freeze(HashTable *table);
+
+// added to get the number of keys currently stored in the table
+int  hash_table_count(HashTable *table);
+
 // added to be able to get the hash function key (or string) stored
 char *hash_table_get_key(HashTable *table, char *key);
 
@@ -0,0 +1,476 @@
+/* * * * * * *
+ * Module for a similarity join between two word lists
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+
+#include "join.h"
+#include "workers.h"
+
+#define ROUND_WORDS (64 << 10)	// right words joined between writes
+#define CHUNK_WORDS 256			// right words a thread takes at a time
+
+#define FNV_BASIS 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+#define MIN(X,Y) (((X)<(Y))? (X):(Y)) // finds the minimum value between X and Y
+#define MAX(X,Y) (((X)>(Y))? (X):(Y)) // finds the maximum value between X and Y
+
+// a segment of a left word
+typedef struct {
+	uint64_t key;	// of the word's length, the segment's number and text
+	int id;			// the word
+} Posting;
+
+// the segments of the left words, by key
+typedef struct {
+	char **words;
+	int *lens;
+	int nwords;
+	int bound;		// distance the filter lets through
+
+	Posting *postings;	// sorted by key, then by word
+	int npostings;
+
+	// open addressing over the distinct keys: the postings of keys[s] are
+	// first[s] to first[s] + count[s] - 1. empty slots have a count of 0
+	uint64_t *keys;
+	int *first;
+	int *count;
+	uint32_t mask;
+
+	// words no longer than the bound are too short to cut into segments:
+	// the words of length l are short_ids[short_start[l]] onwards
+	int *short_ids;
+	int *short_start;
+} SegmentIndex;
+
+// one thread's scratch space
+typedef struct {
+	int *stamps;	// stamps[id] == stamp: left word 'id' is a candidate
+	int stamp;		// of the current right word
+	int *cands;
+	int ncands;
+	int size;
+	int *rows;		// rows of the banded distance table
+	int nrows;
+} Scratch;
+
+// the output of a chunk of right words
+typedef struct {
+	char *out;
+	size_t nout;
+	size_t size;
+} Chunk;
+
+// a round of right words, shared between the threads
+typedef struct {
+	SegmentIndex *index;
+	char **right;
+	int from;
+	int to;
+	int k;
+	bool transpose;
+	Chunk *chunks;	// chunk c holds right words from + c * CHUNK_WORDS on
+	int next;		// the next chunk to take
+	Scratch *scratch;	// by worker
+} JoinRound;
+
+/*----------------------------------------------------------------------*/
+/* HELPER FUNCTION PROTOTYPES */
+uint64_t segment_key(int len, int number, const char *text, int n);
+int compare_postings(const void *a, const void *b);
+SegmentIndex *new_segment_index(char **words, int nwords, int bound);
+void free_segment_index(SegmentIndex *index);
+int find_key(SegmentIndex *index, uint64_t key);
+void add_candidate(Scratch *scratch, int id);
+void find_candidates(SegmentIndex *index, const char *word, int m,
+	Scratch *scratch);
+int banded_distance(const char *a, int n, const char *b, int m, int k,
+	bool transpose, int *rows);
+int compare_ints(const void *a, const void *b);
+void chunk_put(Chunk *chunk, const char *data, size_t n);
+void join_word(JoinRound *round, const char *word, Scratch *scratch,
+	Chunk *chunk);
+void join_job(void *arg, int worker);
+
+/*----------------------------------------------------------------------*/
+/* SEGMENT INDEX */
+
+uint64_t segment_key(int len, int number, const char *text, int n) {
+	uint64_t hash = FNV_BASIS;
+	int i;
+	hash = (hash ^ (uint64_t)len) * FNV_PRIME;
+	hash = (hash ^ (uint64_t)number) * FNV_PRIME;
+	for (i = 0; i < n; i++) {
+		hash = (hash ^ (unsigned char)text[i]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+int compare_postings(const void *a, const void *b) {
+	const Posting *x = a, *y = b;
+	if (x->key != y->key) {
+		return x->key < y->key ? -1 : 1;
+	}
+	return (x->id > y->id) - (x->id < y->id);
+}
+
+/* Cuts each word longer than 'bound' into bound+1 segments (the first ones
+ * a letter shorter if they can't all be the same length), and indexes them
+ */
+SegmentIndex *new_segment_index(char **words, int nwords, int bound) {
+	SegmentIndex *index = malloc(sizeof *index);
+	assert(index);
+	int nsegs = bound + 1;
+	int i, j, nshort = 0;
+
+	index->words = words;
+	index->nwords = nwords;
+	index->bound = bound;
+	index->lens = malloc(sizeof(int) * (nwords > 0 ? nwords : 1));
+	assert(index->lens);
+	for (i = 0; i < nwords; i++) {
+		index->lens[i] = strlen(words[i]);
+		nshort += index->lens[i] <= bound;
+	}
+
+	// short words, grouped by length (a counting sort keeps them in order)
+	index->short_ids = malloc(sizeof(int) * (nshort > 0 ? nshort : 1));
+	index->short_start = calloc(bound + 2, sizeof(int));
+	assert(index->short_ids && index->short_start);
+	for (i = 0; i < nwords; i++) {
+		if (index->lens[i] <= bound) {
+			index->short_start[index->lens[i] + 1]++;
+		}
+	}
+	for (i = 1; i <= bound + 1; i++) {
+		index->short_start[i] += index->short_start[i-1];
+	}
+	int *fill = malloc(sizeof(int) * (bound + 1));
+	assert(fill);
+	memcpy(fill, index->short_start, sizeof(int) * (bound + 1));
+	for (i = 0; i < nwords; i++) {
+		if (index->lens[i] <= bound) {
+			index->short_ids[fill[index->lens[i]]++] = i;
+		}
+	}
+	free(fill);
+
+	// every segment of every other word
+	index->npostings = (nwords - nshort) * nsegs;
+	index->postings = malloc(sizeof(Posting)
+		* (index->npostings > 0 ? index->npostings : 1));
+	assert(index->postings);
+	Posting *posting = index->postings;
+	for (i = 0; i < nwords; i++) {
+		int len = index->lens[i];
+		if (len <= bound) {
+			continue;
+		}
+		int base = len / nsegs, longer = nsegs - len % nsegs, at = 0;
+		for (j = 0; j < nsegs; j++) {
+			int n = base + (j >= longer);
+			posting->key = segment_key(len, j, words[i] + at, n);
+			posting->id = i;
+			posting++;
+			at += n;
+		}
+	}
+	qsort(index->postings, index->npostings, sizeof(Posting),
+		compare_postings);
+
+	// a slot for each distinct key, at most half of them used
+	uint32_t nslots = 2;
+	while (nslots < 2 * (uint32_t)index->npostings) {
+		nslots *= 2;
+	}
+	index->mask = nslots - 1;
+	index->keys = malloc(sizeof(uint64_t) * nslots);
+	index->first = malloc(sizeof(int) * nslots);
+	index->count = calloc(nslots, sizeof(int));
+	assert(index->keys && index->first && index->count);
+	for (i = 0; i < index->npostings; i = j) {
+		uint64_t key = index->postings[i].key;
+		for (j = i; j < index->npostings && index->postings[j].key == key;
+				j++) {
+		}
+		uint32_t slot = (uint32_t)key & index->mask;
+		while (index->count[slot]) {
+			slot = (slot + 1) & index->mask;
+		}
+		index->keys[slot] = key;
+		index->first[slot] = i;
+		index->count[slot] = j - i;
+	}
+	return index;
+}
+
+void free_segment_index(SegmentIndex *index) {
+	free(index->lens);
+	free(index->short_ids);
+	free(index->short_start);
+	free(index->postings);
+	free(index->keys);
+	free(index->first);
+	free(index->count);
+	free(index);
+}
+
+// the slot of 'key', or -1 if no segment has it
+int find_key(SegmentIndex *index, uint64_t key) {
+	uint32_t slot = (uint32_t)key & index->mask;
+	while (index->count[slot]) {
+		if (index->keys[slot] == key) {
+			return slot;
+		}
+		slot = (slot + 1) & index->mask;
+	}
+	return -1;
+}
+
+/*----------------------------------------------------------------------*/
+/* FILTERING */
+
+void add_candidate(Scratch *scratch, int id) {
+	if (scratch->stamps[id] == scratch->stamp) {
+		return;
+	}
+	scratch->stamps[id] = scratch->stamp;
+	if (scratch->ncands == scratch->size) {
+		scratch->size = scratch->size ? 2 * scratch->size : 64;
+		scratch->cands = realloc(scratch->cands,
+			sizeof(int) * scratch->size);
+		assert(scratch->cands);
+	}
+	scratch->cands[scratch->ncands++] = id;
+}
+
+/* Finds every left word that may be within the bound of the 'm' letters
+ * at 'word': of a length within the bound, and with one of its segments in
+ * 'word' at a place that the edits around it could have moved it to. the
+ * places are those of multi-match-aware pass-join: segment i (from 0) of a
+ * word of length l starting at p can only be matched starting between
+ * max(p - i, p + (m-l) - (bound-i)) and min(p + i, p + (m-l) + (bound-i))
+ */
+void find_candidates(SegmentIndex *index, const char *word, int m,
+		Scratch *scratch) {
+	int bound = index->bound, nsegs = bound + 1;
+	int len, i, j, q;
+
+	scratch->stamp++;
+	scratch->ncands = 0;
+	for (len = MAX(0, m - bound); len <= m + bound; len++) {
+		if (len <= bound) {
+			for (j = index->short_start[len]; j < index->short_start[len+1];
+					j++) {
+				add_candidate(scratch, index->short_ids[j]);
+			}
+			continue;
+		}
+		int base = len / nsegs, longer = nsegs - len % nsegs;
+		int delta = m - len;
+		for (i = 0; i < nsegs; i++) {
+			int n = base + (i >= longer);
+			int p = i * base + MAX(0, i - longer);
+			int lo = MAX(MAX(p - i, p + delta - (bound - i)), 0);
+			int hi = MIN(MIN(p + i, p + delta + (bound - i)), m - n);
+			for (q = lo; q <= hi; q++) {
+				int slot = find_key(index, segment_key(len, i, word + q, n));
+				if (slot < 0) {
+					continue;
+				}
+				for (j = 0; j < index->count[slot]; j++) {
+					add_candidate(scratch,
+						index->postings[index->first[slot] + j].id);
+				}
+			}
+		}
+	}
+}
+
+/*----------------------------------------------------------------------*/
+/* VERIFYING */
+
+/* Finds the edit distance between the 'n' letters at 'a' and the 'm' at
+ * 'b', as long as it is at most 'k', or returns k+1. only the cells within
+ * k of the diagonal are filled (any other is over k), in three rows of
+ * 'rows' (room for 3 * (m+1)), and it stops as soon as a row is over k
+ */
+int banded_distance(const char *a, int n, const char *b, int m, int k,
+		bool transpose, int *rows) {
+	int *row = rows, *last = rows + m + 1, *older = rows + 2 * (m + 1);
+	int over = k + 1;
+	int i, j;
+
+	if (n - m > k || m - n > k) {
+		return over;
+	}
+	for (j = 0; j <= MIN(m, k); j++) {
+		row[j] = j;
+	}
+	if (k + 1 <= m) {
+		row[k + 1] = over;
+	}
+	for (i = 1; i <= n; i++) {
+		int *reuse = older;
+		older = last;
+		last = row;
+		row = reuse;
+
+		// the band of this row, with a cell over k on either side
+		int lo = MAX(1, i - k), hi = MIN(m, i + k);
+		row[lo - 1] = lo == 1 ? i : over;
+		if (hi < m) {
+			row[hi + 1] = over;
+		}
+
+		int rowmin = row[lo - 1];
+		for (j = lo; j <= hi; j++) {
+			int edist = MIN(last[j-1] + (a[i-1] != b[j-1]),
+				MIN(last[j] + 1, row[j-1] + 1));
+			if (transpose && i > 1 && j > 1 && a[i-1] == b[j-2]
+					&& a[i-2] == b[j-1]) {
+				edist = MIN(edist, older[j-2] + 1);
+			}
+			row[j] = MIN(edist, over);
+			rowmin = MIN(rowmin, row[j]);
+		}
+		if (rowmin > k) {
+			return over;
+		}
+	}
+	return MIN(row[m], over);
+}
+
+int compare_ints(const void *a, const void *b) {
+	int x = *(const int *)a, y = *(const int *)b;
+	return (x > y) - (x < y);
+}
+
+/*----------------------------------------------------------------------*/
+/* JOINING */
+
+void chunk_put(Chunk *chunk, const char *data, size_t n) {
+	if (chunk->nout + n > chunk->size) {
+		while (chunk->nout + n > chunk->size) {
+			chunk->size = chunk->size ? 2 * chunk->size : 4096;
+		}
+		chunk->out = realloc(chunk->out, chunk->size);
+		assert(chunk->out);
+	}
+	memcpy(chunk->out + chunk->nout, data, n);
+	chunk->nout += n;
+}
+
+// add a line for every left word within k of 'word' to 'chunk'
+void join_word(JoinRound *round, const char *word, Scratch *scratch,
+		Chunk *chunk) {
+	SegmentIndex *index = round->index;
+	int m = strlen(word), i;
+	char number[16];
+
+	if (3 * (m + 1) > scratch->nrows) {
+		scratch->nrows = 3 * (m + 1);
+		scratch->rows = realloc(scratch->rows, sizeof(int) * scratch->nrows);
+		assert(scratch->rows);
+	}
+	find_candidates(index, word, m, scratch);
+
+	// in the order of the left list
+	qsort(scratch->cands, scratch->ncands, sizeof(int), compare_ints);
+	for (i = 0; i < scratch->ncands; i++) {
+		int id = scratch->cands[i];
+		int dist = banded_distance(index->words[id], index->lens[id], word,
+			m, round->k, round->transpose, scratch->rows);
+		if (dist <= round->k) {
+			chunk_put(chunk, index->words[id], index->lens[id]);
+			chunk_put(chunk, " ", 1);
+			chunk_put(chunk, word, m);
+			chunk_put(chunk, number, sprintf(number, " %d\n", dist));
+		}
+	}
+}
+
+// each worker takes the next chunk of the round, until there are none left
+void join_job(void *arg, int worker) {
+	JoinRound *round = arg;
+	Scratch *scratch = &round->scratch[worker];
+	int c, i;
+
+	for (;;) {
+		c = __atomic_fetch_add(&round->next, 1, __ATOMIC_RELAXED);
+		int from = round->from + c * CHUNK_WORDS;
+		if (from >= round->to) {
+			break;
+		}
+		int to = MIN(from + CHUNK_WORDS, round->to);
+		for (i = from; i < to; i++) {
+			join_word(round, round->right[i], scratch, &round->chunks[c]);
+		}
+	}
+}
+
+void run_join(char **left, int nleft, char **right, int nright, int k,
+		bool transpose, int nthreads, FILE *out) {
+	int nchunks = (ROUND_WORDS + CHUNK_WORDS - 1) / CHUNK_WORDS;
+	int i, c;
+
+	if (nthreads < 1) {
+		nthreads = 1;
+	}
+
+	// a transposition is two edits without transpositions, so a pair within
+	// k of each other with them is within 2k without
+	JoinRound round = {
+		.index = new_segment_index(left, nleft, transpose ? 2 * k : k),
+		.right = right,
+		.k = k,
+		.transpose = transpose,
+	};
+	round.chunks = calloc(nchunks, sizeof(Chunk));
+	round.scratch = calloc(nthreads, sizeof(Scratch));
+	assert(round.chunks && round.scratch);
+	for (i = 0; i < nthreads; i++) {
+		round.scratch[i].stamps = calloc(nleft > 0 ? nleft : 1, sizeof(int));
+		assert(round.scratch[i].stamps);
+	}
+	Workers *workers = nthreads > 1 ? new_workers(nthreads) : NULL;
+
+	// a round of right words at a time, written out in order
+	for (round.from = 0; round.from < nright; round.from += ROUND_WORDS) {
+		round.to = MIN(round.from + ROUND_WORDS, nright);
+		round.next = 0;
+		if (workers) {
+			workers_run(workers, join_job, &round);
+		} else {
+			join_job(&round, 0);
+		}
+		for (c = 0; c < nchunks; c++) {
+			fwrite(round.chunks[c].out, 1, round.chunks[c].nout, out);
+			round.chunks[c].nout = 0;
+		}
+	}
+
+	if (workers) {
+		free_workers(workers);
+	}
+	for (i = 0; i < nthreads; i++) {
+		free(round.scratch[i].stamps);
+		free(round.scratch[i].cands);
+		free(round.scratch[i].rows);
+	}
+	for (c = 0; c < nchunks; c++) {
+		free(round.chunks[c].out);
+	}
+	free(round.scratch);
+	free(round.chunks);
+	free_segment_index(round.index);
+}
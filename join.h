@@ -0,0 +1,30 @@
+/* * * * * * *
+ * Module for a similarity join: every pair of a word from one list and a
+ * word from another that are within edit distance k of each other
+ *
+ * candidates come from partitioning (pass-join): each word of the first
+ * list is cut into k+1 segments, so any word within distance k of it holds
+ * one of them unchanged, near where it was. the segments are indexed by
+ * word length, segment number and text, and each word of the second list
+ * only looks up the substrings it has in those places. the few candidates
+ * are then verified with a distance banded to k, which stops as soon as a
+ * whole row is over k
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#ifndef JOIN_H
+#define JOIN_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// write "a b d" to 'out' for every word 'a' of 'left' ('nleft' words) and
+// 'b' of 'right' within edit distance d <= 'k' of each other (optimal
+// string alignment distance with 'transpose'). pairs come in the order of
+// 'right', and then of 'left'. the words of 'right' are split between
+// 'nthreads' threads, which does not change the output
+void run_join(char **left, int nleft, char **right, int nright, int k,
+	bool transpose, int nthreads, FILE *out);
+
+#endif
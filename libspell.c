@@ -0,0 +1,555 @@
+/* * * * * * *
+ * Embeddable spelling library (libspell.a): batch check and correction on
+ * top of the dictionary index, and of an optional overlay of extra words
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "libspell.h"
+#include "list.h"
+#include "dict.h"
+#include "memo.h"
+
+#define INIT_OVERLAY 16	// starting room for overlay words
+
+struct spell_index {
+	Dict *dict;			// the base words
+	SpellOptions options;
+	Memo *memo;			// open memo file, or NULL
+
+	// the image of a base index opened from a file, or NULL
+	void *map;
+	size_t map_len;
+
+	// overlay words, slotted into the rank order of the base words, or
+	// NULL. they are kept in that order (by position, then by the order
+	// they were added in), so overlay word i goes just before base word
+	// positions[i], and its rank among all words is positions[i] + i
+	Dict *overlay;
+	char **texts;		// each overlay word
+	int *positions;
+	int noverlay;
+	int overlay_size;
+
+	// room for the overlay's suggestions of one call to spell_suggest()
+	Suggestion *extra;
+	int extra_size;
+
+	// the index this one is a view of (sharing all of the above but its
+	// scratch space), or NULL
+	SpellIndex *owner;
+};
+
+/*----------------------------------------------------------------------*/
+/* HELPER FUNCTION PROTOTYPES */
+SpellIndex *new_index(Dict *dict);
+void configure_dict(Dict *dict, const SpellOptions *options, int threads);
+void sort_overlay(SpellIndex *index);
+int overlay_rank(SpellIndex *index, int id);
+int base_rank(SpellIndex *index, int rank);
+bool terminate_word(const SpellWord *word, char *buffer);
+bool better_result(int dist, int rank, int best_dist, int best_rank);
+void correct_overlay(SpellIndex *index, char *word, SpellResult *result);
+
+/*----------------------------------------------------------------------*/
+/* INDEX CREATION/DELETION */
+
+// an index over the words of 'dict', with no overlay
+SpellIndex *new_index(Dict *dict) {
+	SpellIndex *index = malloc(sizeof *index);
+	assert(index);
+	index->dict = dict;
+	index->options = (SpellOptions)SPELL_DEFAULT_OPTIONS;
+	index->memo = NULL;
+	index->map = NULL;
+	index->map_len = 0;
+	index->overlay = NULL;
+	index->texts = NULL;
+	index->positions = NULL;
+	index->noverlay = index->overlay_size = 0;
+	index->extra = NULL;
+	index->extra_size = 0;
+	index->owner = NULL;
+	return index;
+}
+
+SpellIndex *spell_index_build(const SpellWord *words, size_t nwords) {
+	return spell_index_build_threads(words, nwords, 1);
+}
+
+SpellIndex *spell_index_build_threads(const SpellWord *words, size_t nwords,
+		int nthreads) {
+	size_t i;
+
+	// the index interns its own copy of each distinct word
+	const char **ptrs = malloc(sizeof(char *) * (nwords ? nwords : 1));
+	size_t *lens = malloc(sizeof(size_t) * (nwords ? nwords : 1));
+	assert(ptrs && lens);
+	for (i=0; i<nwords; i++) {
+		ptrs[i] = words[i].ptr;
+		lens[i] = words[i].len;
+	}
+	SpellIndex *index = new_index(new_dict(nwords));
+	dict_add_all(index->dict, ptrs, lens, nwords, nthreads);
+	free(ptrs);
+	free(lens);
+	return index;
+}
+
+SpellIndex *spell_index_build_list(List *words, int nthreads) {
+	const char **ptrs = malloc(sizeof(char *) * (words->size + 1));
+	size_t *lens = malloc(sizeof(size_t) * (words->size + 1));
+	assert(ptrs && lens);
+	int n = 0;
+	Node *curr_node = words->head;
+	while (curr_node) {
+		ptrs[n] = curr_node->data;
+		lens[n++] = strlen(curr_node->data);
+		curr_node = curr_node->next;
+	}
+	SpellIndex *index = new_index(new_dict(words->size));
+	dict_add_all(index->dict, ptrs, lens, n, nthreads);
+	free(ptrs);
+	free(lens);
+	return index;
+}
+
+SpellIndex *spell_index_view(SpellIndex *index) {
+	assert(!index->owner);
+	SpellIndex *view = new_index(dict_view(index->dict));
+	view->owner = index;
+	view->options = index->options;
+	if (index->overlay) {
+		view->overlay = dict_view(index->overlay);
+		view->texts = index->texts;
+		view->positions = index->positions;
+		view->noverlay = index->noverlay;
+		view->overlay_size = index->overlay_size;
+	}
+	return view;
+}
+
+void spell_index_free(SpellIndex *index) {
+	assert(index != NULL);
+	if (index->owner) {
+		// only the scratch space is the view's own
+		free_dict(index->dict);
+		if (index->overlay) {
+			free_dict(index->overlay);
+		}
+		free(index->extra);
+		free(index);
+		return;
+	}
+	if (index->memo) {
+		close_memo(index->memo);
+	}
+	free_dict(index->dict);
+	if (index->map) {
+		munmap(index->map, index->map_len);
+	}
+	if (index->overlay) {
+		int i;
+		for (i=0; i<index->noverlay; i++) {
+			free(index->texts[i]);
+		}
+		free_dict(index->overlay);
+		free(index->texts);
+		free(index->positions);
+	}
+	free(index->extra);
+	free(index);
+}
+
+// apply 'options' to one of the dictionaries of an index
+void configure_dict(Dict *dict, const SpellOptions *options, int threads) {
+	dict_set_threads(dict, threads);
+	dict_set_transpositions(dict, options->transpositions);
+	dict_set_budget(dict, options->word_budget, options->doc_budget);
+	dict_set_trigrams(dict, options->trigrams);
+}
+
+int spell_index_configure(SpellIndex *index, const SpellOptions *options) {
+	assert(!index->owner);
+	configure_dict(index->dict, options, options->threads);
+	// the overlay is small enough to scan on the calling thread
+	if (index->overlay) {
+		configure_dict(index->overlay, options, 1);
+	}
+	index->options = *options;
+
+	// the memo is reopened, as its key depends on both the words and the
+	// distance used. it only ever holds corrections among the base words,
+	// so it can be shared by indexes with different overlays
+	if (index->memo) {
+		dict_set_memo(index->dict, NULL);
+		close_memo(index->memo);
+		index->memo = NULL;
+	}
+	if (options->memo) {
+		char distance = options->transpositions ? 't' : 'l';
+		uint64_t key = memo_hash(dict_content_hash(index->dict),
+			&distance, 1);
+		index->memo = open_memo(options->memo, key);
+		if (!index->memo) {
+			return -1;
+		}
+		dict_set_memo(index->dict, index->memo);
+	}
+	return 0;
+}
+
+int spell_index_save(SpellIndex *index) {
+	if (index->memo && !memo_flush(index->memo)) {
+		return -1;
+	}
+	return 0;
+}
+
+void spell_index_reset_budget(SpellIndex *index) {
+	dict_set_budget(index->dict, index->options.word_budget,
+		index->options.doc_budget);
+	if (index->overlay) {
+		dict_set_budget(index->overlay, index->options.word_budget,
+			index->options.doc_budget);
+	}
+}
+
+/*----------------------------------------------------------------------*/
+/* BASE INDEX FILES */
+
+int spell_index_save_base(SpellIndex *index, const char *path) {
+	FILE *file = fopen(path, "wb");
+	if (!file) {
+		perror("error creating base index file");
+		return -1;
+	}
+	bool ok = dict_write(index->dict, file);
+	ok = fclose(file) == 0 && ok;
+	if (!ok) {
+		perror("error writing base index file");
+		return -1;
+	}
+	return 0;
+}
+
+int spell_is_base_file(const char *path) {
+	char head[64];
+	FILE *file = fopen(path, "rb");
+	if (!file) {
+		return 0;
+	}
+	size_t len = fread(head, 1, sizeof head, file);
+	fclose(file);
+	return dict_is_image(head, len);
+}
+
+SpellIndex *spell_index_open_base(const char *path) {
+	struct stat st;
+	int fd = open(path, O_RDONLY);
+	if (fd < 0 || fstat(fd, &st) != 0) {
+		perror("error opening base index file");
+		if (fd >= 0) {
+			close(fd);
+		}
+		return NULL;
+	}
+
+	// a shared read-only mapping: the pages are the file's own, in the
+	// page cache, whichever process maps them
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		perror("error mapping base index file");
+		return NULL;
+	}
+	Dict *dict = dict_map(map, st.st_size);
+	if (!dict) {
+		fprintf(stderr, "error: \"%s\" is not a base index file\n", path);
+		munmap(map, st.st_size);
+		return NULL;
+	}
+
+	SpellIndex *index = new_index(dict);
+	index->map = map;
+	index->map_len = st.st_size;
+	return index;
+}
+
+/*----------------------------------------------------------------------*/
+/* OVERLAYS */
+
+size_t spell_index_add_overlay(SpellIndex *index, const SpellWord *words,
+		const int *positions, size_t nwords) {
+	char buffer[SPELL_MAX_WORD_LEN + 1];
+	int nbase = dict_size(index->dict);
+	size_t i, nadded = 0;
+	assert(!index->owner);
+
+	if (!index->overlay) {
+		index->overlay = new_dict(INIT_OVERLAY);
+		configure_dict(index->overlay, &index->options, 1);
+		index->overlay_size = INIT_OVERLAY;
+		index->texts = malloc(sizeof(char *)*index->overlay_size);
+		index->positions = malloc(sizeof(int)*index->overlay_size);
+		assert(index->texts && index->positions);
+	}
+
+	for (i=0; i<nwords; i++) {
+		// a word keeps its first rank, whether from the base or overlay
+		if (!terminate_word(&words[i], buffer)
+				|| dict_rank(index->dict, buffer) != DICT_NONE
+				|| dict_rank(index->overlay, buffer) != DICT_NONE) {
+			continue;
+		}
+		if (index->noverlay == index->overlay_size) {
+			index->overlay_size *= 2;
+			index->texts = realloc(index->texts,
+				sizeof(char *)*index->overlay_size);
+			index->positions = realloc(index->positions,
+				sizeof(int)*index->overlay_size);
+			assert(index->texts && index->positions);
+		}
+		// (added here for now, to catch repeats within this batch)
+		int id = dict_add(index->overlay, buffer, words[i].len);
+		assert(id == index->noverlay);
+		index->texts[id] = malloc(words[i].len + 1);
+		assert(index->texts[id]);
+		memcpy(index->texts[id], buffer, words[i].len + 1);
+		index->positions[id] = positions[i] < 0 ? 0
+			: positions[i] > nbase ? nbase : positions[i];
+		index->noverlay++;
+		nadded++;
+	}
+	if (nadded) {
+		sort_overlay(index);
+	}
+	return nadded;
+}
+
+/* Puts the overlay words in rank order, by position and then by the order
+ * they were added in, and rebuilds the overlay's index in that order: its
+ * own ranks then follow the ranks among all words, so its first correction
+ * (and its suggestions' order) is the right one
+ */
+void sort_overlay(SpellIndex *index) {
+	int i, j, n = index->noverlay;
+
+	// an insertion sort, as the words before this batch are in order
+	// already, and overlays are small
+	for (i=1; i<n; i++) {
+		char *text = index->texts[i];
+		int position = index->positions[i];
+		for (j=i; j>0 && index->positions[j-1] > position; j--) {
+			index->texts[j] = index->texts[j-1];
+			index->positions[j] = index->positions[j-1];
+		}
+		index->texts[j] = text;
+		index->positions[j] = position;
+	}
+
+	free_dict(index->overlay);
+	index->overlay = new_dict(n > INIT_OVERLAY ? n : INIT_OVERLAY);
+	configure_dict(index->overlay, &index->options, 1);
+	for (i=0; i<n; i++) {
+		int id = dict_add(index->overlay, index->texts[i],
+			strlen(index->texts[i]));
+		assert(id == i);
+	}
+}
+
+// the rank among all words of overlay word 'id': i overlay words come
+// ahead of the i-th one
+int overlay_rank(SpellIndex *index, int id) {
+	return index->positions[id] + id;
+}
+
+// the rank among all words of the base word with rank 'rank': every
+// overlay word at or before its position comes ahead of it
+int base_rank(SpellIndex *index, int rank) {
+	int lo = 0, hi = index->noverlay;
+	if (rank == DICT_NONE) {
+		return rank;
+	}
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		if (index->positions[mid] <= rank) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return rank + lo;
+}
+
+// returns whether a correction at 'dist' with 'rank' beats the best so far
+bool better_result(int dist, int rank, int best_dist, int best_rank) {
+	if (dist == DICT_NONE) {
+		return false;
+	}
+	return best_dist == DICT_NONE || dist < best_dist
+		|| (dist == best_dist && rank < best_rank);
+}
+
+/* Turns the base 'result' for 'word' into the best of the base and the
+ * overlay: by distance, then by rank among all words
+ */
+void correct_overlay(SpellIndex *index, char *word, SpellResult *result) {
+	int id, dist;
+
+	result->rank = base_rank(index, result->rank);
+	if (result->dist == 0) {
+		// a base word is never in the overlay too
+		return;
+	}
+	char *found = dict_correct(index->overlay, word, &id, &dist);
+	if (found && better_result(dist, overlay_rank(index, id), result->dist,
+			result->rank)) {
+		result->word = found;
+		result->rank = overlay_rank(index, id);
+		result->dist = dist;
+	}
+	result->degraded |= dict_degraded(index->overlay);
+}
+
+/*----------------------------------------------------------------------*/
+/* BATCH CHECKING AND CORRECTING */
+
+/* Copies 'word' into 'buffer' as a '\0'-terminated string
+ * returns false if it is too long to be a dictionary word
+ */
+bool terminate_word(const SpellWord *word, char *buffer) {
+	if (word->len > SPELL_MAX_WORD_LEN) {
+		return false;
+	}
+	memcpy(buffer, word->ptr, word->len);
+	buffer[word->len] = '\0';
+	return true;
+}
+
+size_t spell_check_batch(SpellIndex *index, const SpellWord *words,
+		size_t nwords, int *ranks) {
+	char buffer[SPELL_MAX_WORD_LEN + 1];
+	size_t i, nmissing=0;
+
+	for (i=0; i<nwords; i++) {
+		ranks[i] = SPELL_NONE;
+		if (terminate_word(&words[i], buffer)) {
+			ranks[i] = dict_rank(index->dict, buffer);
+			if (index->overlay) {
+				// a word is in the base or the overlay, never both
+				ranks[i] = base_rank(index, ranks[i]);
+				int id = ranks[i] == SPELL_NONE
+					? dict_rank(index->overlay, buffer) : DICT_NONE;
+				if (id != DICT_NONE) {
+					ranks[i] = overlay_rank(index, id);
+				}
+			}
+		}
+		if (ranks[i] == SPELL_NONE) {
+			nmissing++;
+		}
+	}
+	return nmissing;
+}
+
+size_t spell_correct_batch(SpellIndex *index, const SpellWord *words,
+		size_t nwords, SpellResult *results) {
+	char buffer[SPELL_MAX_WORD_LEN + 1];
+	size_t i, nmissing=0;
+
+	for (i=0; i<nwords; i++) {
+		SpellResult *result = &results[i];
+		result->word = NULL;
+		result->rank = SPELL_NONE;
+		result->dist = SPELL_NONE;
+		result->degraded = 0;
+		if (terminate_word(&words[i], buffer)) {
+			result->word = dict_correct(index->dict, buffer,
+				&result->rank, &result->dist);
+			result->degraded = dict_degraded(index->dict);
+			if (index->overlay) {
+				correct_overlay(index, buffer, result);
+			}
+		}
+		if (result->word) {
+			result->len = strlen(result->word);
+		} else {
+			result->len = 0;
+			nmissing++;
+		}
+	}
+	return nmissing;
+}
+
+size_t spell_suggest(SpellIndex *index, const SpellWord *word, int k,
+		int maxdist, SpellResult *results) {
+	char buffer[SPELL_MAX_WORD_LEN + 1];
+	int i, nfound;
+
+	if (k < 1 || !terminate_word(word, buffer)) {
+		return 0;
+	}
+
+	// the suggestions are gathered in place, then widened into results
+	// from the back, as a result is larger than a suggestion
+	Suggestion *found = (Suggestion *)results;
+	assert(sizeof *found <= sizeof *results);
+	nfound = dict_suggest(index->dict, buffer, k, maxdist, found);
+	for (i=nfound-1; i>=0; i--) {
+		Suggestion s = found[i];
+		results[i].word = s.word;
+		results[i].rank = index->overlay ? base_rank(index, s.rank) : s.rank;
+		results[i].dist = s.dist;
+		results[i].len = strlen(s.word);
+		results[i].degraded = 0;
+	}
+	if (!index->overlay) {
+		return nfound;
+	}
+
+	// merge in the overlay's own best 'k', keeping the best 'k' of both.
+	// they come sorted by (distance, rank) among all words too
+	if (k > index->extra_size) {
+		index->extra_size = k;
+		index->extra = realloc(index->extra, sizeof *index->extra * k);
+		assert(index->extra);
+	}
+	Suggestion *extra = index->extra;
+	int nextra = dict_suggest(index->overlay, buffer, k, maxdist, extra);
+	for (i=0; i<nextra; i++) {
+		int rank = overlay_rank(index, extra[i].rank);
+		int at = nfound;
+		while (at > 0 && better_result(extra[i].dist, rank,
+				results[at-1].dist, results[at-1].rank)) {
+			at--;
+		}
+		if (at == k) {
+			break;
+		}
+		if (nfound == k) {
+			nfound--;
+		}
+		memmove(&results[at+1], &results[at],
+			sizeof *results * (nfound - at));
+		results[at].word = extra[i].word;
+		results[at].rank = rank;
+		results[at].dist = extra[i].dist;
+		results[at].len = strlen(extra[i].word);
+		results[at].degraded = 0;
+		nfound++;
+	}
+	return nfound;
+}
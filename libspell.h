@@ -0,0 +1,140 @@
+/* * * * * * *
+ * Embeddable spelling library (libspell.a): build a dictionary index once,
+ * then check or correct whole batches of words without going through
+ * stdout. words are passed as (pointer, length) pairs and do not need to be
+ * '\0'-terminated. results are written into caller-provided arrays, and
+ * result words point into the index, so no call allocates anything for its
+ * results
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#ifndef LIBSPELL_H
+#define LIBSPELL_H
+
+#include <stddef.h>
+#include "list.h"
+
+#define SPELL_NONE (-1)			// rank or distance when there is no word
+#define SPELL_MAX_WORD_LEN 255	// longer words are always misspelled
+
+typedef struct spell_index SpellIndex;
+
+// tuning settings of an index
+typedef struct {
+	int threads;		// threads sharing the dictionary scan of a single word
+	int transpositions;	// if set, a swap of adjacent letters is one edit
+
+	// work a correction may do, in probes and distance table cells, for
+	// each word and for the whole document (every word corrected since the
+	// options were set, or the budget reset). 0 for no limit
+	long word_budget;
+	long doc_budget;
+
+	// path of a memo file that keeps corrections of misspelled words
+	// across runs (see memo.h), or NULL for none
+	const char *memo;
+
+	// if set, the distance 3 search only verifies the words that share
+	// enough trigrams with the query (see trigrams.h), from an index built
+	// when the options are set
+	int trigrams;
+} SpellOptions;
+
+#define SPELL_DEFAULT_OPTIONS { 1, 0, 0, 0, NULL, 0 }
+
+// a word to look up: 'len' bytes starting at 'ptr'
+typedef struct {
+	const char *ptr;
+	size_t len;
+} SpellWord;
+
+// the answer for one word of spell_correct_batch()
+typedef struct {
+	int rank;			// rank of 'word' in the dictionary, or SPELL_NONE
+	int dist;			// edit distance from the query (0 if correctly spelled)
+						// or SPELL_NONE
+	const char *word;	// the correction ('\0'-terminated, owned by the
+						// index), or NULL if there is none
+	size_t len;			// strlen(word), or 0
+	int degraded;		// the search ran out of budget: 'word' is the best
+						// correction found before it did, or NULL
+} SpellResult;
+
+// build an index over 'nwords' dictionary words, ranked in the given order
+// (a repeated word keeps the rank of its first occurrence)
+// the words are copied, so the caller's memory can be reused afterwards
+SpellIndex *spell_index_build(const SpellWord *words, size_t nwords);
+void spell_index_free(SpellIndex *index);
+
+// as above, with the work split between 'nthreads' threads. every word
+// gets the same rank as in an index built on a single thread
+SpellIndex *spell_index_build_threads(const SpellWord *words, size_t nwords,
+	int nthreads);
+
+// as above, for the words (strings) of a list, as read by the a2 tasks
+SpellIndex *spell_index_build_list(List *words, int nthreads);
+
+// a view of 'index' for another thread: it shares every word (and the memo
+// file) of 'index', but has scratch space of its own, so that it can check
+// and correct words while 'index' and its other views do too. it takes the
+// settings of 'index', which must already have all of its words, overlay
+// and settings: none of them can change from then on. the view is freed
+// with spell_index_free(), before 'index' is
+SpellIndex *spell_index_view(SpellIndex *index);
+
+// write the words of 'index' (not its overlay) to 'path' as a base index
+// file. returns 0, or -1 (with a message on stderr) on failure
+int spell_index_save_base(SpellIndex *index, const char *path);
+
+// open a base index file written by spell_index_save_base(). the file is
+// mapped read-only and used in place, so every process that opens it
+// shares a single copy of the words: each index only holds its own
+// scratch space (and overlay). returns NULL (with a message on stderr) if
+// the file can't be opened or isn't a base index file
+SpellIndex *spell_index_open_base(const char *path);
+
+// returns whether the file at 'path' is a base index file
+int spell_is_base_file(const char *path);
+
+// add 'nwords' overlay words to an index, without touching its base words
+// (of a built or an opened index alike): words[i] takes the place of base
+// word positions[i] in the rank order, just ahead of it (0 for first,
+// past the last base word for last), and overlay words at the same
+// position keep the order they were added in. a word that is already in
+// the index keeps its rank. every rank reported from then on is a rank
+// among all words. returns the number of words added
+size_t spell_index_add_overlay(SpellIndex *index, const SpellWord *words,
+	const int *positions, size_t nwords);
+
+// change the settings of an index (an index starts with
+// SPELL_DEFAULT_OPTIONS). not safe while a batch is running. a memo file is
+// opened for the words in the index now, so configure it once they are all
+// in. returns 0, or -1 if the memo file could not be opened (the other
+// settings still take effect)
+int spell_index_configure(SpellIndex *index, const SpellOptions *options);
+
+// append the corrections learned since the last save to the memo file, if
+// there is one (spell_index_free() does too). returns 0, or -1 on failure
+int spell_index_save(SpellIndex *index);
+
+// start a new document: the document budget is available in full again
+void spell_index_reset_budget(SpellIndex *index);
+
+// Task 3 for a batch: ranks[i] receives the rank of words[i], or SPELL_NONE
+// if it is misspelled. returns the number of misspelled words
+size_t spell_check_batch(SpellIndex *index, const SpellWord *words,
+	size_t nwords, int *ranks);
+
+// Task 4 for a batch: results[i] receives the correction of words[i]
+// returns the number of words that have no correction
+size_t spell_correct_batch(SpellIndex *index, const SpellWord *words,
+	size_t nwords, SpellResult *results);
+
+// the 'k' best corrections of one word within edit distance 'maxdist',
+// ordered by distance and then by rank. results needs room for 'k'
+// returns the number of suggestions found
+size_t spell_suggest(SpellIndex *index, const SpellWord *word, int k,
+	int maxdist, SpellResult *results);
+
+#endif
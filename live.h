@@ -0,0 +1,41 @@
+/* * * * * * *
+ * Module for incremental re-checking of a document that is being edited:
+ * the document (one word per line, as for Task 3/4) and the result of
+ * each of its lines are kept between versions, and only the lines whose
+ * text changed are checked or corrected again
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ *
+ * protocol (text, one command per line on the input):
+ *   @doc N         the next N lines are the whole new document
+ *   @edit A B N    lines A to B-1 (counting from 0) are replaced by the
+ *                  next N lines
+ *   @quit          stop (as does the end of the input)
+ *
+ * every command is answered with the change to the output, in the same
+ * form: "@edit A B N" followed by the N new output lines (as printed by
+ * Task 3/4) that replace output lines A to B-1. a new version of the whole
+ * document is answered with only the lines between its unchanged start and
+ * end. a malformed command is answered with "@error" followed by a reason
+ *
+ * as for Task 3/4, the document ends at its first blank line, and a line
+ * that isn't a lowercase word is skipped with a warning on stderr: output
+ * line numbers count the words printed, not the lines of the document
+ */
+
+#ifndef LIVE_H
+#define LIVE_H
+
+#include <stdio.h>
+
+#include "libspell.h"
+
+#define LIVE_OP_CHECK 'c'	// Task 3
+#define LIVE_OP_SPELL 's'	// Task 4
+
+// answer the commands read from 'in' against 'index' with operation 'op',
+// writing the answers to 'out' (flushed after each one). returns 0 once
+// the input ends
+int run_live(SpellIndex *index, char op, FILE *in, FILE *out);
+
+#endif
@@ -13,6 +13,11 @@
 
 #include "list.h"
 #include "spell.h"
+#include "server.h"
+#include "live.h"
+#include "pipeline.h"
+#include "tokens.h"
+#include "pool.h"
 
 /*                         DO NOT CHANGE THIS FILE
  * 
@@ -32,6 +37,15 @@ typedef enum task {
 	TASK_EDITS = 2,
 	TASK_CHECK = 3,
 	TASK_SPELL = 4,
+	TASK_SERVE = 5,
+	TASK_CLIENT = 6,
+	TASK_SUGGEST = 7,
+	TASK_LIVE = 8,
+	TASK_INDEX = 9,
+	TASK_FIX = 10,
+	TASK_BULKDIST = 11,
+	TASK_BULKEDITS = 12,
+	TASK_JOIN = 13,
 } Task;
 
 // struct to store the command line options
@@ -41,12 +55,31 @@ typedef struct options {
 	char *word1;
 	char *word2;
 	FILE *dicfile;
+	char *dicpath;	// the dictionary's file name
 	FILE *docfile;
+	FILE *joinfile;	// the second word list of a join (task 13)
+	char *socket;	// socket path for the daemon (tasks 5 / 6)
+	char *output;	// base index file to write (task 9)
+	char op;		// operation the client asks for (task 6 / 8)
+	int  k;			// number of suggestions per word (task 7)
+	int  maxdist;	// largest edit distance of a suggestion (task 7)
+	SpellOptions spell;	// settings for the dictionary index (flags)
+	int  stats;			// print allocation statistics at the end (flag)
+	int  prose;			// documents are raw prose, not a word per line (flag)
+	int  workers;		// correction workers of a pipelined Task 3/4 (flag)
+	int  depth;			// blocks in flight in the pipeline (flag)
+	int  shards;		// shard processes of a sharded Task 3/4 (flag)
+	int  files;			// task 1's arguments are file names (flag)
+	int  script;		// task 1 prints the edits too (flag)
 } Options;
 
 // helper functions
 Options get_options(int argc, char **argv);
+List *read_dictionary(Options *options);
 List *read_word_list(FILE *file);
+List *read_document(Options *options);
+char *read_text(FILE *file, size_t *len);
+char *read_string(char *path);
 void free_word_list(List *list);
 
 // program entry point
@@ -57,18 +90,81 @@ int main(int argc, char **argv) {
 	if (options.invalid) {
 		exit(EXIT_FAILURE);
 	}
+	spell_options = options.spell;
 
 	// branch to relevant function depending on execution mode
 	if (options.task == TASK_DIST) {
-		print_edit_distance(options.word1, options.word2);
+		if (options.script) {
+			print_edit_script(options.word1, options.word2);
+		} else {
+			print_edit_distance(options.word1, options.word2);
+		}
+		if (options.files) {
+			free(options.word1);
+			free(options.word2);
+		}
 
 	} else if (options.task == TASK_EDITS) {
 		print_all_edits(options.word1);
 
+	} else if (options.task == TASK_BULKDIST
+			|| options.task == TASK_BULKEDITS) {
+		char op = options.task == TASK_BULKDIST ? PIPELINE_OP_DIST
+			: PIPELINE_OP_EDITS;
+		if (print_bulk(options.docfile, op, options.workers,
+				options.depth) != 0) {
+			exit(EXIT_FAILURE);
+		}
+
+	} else if (options.task == TASK_JOIN) {
+		List *left  = read_word_list(options.dicfile);
+		List *right = read_word_list(options.joinfile);
+
+		print_join(left, right, options.k,
+			options.workers > 0 ? options.workers : 1);
+
+		free_word_list(left);
+		free_word_list(right);
+
 	} else if (options.task == TASK_CHECK || options.task == TASK_SPELL) {
 		// prepare dictionary and document
-		List *dictionary = read_word_list(options.dicfile);
-		List *document   = read_word_list(options.docfile);
+		List *dictionary = read_dictionary(&options);
+
+		// or stream the document through a pipeline instead
+		if (options.workers > 0) {
+			char op = options.task == TASK_CHECK ? PIPELINE_OP_CHECK
+				: PIPELINE_OP_SPELL;
+			int status = print_pipelined(dictionary, options.docfile, op,
+				options.workers, options.depth);
+
+			free_word_list(dictionary);
+			if (status != 0) {
+				exit(EXIT_FAILURE);
+			}
+			if (options.stats) {
+				fprint_alloc_stats(stderr);
+			}
+			exit(EXIT_SUCCESS);
+		}
+		List *document   = read_document(&options);
+
+		// or split the dictionary between shard processes
+		if (options.shards > 0) {
+			char op = options.task == TASK_CHECK ? PIPELINE_OP_CHECK
+				: PIPELINE_OP_SPELL;
+			int status = print_sharded(dictionary, document, op,
+				options.shards);
+
+			free_word_list(dictionary);
+			free_word_list(document);
+			if (status != 0) {
+				exit(EXIT_FAILURE);
+			}
+			if (options.stats) {
+				fprint_alloc_stats(stderr);
+			}
+			exit(EXIT_SUCCESS);
+		}
 
 		if (options.task == TASK_CHECK) {
 			print_checked(dictionary, document);
@@ -80,6 +176,64 @@ int main(int argc, char **argv) {
 		// clean up
 		free_word_list(dictionary);
 		free_word_list(document);
+
+	} else if (options.task == TASK_SUGGEST) {
+		List *dictionary = read_dictionary(&options);
+		List *document   = read_document(&options);
+
+		print_suggestions(dictionary, document, options.k, options.maxdist);
+
+		free_word_list(dictionary);
+		free_word_list(document);
+
+	} else if (options.task == TASK_SERVE) {
+		// load the dictionary once, then serve it until interrupted
+		List *dictionary = read_dictionary(&options);
+		SpellIndex *index = open_spell_index(dictionary);
+		int status = run_server(index, options.socket);
+
+		spell_index_free(index);
+		free_word_list(dictionary);
+		if (status != 0) {
+			exit(EXIT_FAILURE);
+		}
+
+	} else if (options.task == TASK_LIVE) {
+		// load the dictionary once, then follow the document's edits
+		List *dictionary = read_dictionary(&options);
+		SpellIndex *index = open_spell_index(dictionary);
+		run_live(index, options.op, stdin, stdout);
+
+		spell_index_free(index);
+		free_word_list(dictionary);
+
+	} else if (options.task == TASK_FIX) {
+		List *dictionary = read_dictionary(&options);
+		size_t len;
+		char *text = read_text(options.docfile, &len);
+
+		print_fixed(dictionary, text, len);
+
+		free(text);
+		free_word_list(dictionary);
+
+	} else if (options.task == TASK_INDEX) {
+		List *dictionary = read_word_list(options.dicfile);
+		write_base_index(dictionary, options.output);
+		free_word_list(dictionary);
+
+	} else if (options.task == TASK_CLIENT) {
+		List *document = read_word_list(options.docfile);
+		int status = run_client(options.socket, options.op, document);
+
+		free_word_list(document);
+		if (status != 0) {
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	if (options.stats) {
+		fprint_alloc_stats(stderr);
 	}
 
 	// done!
@@ -91,6 +245,7 @@ int main(int argc, char **argv) {
 
 
 Task strtotask(char *str);
+int parse_flag(int argc, char **argv, Options *options);
 
 // read command line options into Options struct
 Options get_options(int argc, char **argv) {
@@ -101,10 +256,37 @@ Options get_options(int argc, char **argv) {
 		.word1   = NULL,
 		.word2   = NULL,
 		.dicfile = NULL,
+		.dicpath = NULL,
 		.docfile = NULL,
+		.joinfile = NULL,
+		.socket  = NULL,
+		.output  = NULL,
+		.op      = 0,
+		.k       = 0,
+		.maxdist = 0,
+		.spell   = SPELL_DEFAULT_OPTIONS,
+		.stats   = 0, // false
+		.prose   = 0, // false
+		.workers = 0,
+		.depth   = 0,
+		.shards  = 0,
+		.files   = 0, // false
+		.script  = 0, // false
 		.invalid = 0 // false
 	};
 
+	// flags come first, before the task: skip past them
+	int nflag;
+	while (argc >= 2 && argv[1][0] == '-') {
+		nflag = parse_flag(argc - 1, argv + 1, &options);
+		if (nflag == 0) {
+			options.invalid = 1; // true
+			return options;
+		}
+		argc -= nflag;
+		argv += nflag;
+	}
+
 	// look for the task argument to determine remaining behaviour
 	if (argc >= 2) {
 		options.task = strtotask(argv[1]);
@@ -121,11 +303,47 @@ Options get_options(int argc, char **argv) {
 		fprintf(stderr, " edits: enumerating all possible edits (task 2)\n");
 		fprintf(stderr, " check: spell checking                 (task 3)\n");
 		fprintf(stderr, " spell: spelling correction            (task 4)\n");
+		fprintf(stderr, " serve: spelling daemon on a socket    (task 5)\n");
+		fprintf(stderr, " client: check/spell via the daemon    (task 6)\n");
+		fprintf(stderr, " suggest: top-k ranked suggestions     (task 7)\n");
+		fprintf(stderr, " live:  incremental check/spell        (task 8)\n");
+		fprintf(stderr, " index: write a base index file        (task 9)\n");
+		fprintf(stderr, " fix:   correct raw prose in place     (task 10)\n");
+		fprintf(stderr, " bulkdist:  task 1 for each line's pair (task 11)\n");
+		fprintf(stderr, " bulkedits: task 2 for each line's word (task 12)\n");
+		fprintf(stderr, " join:  pairs of words within a distance (task 13)\n");
+		fprintf(stderr, "optional flags, before the task:\n");
+		fprintf(stderr, " -j <threads>: threads per dictionary scan and "
+			"index build\n");
+		fprintf(stderr, " -t: a swap of adjacent letters is a single edit\n");
+		fprintf(stderr, " -b <work>: work budget of a correction, per word\n");
+		fprintf(stderr, " -B <work>: work budget of a correction, per run\n");
+		fprintf(stderr, " -m <file>: memo file of corrections kept "
+			"across runs\n");
+		fprintf(stderr, " -o <file>: overlay words (\"word [position]\" "
+			"lines)\n");
+		fprintf(stderr, " -p: documents are raw prose (tasks 3, 4, 7)\n");
+		fprintf(stderr, " -w <workers>: pipelined tasks 3 / 4 (and 11 / 12) "
+			"with that many workers, or threads of a join\n");
+		fprintf(stderr, " -q <blocks>: blocks in flight in the pipeline\n");
+		fprintf(stderr, " -n <shards>: tasks 3 / 4 with the dictionary "
+			"split between that many processes\n");
+		fprintf(stderr, " -g: distance 3 candidates from a trigram index\n");
+		fprintf(stderr, " -f: task 1's arguments are files to compare\n");
+		fprintf(stderr, " -a: task 1 prints a script of the edits too\n");
+		fprintf(stderr, " -s: print allocation statistics to stderr\n");
 		options.invalid = 1; // true
 	
 
 	} else if (options.task == TASK_DIST) {
-		if (argc_remaining == 2) {
+		if (argc_remaining == 2 && options.files) {
+			options.word1 = read_string(argv[2]);
+			options.word2 = read_string(argv[3]);
+			if (!options.word1 || !options.word2) {
+				options.invalid = 1; // true
+			}
+
+		} else if (argc_remaining == 2) {
 			options.word1 = argv[2];
 			options.word2 = argv[3];
 		} else {
@@ -147,9 +365,61 @@ Options get_options(int argc, char **argv) {
 			options.invalid = 1; // true
 		}
 
-	} else if (options.task == TASK_CHECK || options.task == TASK_SPELL) {
+	} else if (options.task == TASK_BULKDIST
+			|| options.task == TASK_BULKEDITS) {
+		if (argc_remaining == 0) {
+			options.docfile = stdin;
+
+		} else if (argc_remaining == 1) {
+			options.docfile = fopen(argv[2], "r");
+			if (!options.docfile) {
+				perror("error opening input file");
+				options.invalid = 1; // true
+			}
+
+		} else {
+			// not the right number of arguments!
+			fprintf(stderr,
+				"argument error: please provide at most one filename argument "
+				"for bulk edit distances or edits (tasks 11 / 12).\n");
+			options.invalid = 1; // true
+		}
+
+	} else if (options.task == TASK_JOIN) {
+		if (argc_remaining == 3) {
+			options.k = atoi(argv[2]);
+			if (options.k < 0) {
+				fprintf(stderr,
+					"argument error: the edit distance of a join must be "
+					"non-negative (task 13).\n");
+				options.invalid = 1; // true
+			}
+
+			options.dicfile = fopen(argv[3], "r");
+			if (!options.dicfile) {
+				perror("error opening first word list file");
+				options.invalid = 1; // true
+			}
+
+			options.joinfile = fopen(argv[4], "r");
+			if (!options.joinfile) {
+				perror("error opening second word list file");
+				options.invalid = 1; // true
+			}
+		} else {
+			// not the right number of arguments!
+			fprintf(stderr,
+				"argument error: please provide the maximum edit distance "
+				"and two word list filenames for a similarity join "
+				"(task 13).\n");
+			options.invalid = 1; // true
+		}
+
+	} else if (options.task == TASK_CHECK || options.task == TASK_SPELL
+			|| options.task == TASK_FIX) {
 		if (argc_remaining == 1) {
-			options.dicfile = fopen(argv[2], "r");
+			options.dicpath = argv[2];
+			options.dicfile = fopen(options.dicpath, "r");
 			if (!options.dicfile) {
 				perror("error opening dictionary file");
 				options.invalid = 1; // true
@@ -158,7 +428,8 @@ Options get_options(int argc, char **argv) {
 			options.docfile = stdin;
 
 		} else if (argc_remaining == 2) {
-			options.dicfile = fopen(argv[2], "r");
+			options.dicpath = argv[2];
+			options.dicfile = fopen(options.dicpath, "r");
 			if (!options.dicfile) {
 				perror("error opening dictionary file");
 				options.invalid = 1; // true
@@ -174,7 +445,143 @@ Options get_options(int argc, char **argv) {
 			// not the right number of arguments!
 			fprintf(stderr,
 				"argument error: please provide one or two filename arguments "
-				"for spell checking or spelling corrections (tasks 3 / 4).\n");
+				"for spell checking or spelling corrections (tasks 3 / 4 / "
+				"10).\n");
+			options.invalid = 1; // true
+		}
+
+		// the pipeline splits its input into lines, not prose words
+		if (options.task != TASK_FIX && options.prose && options.workers > 0) {
+			fprintf(stderr,
+				"argument error: -w can't be used with -p (tasks 3 / 4).\n");
+			options.invalid = 1; // true
+		}
+
+	} else if (options.task == TASK_SUGGEST) {
+		if (argc_remaining == 3 || argc_remaining == 4) {
+			options.k = atoi(argv[2]);
+			options.maxdist = atoi(argv[3]);
+			if (options.k < 1 || options.maxdist < 0) {
+				fprintf(stderr,
+					"argument error: the number of suggestions must be "
+					"positive and the distance non-negative (task 7).\n");
+				options.invalid = 1; // true
+			}
+
+			options.dicpath = argv[4];
+			options.dicfile = fopen(options.dicpath, "r");
+			if (!options.dicfile) {
+				perror("error opening dictionary file");
+				options.invalid = 1; // true
+			}
+
+			options.docfile = stdin;
+			if (argc_remaining == 4) {
+				options.docfile = fopen(argv[5], "r");
+				if (!options.docfile) {
+					perror("error opening document file");
+					options.invalid = 1; // true
+				}
+			}
+		} else {
+			// not the right number of arguments!
+			fprintf(stderr,
+				"argument error: please provide the number of suggestions, "
+				"the maximum edit distance, a dictionary filename and "
+				"optionally a document filename (task 7).\n");
+			options.invalid = 1; // true
+		}
+
+	} else if (options.task == TASK_SERVE) {
+		if (argc_remaining == 2) {
+			options.dicpath = argv[2];
+			options.dicfile = fopen(options.dicpath, "r");
+			if (!options.dicfile) {
+				perror("error opening dictionary file");
+				options.invalid = 1; // true
+			}
+			options.socket = argv[3];
+		} else {
+			// not the right number of arguments!
+			fprintf(stderr,
+				"argument error: please provide a dictionary filename and a "
+				"socket path for the spelling daemon (task 5).\n");
+			options.invalid = 1; // true
+		}
+
+	} else if (options.task == TASK_CLIENT) {
+		if (argc_remaining == 2 || argc_remaining == 3) {
+			if (strtotask(argv[2]) == TASK_CHECK) {
+				options.op = SERVER_OP_CHECK;
+			} else if (strtotask(argv[2]) == TASK_SPELL) {
+				options.op = SERVER_OP_SPELL;
+			} else {
+				fprintf(stderr,
+					"argument error: the daemon client can only run "
+					"\"check\" or \"spell\" (task 6).\n");
+				options.invalid = 1; // true
+			}
+			options.socket = argv[3];
+
+			options.docfile = stdin;
+			if (argc_remaining == 3) {
+				options.docfile = fopen(argv[4], "r");
+				if (!options.docfile) {
+					perror("error opening document file");
+					options.invalid = 1; // true
+				}
+			}
+		} else {
+			// not the right number of arguments!
+			fprintf(stderr,
+				"argument error: please provide \"check\" or \"spell\", a "
+				"socket path and optionally a document filename for the "
+				"daemon client (task 6).\n");
+			options.invalid = 1; // true
+		}
+
+	} else if (options.task == TASK_LIVE) {
+		if (argc_remaining == 2) {
+			if (strtotask(argv[2]) == TASK_CHECK) {
+				options.op = LIVE_OP_CHECK;
+			} else if (strtotask(argv[2]) == TASK_SPELL) {
+				options.op = LIVE_OP_SPELL;
+			} else {
+				fprintf(stderr,
+					"argument error: incremental mode can only run "
+					"\"check\" or \"spell\" (task 8).\n");
+				options.invalid = 1; // true
+			}
+
+			options.dicpath = argv[3];
+			options.dicfile = fopen(options.dicpath, "r");
+			if (!options.dicfile) {
+				perror("error opening dictionary file");
+				options.invalid = 1; // true
+			}
+		} else {
+			// not the right number of arguments!
+			fprintf(stderr,
+				"argument error: please provide \"check\" or \"spell\" "
+				"and a dictionary filename for incremental mode (task 8). "
+				"the document's versions and edits are read from stdin.\n");
+			options.invalid = 1; // true
+		}
+
+	} else if (options.task == TASK_INDEX) {
+		if (argc_remaining == 2) {
+			options.dicpath = argv[2];
+			options.dicfile = fopen(options.dicpath, "r");
+			if (!options.dicfile) {
+				perror("error opening dictionary file");
+				options.invalid = 1; // true
+			}
+			options.output = argv[3];
+		} else {
+			// not the right number of arguments!
+			fprintf(stderr,
+				"argument error: please provide a dictionary filename and "
+				"the base index file to write (task 9).\n");
 			options.invalid = 1; // true
 		}
 	}
@@ -182,6 +589,86 @@ Options get_options(int argc, char **argv) {
 	return options;
 }
 
+// read one flag (and its value) from the front of argv into options
+// returns the number of arguments used, or 0 if the flag is invalid
+int parse_flag(int argc, char **argv, Options *options) {
+	if (strcmp("-j", argv[0]) == 0 && argc >= 2) {
+		options->spell.threads = atoi(argv[1]);
+		if (options->spell.threads < 1) {
+			fprintf(stderr, "argument error: -j needs a positive number "
+				"of threads.\n");
+			return 0;
+		}
+		return 2;
+	}
+	if ((strcmp("-b", argv[0]) == 0 || strcmp("-B", argv[0]) == 0)
+			&& argc >= 2) {
+		long budget = atol(argv[1]);
+		if (budget < 1) {
+			fprintf(stderr, "argument error: %s needs a positive budget.\n",
+				argv[0]);
+			return 0;
+		}
+		if (argv[0][1] == 'b') {
+			options->spell.word_budget = budget;
+		} else {
+			options->spell.doc_budget = budget;
+		}
+		return 2;
+	}
+	if ((strcmp("-w", argv[0]) == 0 || strcmp("-q", argv[0]) == 0
+			|| strcmp("-n", argv[0]) == 0) && argc >= 2) {
+		int n = atoi(argv[1]);
+		if (n < 1) {
+			fprintf(stderr, "argument error: %s needs a positive number.\n",
+				argv[0]);
+			return 0;
+		}
+		if (argv[0][1] == 'w') {
+			options->workers = n;
+		} else if (argv[0][1] == 'n') {
+			options->shards = n;
+		} else {
+			options->depth = n;
+		}
+		return 2;
+	}
+	if (strcmp("-m", argv[0]) == 0 && argc >= 2) {
+		options->spell.memo = argv[1];
+		return 2;
+	}
+	if (strcmp("-o", argv[0]) == 0 && argc >= 2) {
+		spell_overlay = argv[1];
+		return 2;
+	}
+	if (strcmp("-t", argv[0]) == 0) {
+		options->spell.transpositions = 1; // true
+		return 1;
+	}
+	if (strcmp("-s", argv[0]) == 0) {
+		options->stats = 1; // true
+		return 1;
+	}
+	if (strcmp("-p", argv[0]) == 0) {
+		options->prose = 1; // true
+		return 1;
+	}
+	if (strcmp("-g", argv[0]) == 0) {
+		options->spell.trigrams = 1; // true
+		return 1;
+	}
+	if (strcmp("-f", argv[0]) == 0) {
+		options->files = 1; // true
+		return 1;
+	}
+	if (strcmp("-a", argv[0]) == 0) {
+		options->script = 1; // true
+		return 1;
+	}
+	fprintf(stderr, "argument error: unknown flag \"%s\".\n", argv[0]);
+	return 0;
+}
+
 Task strtotask(char *str) {
 	if (strcmp("dist",  str) == 0 || strcmp("1", str) == 0) {
 		return TASK_DIST;
@@ -195,6 +682,33 @@ Task strtotask(char *str) {
 	if (strcmp("spell", str) == 0 || strcmp("4", str) == 0) {
 		return TASK_SPELL;
 	}
+	if (strcmp("serve", str) == 0 || strcmp("5", str) == 0) {
+		return TASK_SERVE;
+	}
+	if (strcmp("client", str) == 0 || strcmp("6", str) == 0) {
+		return TASK_CLIENT;
+	}
+	if (strcmp("suggest", str) == 0 || strcmp("7", str) == 0) {
+		return TASK_SUGGEST;
+	}
+	if (strcmp("live", str) == 0 || strcmp("8", str) == 0) {
+		return TASK_LIVE;
+	}
+	if (strcmp("index", str) == 0 || strcmp("9", str) == 0) {
+		return TASK_INDEX;
+	}
+	if (strcmp("fix", str) == 0 || strcmp("10", str) == 0) {
+		return TASK_FIX;
+	}
+	if (strcmp("bulkdist", str) == 0 || strcmp("11", str) == 0) {
+		return TASK_BULKDIST;
+	}
+	if (strcmp("bulkedits", str) == 0 || strcmp("12", str) == 0) {
+		return TASK_BULKEDITS;
+	}
+	if (strcmp("join", str) == 0 || strcmp("13", str) == 0) {
+		return TASK_JOIN;
+	}
 	return TASK_NONE;
 }
 
@@ -205,6 +719,16 @@ Task strtotask(char *str) {
 
 int is_valid_word(char *word, int len);
 
+// the words of the dictionary file. a base index file (task 9) is mapped
+// by the tasks themselves instead: its list is empty
+List *read_dictionary(Options *options) {
+	if (spell_is_base_file(options->dicpath)) {
+		spell_base = options->dicpath;
+		return new_list();
+	}
+	return read_word_list(options->dicfile);
+}
+
 List *read_word_list(FILE *file) {
 	List *list = new_list();
 
@@ -249,6 +773,76 @@ List *read_word_list(FILE *file) {
 	return list;
 }
 
+// the words of the document file: a word per line, or every word of raw
+// prose (folded to lowercase) with -p. words with letters other than ASCII
+// ones are left out, as they can't be looked up (Task 10 leaves them be)
+List *read_document(Options *options) {
+	if (!options->prose) {
+		return read_word_list(options->docfile);
+	}
+
+	size_t len, pos = 0, ntokens, i;
+	char *text = read_text(options->docfile, &len);
+	Token tokens[TOKEN_BATCH];
+	List *list = new_list();
+
+	fold_ascii(text, len, text);
+	while ((ntokens = next_tokens(text, len, &pos, tokens,
+			TOKEN_BATCH)) > 0) {
+		for (i = 0; i < ntokens; i++) {
+			if (!tokens[i].ascii) {
+				continue;
+			}
+			char *word = malloc(tokens[i].len + 1);
+			assert(word);
+			memcpy(word, text + tokens[i].offset, tokens[i].len);
+			word[tokens[i].len] = '\0';
+			list_add_end(list, word);
+		}
+	}
+	free(text);
+	return list;
+}
+
+// the whole of 'file', in one buffer of '*len' bytes
+char *read_text(FILE *file, size_t *len) {
+	size_t size = 1 << 16, nread;
+	char *text = malloc(size);
+	assert(text);
+
+	*len = 0;
+	while ((nread = fread(text + *len, 1, size - *len, file)) > 0) {
+		*len += nread;
+		if (*len == size) {
+			size *= 2;
+			text = realloc(text, size);
+			assert(text);
+		}
+	}
+	return text;
+}
+
+// the whole of the file at 'path' as a string, without a final newline,
+// or NULL (with a message) if it can't be opened
+char *read_string(char *path) {
+	FILE *file = fopen(path, "r");
+	size_t len;
+
+	if (!file) {
+		perror("error opening input file");
+		return NULL;
+	}
+	char *text = read_text(file, &len);
+	fclose(file);
+
+	// read_text() always leaves room for one more byte
+	if (len > 0 && text[len-1] == '\n') {
+		len--;
+	}
+	text[len] = '\0';
+	return text;
+}
+
 int is_valid_word(char *word, int len) {
 	for (int i = 0; i < len; i++) {
 		if (word[i] < 'a' || word[i] > 'z') {
@@ -0,0 +1,352 @@
+/* * * * * * *
+ * Module for a correction memo kept on disk and shared across runs
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#define _DEFAULT_SOURCE	// for flock()
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "memo.h"
+#include "hashtbl.h"
+#include "pool.h"
+
+#define MEMO_MAGIC  "a2memo1\n"	// first bytes of every memo file
+#define MAGIC_LEN   8
+#define INIT_SIZE   64			// starting room for records found or added
+#define WORDS_CHUNK (16 << 10)	// bytes per arena chunk of added words
+
+#define FNV_PRIME 0x100000001b3ull
+
+// every record starts with this head, followed by the word and then the
+// correction, each '\0'-terminated. heads are copied out of the file, so
+// records need no alignment
+typedef struct {
+	uint32_t size;		// bytes in the whole record
+	uint32_t checksum;	// of every byte after this field
+	uint64_t key;
+	int32_t rank;
+	int32_t dist;
+	uint16_t word_len;
+	uint16_t corr_len;
+} RecordHead;
+
+#define CHECKED_FROM (2 * sizeof(uint32_t))	// first byte under the checksum
+
+typedef struct {
+	int rank;
+	int dist;
+} MemoEntry;
+
+struct memo {
+	int fd;
+	uint64_t key;
+
+	// the file as it was when opened
+	char *map;
+	size_t map_len;
+	size_t valid_end;	// end of its last good record
+
+	// words with our key, each mapped to its entry. words from the file
+	// point into the map, words added since into the arena
+	HashTable *table;
+	MemoEntry *entries;
+	int nentries;
+	int size;
+	Arena *words;
+
+	// records waiting to be appended
+	char *pending;
+	size_t npending;
+	size_t pending_size;
+
+	pthread_mutex_t lock;	// held by every call, as lookups move entries
+};
+
+/*----------------------------------------------------------------------*/
+/* HELPER FUNCTION PROTOTYPES */
+uint32_t record_checksum(const char *record, size_t size);
+size_t record_size(const char *data, size_t avail);
+size_t scan_records(Memo *memo, const char *data, size_t from, size_t to);
+void add_entry(Memo *memo, char *word, int rank, int dist);
+bool append_all(int fd, const char *data, size_t n);
+
+/*----------------------------------------------------------------------*/
+/* RECORDS */
+
+uint64_t memo_hash(uint64_t hash, const void *data, size_t len) {
+	const unsigned char *bytes = data;
+	size_t i;
+	for (i = 0; i < len; i++) {
+		hash = (hash ^ bytes[i]) * FNV_PRIME;
+	}
+	return hash;
+}
+
+uint32_t record_checksum(const char *record, size_t size) {
+	uint64_t hash = memo_hash(MEMO_HASH_INIT, record + CHECKED_FROM,
+		size - CHECKED_FROM);
+	return (uint32_t)(hash ^ (hash >> 32));
+}
+
+// the size of the record at the front of the 'avail' bytes at 'data', or
+// 0 if there isn't a whole, intact one there
+size_t record_size(const char *data, size_t avail) {
+	RecordHead head;
+	if (avail < sizeof head) {
+		return 0;
+	}
+	memcpy(&head, data, sizeof head);
+	if (head.size != sizeof head + head.word_len + 1 + head.corr_len + 1
+			|| head.size > avail
+			|| record_checksum(data, head.size) != head.checksum
+			|| data[sizeof head + head.word_len] != '\0'
+			|| data[head.size - 1] != '\0') {
+		return 0;
+	}
+	return head.size;
+}
+
+/* Walks the records between offsets 'from' and 'to' of 'data', adding
+ * those with the memo's key to it (if 'memo' is not NULL)
+ * returns the offset just past the last intact record
+ */
+size_t scan_records(Memo *memo, const char *data, size_t from, size_t to) {
+	size_t size;
+	while ((size = record_size(data + from, to - from)) > 0) {
+		RecordHead head;
+		memcpy(&head, data + from, sizeof head);
+		char *word = (char *)data + from + sizeof head;
+		// the first record of a word wins, as for dictionary ranks
+		if (memo && head.key == memo->key
+				&& !hash_table_has(memo->table, word)) {
+			add_entry(memo, word, head.rank, head.dist);
+		}
+		from += size;
+	}
+	return from;
+}
+
+/*----------------------------------------------------------------------*/
+/* MEMO OPENING/CLOSING */
+
+Memo *open_memo(const char *path, uint64_t key) {
+	int fd = open(path, O_RDWR | O_CREAT | O_APPEND, 0644);
+	if (fd < 0) {
+		perror("error opening memo file");
+		return NULL;
+	}
+
+	// a shared lock keeps writers from cutting off a torn tail while it
+	// is being read
+	struct stat st;
+	flock(fd, LOCK_SH);
+	if (fstat(fd, &st) != 0) {
+		perror("error reading memo file");
+		close(fd);
+		return NULL;
+	}
+
+	Memo *memo = malloc(sizeof *memo);
+	assert(memo);
+	memo->fd = fd;
+	memo->key = key;
+	memo->map = NULL;
+	memo->map_len = st.st_size;
+	memo->valid_end = MAGIC_LEN;
+	memo->table = new_hash_table_shared_keys(INIT_SIZE);
+	memo->entries = malloc(INIT_SIZE * sizeof *memo->entries);
+	assert(memo->entries);
+	memo->nentries = 0;
+	memo->size = INIT_SIZE;
+	memo->words = new_arena(WORDS_CHUNK, "memo words");
+	pthread_mutex_init(&memo->lock, NULL);
+	memo->pending = NULL;
+	memo->npending = memo->pending_size = 0;
+
+	// a file without its whole header is new (or was torn while being
+	// created): the first flush writes the header
+	if (memo->map_len >= MAGIC_LEN) {
+		memo->map = mmap(NULL, memo->map_len, PROT_READ, MAP_SHARED, fd, 0);
+		if (memo->map == MAP_FAILED) {
+			perror("error mapping memo file");
+			memo->map = NULL;
+			flock(fd, LOCK_UN);
+			close_memo(memo);
+			return NULL;
+		}
+		if (memcmp(memo->map, MEMO_MAGIC, MAGIC_LEN) != 0) {
+			fprintf(stderr, "error: \"%s\" is not a memo file\n", path);
+			flock(fd, LOCK_UN);
+			close_memo(memo);
+			return NULL;
+		}
+		memo->valid_end = scan_records(memo, memo->map, MAGIC_LEN,
+			memo->map_len);
+	}
+	flock(fd, LOCK_UN);
+	return memo;
+}
+
+void close_memo(Memo *memo) {
+	assert(memo != NULL);
+	memo_flush(memo);
+	if (memo->map) {
+		munmap(memo->map, memo->map_len);
+	}
+	close(memo->fd);
+	free_hash_table(memo->table);
+	free(memo->entries);
+	free_arena(memo->words);
+	free(memo->pending);
+	pthread_mutex_destroy(&memo->lock);
+	free(memo);
+}
+
+/*----------------------------------------------------------------------*/
+/* FINDING AND ADDING CORRECTIONS */
+
+void add_entry(Memo *memo, char *word, int rank, int dist) {
+	if (memo->nentries == memo->size) {
+		memo->size *= 2;
+		memo->entries = realloc(memo->entries,
+			memo->size * sizeof *memo->entries);
+		assert(memo->entries);
+	}
+	memo->entries[memo->nentries].rank = rank;
+	memo->entries[memo->nentries].dist = dist;
+	hash_table_put(memo->table, word, memo->nentries++);
+}
+
+bool memo_find(Memo *memo, char *word, int *rank, int *dist) {
+	bool found = false;
+	pthread_mutex_lock(&memo->lock);
+	if (hash_table_has(memo->table, word)) {
+		MemoEntry *entry =
+			&memo->entries[hash_table_get_val(memo->table, word)];
+		*rank = entry->rank;
+		*dist = entry->dist;
+		found = true;
+	}
+	pthread_mutex_unlock(&memo->lock);
+	return found;
+}
+
+void memo_add(Memo *memo, const char *word, int rank, int dist,
+		const char *correction) {
+	RecordHead head;
+	size_t word_len = strlen(word), corr_len = strlen(correction);
+	pthread_mutex_lock(&memo->lock);
+	if (word_len > UINT16_MAX || corr_len > UINT16_MAX
+			|| hash_table_has(memo->table, (char *)word)) {
+		pthread_mutex_unlock(&memo->lock);
+		return;
+	}
+
+	char *copy = arena_alloc(memo->words, word_len + 1);
+	memcpy(copy, word, word_len + 1);
+	add_entry(memo, copy, rank, dist);
+
+	// zeroed first, so that the padding of the head is checksummed too
+	memset(&head, 0, sizeof head);
+	head.size = sizeof head + word_len + 1 + corr_len + 1;
+	head.key = memo->key;
+	head.rank = rank;
+	head.dist = dist;
+	head.word_len = word_len;
+	head.corr_len = corr_len;
+
+	while (memo->npending + head.size > memo->pending_size) {
+		memo->pending_size = memo->pending_size ? 2 * memo->pending_size
+			: 4096;
+		memo->pending = realloc(memo->pending, memo->pending_size);
+		assert(memo->pending);
+	}
+	char *record = memo->pending + memo->npending;
+	memcpy(record + sizeof head, word, word_len + 1);
+	memcpy(record + sizeof head + word_len + 1, correction, corr_len + 1);
+	memcpy(record, &head, sizeof head);
+	head.checksum = record_checksum(record, head.size);
+	memcpy(record, &head, sizeof head);
+	memo->npending += head.size;
+	pthread_mutex_unlock(&memo->lock);
+}
+
+/*----------------------------------------------------------------------*/
+/* WRITING OUT */
+
+bool append_all(int fd, const char *data, size_t n) {
+	while (n > 0) {
+		ssize_t w = write(fd, data, n);
+		if (w < 0 && errno == EINTR) {
+			continue;
+		}
+		if (w <= 0) {
+			return false;
+		}
+		data += w;
+		n -= w;
+	}
+	return true;
+}
+
+bool memo_flush(Memo *memo) {
+	struct stat st;
+	bool ok = true;
+	size_t end = 0;		// where the records will go
+
+	pthread_mutex_lock(&memo->lock);
+	if (memo->npending == 0) {
+		pthread_mutex_unlock(&memo->lock);
+		return true;
+	}
+
+	flock(memo->fd, LOCK_EX);
+	if (fstat(memo->fd, &st) != 0) {
+		ok = false;
+	} else if ((size_t)st.st_size < MAGIC_LEN) {
+		end = MAGIC_LEN;
+		ok = ftruncate(memo->fd, 0) == 0
+			&& append_all(memo->fd, MEMO_MAGIC, MAGIC_LEN);
+	} else if ((size_t)st.st_size <= memo->valid_end) {
+		end = st.st_size;
+	} else {
+		// other runs may have appended since the file was opened. find
+		// the end of their last intact record, and cut off anything torn
+		// after it, or the records appended now would never be read
+		size_t len = st.st_size, from = memo->valid_end;
+		char *map = mmap(NULL, len, PROT_READ, MAP_SHARED, memo->fd, 0);
+		if (map == MAP_FAILED) {
+			ok = false;
+		} else {
+			end = scan_records(NULL, map, from, len);
+			munmap(map, len);
+			ok = end == len || ftruncate(memo->fd, end) == 0;
+		}
+	}
+
+	// one write per flush, made durable before the lock is let go
+	ok = ok && append_all(memo->fd, memo->pending, memo->npending)
+		&& fdatasync(memo->fd) == 0;
+	flock(memo->fd, LOCK_UN);
+
+	if (ok) {
+		memo->valid_end = end + memo->npending;
+	} else {
+		perror("error writing memo file");
+	}
+	memo->npending = 0;
+	pthread_mutex_unlock(&memo->lock);
+	return ok;
+}
@@ -0,0 +1,57 @@
+/* * * * * * *
+ * Module for a correction memo kept on disk and shared across runs: for
+ * each misspelled word, the correction an earlier run found for it (or the
+ * fact that it has none), so that a cold start inherits the expensive
+ * distance 2 and 3 searches instead of repeating them
+ *
+ * the file is a magic header followed by records that are only ever
+ * appended, each with its own checksum. it is mapped read-only when opened
+ * and never written in place, so any number of runs can read it at once.
+ * writers take an exclusive lock to append, and a record torn by a crash
+ * fails its checksum: it is ignored, and cut off by the next writer
+ *
+ * records carry a key (a hash of the dictionary, and of the settings that
+ * change corrections): a memo only sees the records with its own key
+ *
+ * a memo can be used by several threads at once
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#ifndef MEMO_H
+#define MEMO_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MEMO_HASH_INIT 0xcbf29ce484222325ull	// memo_hash() of nothing
+
+typedef struct memo Memo;
+
+// extend the 64-bit FNV-1a hash 'hash' with the 'len' bytes at 'data'
+uint64_t memo_hash(uint64_t hash, const void *data, size_t len);
+
+// open the memo file at 'path' (creating it if there is none), and map the
+// records with key 'key'. returns NULL, with a message on stderr, if the
+// file can't be opened or isn't a memo file
+Memo *open_memo(const char *path, uint64_t key);
+
+// write out the records added since the last flush, then close the file
+void close_memo(Memo *memo);
+
+// look up the misspelled word 'word': returns whether it is in the memo,
+// and if so 'rank' and 'dist' receive its correction's rank and edit
+// distance (both -1 if it has none)
+bool memo_find(Memo *memo, char *word, int *rank, int *dist);
+
+// remember that 'word' corrects to 'correction' ("" for none), with rank
+// 'rank' and distance 'dist'. it is written out by the next flush
+void memo_add(Memo *memo, const char *word, int rank, int dist,
+	const char *correction);
+
+// append the records added since the last flush to the file. returns
+// false, with a message on stderr, if they could not be written
+bool memo_flush(Memo *memo);
+
+#endif
@@ -0,0 +1,237 @@
+/* * * * * * *
+ * Module for packed short words, and a key-only table of them (which can
+ * be written out as an image, and used read-only from it)
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "packed.h"
+
+#define MIN_BITS 4	// smallest table: 16 slots
+#define PUT_AHEAD 16	// words of a batched put with their slots in flight
+
+// hint that 'addr' will be read soon, if the compiler supports it
+#ifdef __GNUC__
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
+
+/*----------------------------------------------------------------------*/
+/* PACKING AND UNPACKING */
+
+bool pack_word(const char *word, size_t len, PackedWord *packed) {
+	PackedWord w = 0;
+	size_t i;
+
+	if (len == 0 || len > PACKED_MAX_LEN) {
+		return false;
+	}
+	for (i = 0; i < len; i++) {
+		if (word[i] < 'a' || word[i] > 'z') {
+			return false;
+		}
+		w |= (PackedWord)(word[i] - 'a' + 1) << (PACKED_BITS * i);
+	}
+	*packed = w;
+	return true;
+}
+
+int packed_len(PackedWord w) {
+	int len = 0;
+	while (w) {
+		w >>= PACKED_BITS;
+		len++;
+	}
+	return len;
+}
+
+void unpack_word(PackedWord w, char *out) {
+	while (w) {
+		*out++ = 'a' + (w & PACKED_MASK) - 1;
+		w >>= PACKED_BITS;
+	}
+	*out = '\0';
+}
+
+/*----------------------------------------------------------------------*/
+/* TABLE CREATION/DELETION */
+
+// open addressing with linear probing. 0 is never a packed word, so it
+// marks an empty slot
+struct packed_table {
+	PackedWord *keys;
+	uint32_t *ranks;
+	int bits;			// the table has 2^bits slots
+	uint32_t count;		// kept at most half the slots
+	bool mapped;		// the slots belong to an image
+};
+
+// the head of a table image. the keys and then the ranks follow
+typedef struct {
+	uint32_t bits;
+	uint32_t count;
+} ImageHead;
+
+/*----------------------------------------------------------------------*/
+/* HELPER FUNCTION PROTOTYPES */
+void init_slots(PackedTable *table, int bits);
+uint32_t find_slot(PackedTable *table, PackedWord word);
+void grow_packed_table(PackedTable *table);
+
+void init_slots(PackedTable *table, int bits) {
+	table->bits = bits;
+	table->keys = calloc((size_t)1 << bits, sizeof(PackedWord));
+	table->ranks = malloc(sizeof(uint32_t) << bits);
+	assert(table->keys && table->ranks);
+}
+
+PackedTable *new_packed_table(int nwords) {
+	PackedTable *table = malloc(sizeof *table);
+	assert(table);
+
+	int bits = MIN_BITS;
+	while (((int64_t)1 << bits) < 2 * (int64_t)nwords) {
+		bits++;
+	}
+	init_slots(table, bits);
+	table->count = 0;
+	table->mapped = false;
+	return table;
+}
+
+void free_packed_table(PackedTable *table) {
+	assert(table != NULL);
+	if (!table->mapped) {
+		free(table->keys);
+		free(table->ranks);
+	}
+	free(table);
+}
+
+/*----------------------------------------------------------------------*/
+/* ADDING AND FINDING WORDS */
+
+// the slot holding 'word', or the empty slot where it would go
+uint32_t find_slot(PackedTable *table, PackedWord word) {
+	uint32_t mask = ((uint32_t)1 << table->bits) - 1;
+	uint32_t slot = PACKED_HASH(word, table->bits);
+	while (table->keys[slot] && table->keys[slot] != word) {
+		slot = (slot + 1) & mask;
+	}
+	return slot;
+}
+
+// double the number of slots, and re-place every word
+void grow_packed_table(PackedTable *table) {
+	PackedWord *keys = table->keys;
+	uint32_t *ranks = table->ranks;
+	uint32_t i, nslots = (uint32_t)1 << table->bits;
+
+	init_slots(table, table->bits + 1);
+	for (i = 0; i < nslots; i++) {
+		if (keys[i]) {
+			uint32_t slot = find_slot(table, keys[i]);
+			table->keys[slot] = keys[i];
+			table->ranks[slot] = ranks[i];
+		}
+	}
+	free(keys);
+	free(ranks);
+}
+
+bool packed_table_put(PackedTable *table, PackedWord word, uint32_t rank) {
+	assert(word != 0 && !table->mapped);
+	uint32_t slot = find_slot(table, word);
+	if (table->keys[slot]) {
+		return false;
+	}
+	table->keys[slot] = word;
+	table->ranks[slot] = rank;
+	if (2 * ++table->count > (uint32_t)1 << table->bits) {
+		grow_packed_table(table);
+	}
+	return true;
+}
+
+void packed_table_put_batch(PackedTable *table, const PackedWord *words,
+		const uint32_t *ranks, int n) {
+	int i;
+	for (i = 0; i < n && i < PUT_AHEAD; i++) {
+		PREFETCH(&table->keys[PACKED_HASH(words[i], table->bits)]);
+	}
+	for (i = 0; i < n; i++) {
+		if (i + PUT_AHEAD < n) {
+			uint32_t ahead = PACKED_HASH(words[i + PUT_AHEAD], table->bits);
+			PREFETCH(&table->keys[ahead]);
+			PREFETCH(&table->ranks[ahead]);
+		}
+		packed_table_put(table, words[i], ranks[i]);
+	}
+}
+
+uint32_t packed_table_get(PackedTable *table, PackedWord word) {
+	uint32_t slot = find_slot(table, word);
+	return table->keys[slot] ? table->ranks[slot] : PACKED_NONE;
+}
+
+void packed_table_get_batch(PackedTable *table, PackedWord *words, int n,
+		uint32_t *ranks) {
+	int i;
+	// fetch every home slot first, so the misses overlap. 'ranks' holds
+	// the slots in the meantime
+	for (i = 0; i < n; i++) {
+		ranks[i] = PACKED_HASH(words[i], table->bits);
+		PREFETCH(&table->keys[ranks[i]]);
+	}
+	for (i = 0; i < n; i++) {
+		PREFETCH(&table->ranks[ranks[i]]);
+	}
+	for (i = 0; i < n; i++) {
+		ranks[i] = packed_table_get(table, words[i]);
+	}
+}
+
+/*----------------------------------------------------------------------*/
+/* IMAGES */
+
+bool packed_table_write(PackedTable *table, FILE *file) {
+	ImageHead head = { table->bits, table->count };
+	size_t nslots = (size_t)1 << table->bits;
+	size_t npad = nslots % 2 * sizeof(uint32_t);	// ranks to 8 bytes
+	static const char zeroes[8];
+	return fwrite(&head, sizeof head, 1, file) == 1
+		&& fwrite(table->keys, sizeof(PackedWord), nslots, file) == nslots
+		&& fwrite(table->ranks, sizeof(uint32_t), nslots, file) == nslots
+		&& fwrite(zeroes, 1, npad, file) == npad;
+}
+
+PackedTable *packed_table_map(const char *data, size_t len) {
+	ImageHead head;
+	if (len < sizeof head) {
+		return NULL;
+	}
+	memcpy(&head, data, sizeof head);
+	if (head.bits < MIN_BITS || head.bits >= 32) {
+		return NULL;
+	}
+	size_t nslots = (size_t)1 << head.bits;
+	if (sizeof head + nslots * (sizeof(PackedWord) + sizeof(uint32_t)) > len) {
+		return NULL;
+	}
+
+	PackedTable *table = malloc(sizeof *table);
+	assert(table);
+	table->bits = head.bits;
+	table->count = head.count;
+	table->keys = (PackedWord *)(data + sizeof head);
+	table->ranks = (uint32_t *)(data + sizeof head
+		+ nslots * sizeof(PackedWord));
+	table->mapped = true;
+	return table;
+}
@@ -0,0 +1,97 @@
+/* * * * * * *
+ * Module for packed short words: a word of up to PACKED_MAX_LEN lowercase
+ * letters fits in one 64-bit integer at 5 bits per letter ('a' is 1, 'z'
+ * is 26, and 0 marks the end), first letter in the lowest bits. packed
+ * words are compared with a single instruction, edited with a few bit
+ * operations, and kept in a key-only table with no pointers to chase
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#ifndef PACKED_H
+#define PACKED_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define PACKED_MAX_LEN 12
+#define PACKED_NONE    UINT32_MAX	// rank returned for an unknown word
+
+typedef uint64_t PackedWord;
+
+#define PACKED_BITS 5
+#define PACKED_MASK ((PackedWord)31)
+
+// the letter code (1-26, or 0 past the end) at position 'i' of 'w'
+#define PACKED_LETTER(W, I) (((W) >> (PACKED_BITS * (I))) & PACKED_MASK)
+
+// the letters of 'w' before position 'i', and from position 'i' on
+#define PACKED_BELOW(W, I) \
+	((W) & ((((PackedWord)1) << (PACKED_BITS * (I))) - 1))
+#define PACKED_FROM(W, I) ((W) >> (PACKED_BITS * (I)))
+
+// 'w' with letter 'i' replaced by, or letter 'c' inserted before position
+// 'i', or letter 'i' deleted
+#define PACKED_SUBSTITUTE(W, I, C) \
+	(((W) & ~(PACKED_MASK << (PACKED_BITS * (I)))) \
+	| ((PackedWord)(C) << (PACKED_BITS * (I))))
+#define PACKED_INSERT(W, I, C) (PACKED_BELOW(W, I) \
+	| ((PackedWord)(C) << (PACKED_BITS * (I))) \
+	| (PACKED_FROM(W, I) << (PACKED_BITS * ((I) + 1))))
+#define PACKED_DELETE(W, I) (PACKED_BELOW(W, I) \
+	| (PACKED_FROM(W, (I) + 1) << (PACKED_BITS * (I))))
+
+// pack the 'len' bytes at 'word' into 'packed'. returns false (leaving
+// 'packed' alone) if the word is empty, too long, or not all lowercase
+bool pack_word(const char *word, size_t len, PackedWord *packed);
+
+// the number of letters in 'w'
+int packed_len(PackedWord w);
+
+// write 'w' out as a '\0'-terminated string (room for PACKED_MAX_LEN+1)
+void unpack_word(PackedWord w, char *out);
+
+// spread the bits of a packed word over a table of 2^bits slots
+#define PACKED_HASH(W, BITS) \
+	((uint32_t)(((W) * 0x9E3779B97F4A7C15ull) >> (64 - (BITS))))
+
+
+/* * *
+ * KEY-ONLY TABLE OF PACKED WORDS
+ */
+
+typedef struct packed_table PackedTable;
+
+// create an empty table, with room for around 'nwords' words
+PackedTable *new_packed_table(int nwords);
+void free_packed_table(PackedTable *table);
+
+// add 'word' with rank 'rank'. a word already in the table keeps its rank
+// returns whether the word was new
+bool packed_table_put(PackedTable *table, PackedWord word, uint32_t rank);
+
+// packed_table_put() 'n' words in order (ranks[i] for words[i]), fetching
+// the slots of the words ahead while each one is put
+void packed_table_put_batch(PackedTable *table, const PackedWord *words,
+	const uint32_t *ranks, int n);
+
+// the rank of 'word', or PACKED_NONE
+uint32_t packed_table_get(PackedTable *table, PackedWord word);
+
+// the ranks of 'n' words at once (ranks[i] for words[i]), overlapping their
+// memory accesses
+void packed_table_get_batch(PackedTable *table, PackedWord *words, int n,
+	uint32_t *ranks);
+
+// write the table to 'file' as an image (host byte order, a multiple of 8
+// bytes long). returns false on a write error
+bool packed_table_write(PackedTable *table, FILE *file);
+
+// a read-only table over the image of 'len' bytes at 'data' (8-byte
+// aligned), as written by packed_table_write(). the image must stay in
+// place until the table is freed. returns NULL if it is malformed
+PackedTable *packed_table_map(const char *data, size_t len);
+
+#endif
@@ -0,0 +1,763 @@
+/* * * * * * *
+ * Module for pipelined Task 3/4 and bulk Task 1/2: reader, workers and
+ * writer
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/uio.h>
+
+#include "pipeline.h"
+#include "libspell.h"
+
+#define BATCH_SIZE 1024	// words of a block handed to the library at a time
+#define MAX_PIECE  255	// bytes of a line read_word_list() reads at a time
+#define MAX_IOV    64	// blocks written out by a single writev()
+
+#define MIN(X,Y) (((X)<(Y))? (X):(Y)) // finds the minimum value between X and Y
+
+// what a note on a line of a block says
+#define NOTE_INVALID  'i'	// the line isn't a word
+#define NOTE_DEGRADED 'd'	// the word ran out of budget
+#define NOTE_PAIR     'p'	// the line isn't a pair of words
+
+// a line of a block to report on stderr, once the block is written out
+typedef struct {
+	const char *text;	// in the block's input
+	int len;
+	int line;			// of the block, counting from 1
+	char kind;			// NOTE_...
+} Note;
+
+// a block of the document, and its output
+typedef struct {
+	// the input: whole lines (the last block may end without a newline)
+	char *text;
+	size_t len;
+	size_t size;
+
+	// the output, and what to report on stderr
+	char *out;
+	size_t nout;
+	size_t out_size;
+	Note *notes;
+	int nnotes;
+	int notes_size;
+
+	int nlines;		// lines of the block, up to the end of the document
+	bool ends;		// a blank line ends the document in this block
+	long words;
+	long degraded;
+	bool done;		// a worker has finished with the block
+} Block;
+
+// the state the threads share. block number i (counting from 0 since the
+// start of the document) goes through blocks[i % depth]
+typedef struct {
+	char op;
+	bool transpositions;
+	int in;
+	Block *blocks;
+	int depth;
+
+	pthread_mutex_t lock;
+	pthread_cond_t read;	// a block was read, or the input ended
+	pthread_cond_t done;	// a worker finished a block
+	pthread_cond_t written;	// the writer finished with a block
+	long nread;			// blocks read so far
+	long ntaken;		// blocks taken by workers so far
+	long nwritten;		// blocks written out so far
+	bool eof;			// the reader has read its last block
+	bool stop;			// the writer has stopped: every thread quits
+	int error;			// errno of a failed read, or 0
+
+	// the start of a line left over at the end of the last block read
+	char *carry;
+	size_t ncarry;
+	size_t carry_size;
+} Pipeline;
+
+// a worker, the index (or view) it works on, and its own scratch space
+typedef struct {
+	Pipeline *pipeline;
+	SpellIndex *index;
+	pthread_t thread;
+	int *rows;			// rows of a distance table
+	size_t nrows;
+} Worker;
+
+/*----------------------------------------------------------------------*/
+/* HELPER FUNCTION PROTOTYPES */
+void reserve(char **buffer, size_t *size, size_t n);
+int fill_block(Pipeline *pipeline, Block *block, bool *eof);
+void *pipe_reader(void *arg);
+size_t piece_len(const char *at, const char *end);
+bool all_lowercase(const char *word, size_t len);
+void put_output(Block *block, const char *data, size_t n);
+void put_number(Block *block, int number);
+void add_note(Block *block, const char *text, int len, int line, char kind);
+void correct_words(char op, SpellIndex *index, Block *block,
+	const SpellWord *words, const int *lines, int n);
+void scan_words(char op, SpellIndex *index, Block *block);
+size_t next_line(const char *at, const char *end, size_t *len);
+int line_distance(const char *a, size_t n, const char *b, size_t m,
+	bool transpose, int *rows);
+void scan_pairs(Worker *worker, Block *block);
+void put_edits(Block *block, const char *word, size_t n, bool transpose);
+void scan_edits(Worker *worker, Block *block);
+void *pipe_worker(void *arg);
+bool writev_all(int fd, struct iovec *iov, int n);
+void print_notes(const Block *block, long first_line);
+int write_blocks(Pipeline *pipeline, int out, PipelineStats *stats);
+
+/*----------------------------------------------------------------------*/
+/* READER */
+
+// make room for 'n' bytes in '*buffer', of '*size' bytes
+void reserve(char **buffer, size_t *size, size_t n) {
+	if (n <= *size) {
+		return;
+	}
+	while (*size < n) {
+		*size = *size ? 2 * *size : 4096;
+	}
+	*buffer = realloc(*buffer, *size);
+	assert(*buffer);
+}
+
+/* Reads the document into 'block' (after what it holds already) until it
+ * holds the end of a line and either a block's worth of bytes or all the
+ * input there is for now (a pipe or terminal may have more later), or the
+ * input ends. the block is cut after its last newline, and the rest
+ * carried over. returns 0, or the errno of a failed read
+ */
+int fill_block(Pipeline *pipeline, Block *block, bool *eof) {
+	size_t cut = 0;		// just past the last newline read
+	bool drained = false;
+	ssize_t n;
+	int err = 0;
+
+	while (!*eof
+			&& (cut == 0 || (block->len < PIPELINE_BLOCK && !drained))) {
+		reserve(&block->text, &block->size, block->len + PIPELINE_BLOCK);
+		size_t want = block->size - block->len;
+
+		// the reader can only be cancelled while it waits for input
+		pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+		n = read(pipeline->in, block->text + block->len, want);
+		pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			err = n < 0 ? errno : 0;
+			*eof = true;
+			break;
+		}
+		size_t i;
+		for (i = block->len + n; i > block->len; i--) {
+			if (block->text[i-1] == '\n') {
+				cut = i;
+				break;
+			}
+		}
+		block->len += n;
+		drained = (size_t)n < want;
+	}
+
+	// the last block takes everything that is left
+	if (*eof) {
+		cut = block->len;
+	}
+	pipeline->ncarry = block->len - cut;
+	reserve(&pipeline->carry, &pipeline->carry_size, pipeline->ncarry);
+	if (pipeline->ncarry) {
+		// (the carry stays NULL until a block ends mid-line)
+		memcpy(pipeline->carry, block->text + cut, pipeline->ncarry);
+	}
+	block->len = cut;
+	return err;
+}
+
+void *pipe_reader(void *arg) {
+	Pipeline *pipeline = arg;
+	bool eof = false, stop = false;
+
+	pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+	while (!eof) {
+		// wait for a free block
+		pthread_mutex_lock(&pipeline->lock);
+		while (pipeline->nread - pipeline->nwritten == pipeline->depth
+				&& !pipeline->stop) {
+			pthread_cond_wait(&pipeline->written, &pipeline->lock);
+		}
+		stop = pipeline->stop;
+		pthread_mutex_unlock(&pipeline->lock);
+		if (stop) {
+			break;
+		}
+
+		// the line left unfinished by the last block starts this one
+		Block *block = &pipeline->blocks[pipeline->nread % pipeline->depth];
+		reserve(&block->text, &block->size, pipeline->ncarry);
+		if (pipeline->ncarry) {
+			memcpy(block->text, pipeline->carry, pipeline->ncarry);
+		}
+		block->len = pipeline->ncarry;
+		int err = fill_block(pipeline, block, &eof);
+
+		pthread_mutex_lock(&pipeline->lock);
+		pipeline->nread++;
+		pipeline->eof = eof;
+		pipeline->error = err;
+		pthread_cond_broadcast(&pipeline->read);
+		pthread_mutex_unlock(&pipeline->lock);
+	}
+	return NULL;
+}
+
+/*----------------------------------------------------------------------*/
+/* WORKERS: TASK 3 / TASK 4 */
+
+// the length of the piece of a line at 'at' that fgets() reads in
+// read_word_list(): up to and including its newline, but no more than
+// MAX_PIECE bytes. each piece counts as a line of its own there
+size_t piece_len(const char *at, const char *end) {
+	size_t max = end - at < MAX_PIECE ? end - at : MAX_PIECE;
+	const char *newline = memchr(at, '\n', max);
+	return newline ? newline - at + 1 : max;
+}
+
+bool all_lowercase(const char *word, size_t len) {
+	size_t i;
+	for (i = 0; i < len; i++) {
+		if (word[i] < 'a' || word[i] > 'z') {
+			return false;
+		}
+	}
+	return true;
+}
+
+void put_output(Block *block, const char *data, size_t n) {
+	reserve(&block->out, &block->out_size, block->nout + n);
+	memcpy(block->out + block->nout, data, n);
+	block->nout += n;
+}
+
+// add 'number' and a newline to the output, as printf("%d\n") would
+void put_number(Block *block, int number) {
+	char digits[16];
+	int n = 0;
+	unsigned value = number < 0 ? -(unsigned)number : (unsigned)number;
+
+	digits[sizeof digits - ++n] = '\n';
+	do {
+		digits[sizeof digits - ++n] = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	if (number < 0) {
+		digits[sizeof digits - ++n] = '-';
+	}
+	put_output(block, digits + sizeof digits - n, n);
+}
+
+void add_note(Block *block, const char *text, int len, int line, char kind) {
+	if (block->nnotes == block->notes_size) {
+		block->notes_size = block->notes_size ? 2 * block->notes_size : 16;
+		block->notes = realloc(block->notes,
+			block->notes_size * sizeof *block->notes);
+		assert(block->notes);
+	}
+	Note *note = &block->notes[block->nnotes++];
+	note->text = text;
+	note->len = len;
+	note->line = line;
+	note->kind = kind;
+}
+
+// check or correct the 'n' words at 'words' (from lines 'lines' of
+// 'block'), and add what Task 3/4 prints for them to its output
+void correct_words(char op, SpellIndex *index, Block *block,
+		const SpellWord *words, const int *lines, int n) {
+	SpellResult results[BATCH_SIZE];
+	int ranks[BATCH_SIZE];
+	int i;
+
+	if (op == PIPELINE_OP_CHECK) {
+		spell_check_batch(index, words, n, ranks);
+		for (i = 0; i < n; i++) {
+			put_output(block, words[i].ptr, words[i].len);
+			if (ranks[i] == SPELL_NONE) {
+				put_output(block, "?", 1);
+			}
+			put_output(block, "\n", 1);
+		}
+	} else {
+		spell_correct_batch(index, words, n, results);
+		for (i = 0; i < n; i++) {
+			if (results[i].word) {
+				put_output(block, results[i].word, results[i].len);
+			} else {
+				put_output(block, words[i].ptr, words[i].len);
+				put_output(block, "?", 1);
+			}
+			put_output(block, "\n", 1);
+			if (results[i].degraded) {
+				add_note(block, words[i].ptr, words[i].len, lines[i],
+					NOTE_DEGRADED);
+				block->degraded++;
+			}
+		}
+	}
+	block->words += n;
+}
+
+// split 'block' into lines just as read_word_list() would, and check or
+// correct its words a batch at a time
+void scan_words(char op, SpellIndex *index, Block *block) {
+	SpellWord words[BATCH_SIZE];
+	int lines[BATCH_SIZE];
+	int nwords = 0;
+	const char *at = block->text, *end = block->text + block->len;
+
+	while (at < end) {
+		size_t n = piece_len(at, end);
+		size_t len = strnlen(at, n);
+		block->nlines++;
+		if (len == 1) {
+			// a completely blank line: the end of the document
+			block->ends = true;
+			break;
+		}
+		if (len > 0 && at[len-1] == '\n') {
+			len--;
+		}
+
+		if (all_lowercase(at, len)) {
+			words[nwords].ptr = at;
+			words[nwords].len = len;
+			lines[nwords++] = block->nlines;
+			if (nwords == BATCH_SIZE) {
+				correct_words(op, index, block, words, lines, nwords);
+				nwords = 0;
+			}
+		} else {
+			add_note(block, at, len, block->nlines, NOTE_INVALID);
+		}
+		at += n;
+	}
+	correct_words(op, index, block, words, lines, nwords);
+}
+
+/*----------------------------------------------------------------------*/
+/* WORKERS: BULK TASK 1 / TASK 2 */
+
+// the length of the line at 'at' (up to 'end'), including its newline if
+// it has one. '*len' receives its length without the newline
+size_t next_line(const char *at, const char *end, size_t *len) {
+	const char *newline = memchr(at, '\n', end - at);
+	*len = newline ? (size_t)(newline - at) : (size_t)(end - at);
+	return newline ? *len + 1 : *len;
+}
+
+/* Finds the edit distance between the 'n' bytes at 'a' and the 'm' bytes
+ * at 'b' as Task 1 does, but keeping only the last three rows of the table
+ * (enough for transpositions), in 'rows' (room for 3 * (m+1))
+ */
+int line_distance(const char *a, size_t n, const char *b, size_t m,
+		bool transpose, int *rows) {
+	int *row = rows, *last = rows + m + 1, *older = rows + 2 * (m + 1);
+	size_t i, j;
+
+	for (j = 0; j <= m; j++) {
+		row[j] = j;
+	}
+	for (i = 1; i <= n; i++) {
+		// the rows move up one: the oldest is reused for the new row
+		int *reuse = older;
+		older = last;
+		last = row;
+		row = reuse;
+
+		row[0] = i;
+		for (j = 1; j <= m; j++) {
+			int edist = MIN(last[j-1] + (a[i-1] != b[j-1]),
+				MIN(last[j] + 1, row[j-1] + 1));
+			if (transpose && i > 1 && j > 1 && a[i-1] == b[j-2]
+					&& a[i-2] == b[j-1]) {
+				edist = MIN(edist, older[j-2] + 1);
+			}
+			row[j] = edist;
+		}
+	}
+	return row[m];
+}
+
+// Task 1 for every line of 'block' that holds a pair of words (separated
+// by spaces or tabs). blank lines are skipped
+void scan_pairs(Worker *worker, Block *block) {
+	const char *at = block->text, *end = block->text + block->len;
+	size_t len, n, m;
+
+	while (at < end) {
+		size_t step = next_line(at, end, &len);
+		const char *line_end = at + len;
+		block->nlines++;
+
+		// the two words, and nothing after them
+		const char *a = at, *b;
+		while (a < line_end && (*a == ' ' || *a == '\t')) {
+			a++;
+		}
+		for (b = a; b < line_end && *b != ' ' && *b != '\t'; b++) {
+		}
+		n = b - a;
+		while (b < line_end && (*b == ' ' || *b == '\t')) {
+			b++;
+		}
+		for (m = 0; b + m < line_end && b[m] != ' ' && b[m] != '\t'; m++) {
+		}
+		const char *rest = b + m;
+		while (rest < line_end && (*rest == ' ' || *rest == '\t')) {
+			rest++;
+		}
+
+		if (n == 0 && m == 0) {
+			// a blank line
+		} else if (n == 0 || m == 0 || rest < line_end) {
+			add_note(block, at, len, block->nlines, NOTE_PAIR);
+		} else {
+			if (3 * (m + 1) > worker->nrows) {
+				worker->nrows = 3 * (m + 1);
+				worker->rows = realloc(worker->rows,
+					worker->nrows * sizeof *worker->rows);
+				assert(worker->rows);
+			}
+			put_number(block, line_distance(a, n, b, m,
+				worker->pipeline->transpositions, worker->rows));
+			block->words++;
+		}
+		at += step;
+	}
+}
+
+/* Adds every edit of the 'n' bytes at 'word' to the output, in Task 2's
+ * order: substitutions, deletions, insertions (and transpositions). each
+ * edit is copied into place, and room is made for all of them at once
+ */
+void put_edits(Block *block, const char *word, size_t n, bool transpose) {
+	const char *ALPHAB = "abcdefghijklmnopqrstuvwxyz";
+	const size_t a = 26;
+	size_t i, j;
+
+	size_t total = n * a * (n + 1) + n * n + (n + 1) * a * (n + 2)
+		+ (transpose && n > 1 ? (n - 1) * (n + 1) : 0);
+	reserve(&block->out, &block->out_size, block->nout + total);
+	char *out = block->out + block->nout;
+
+	// through substitution
+	for (i = 0; i < n; i++) {
+		for (j = 0; j < a; j++) {
+			memcpy(out, word, n);
+			out[i] = ALPHAB[j];
+			out[n] = '\n';
+			out += n + 1;
+		}
+	}
+	// through deletion
+	for (i = 0; i < n; i++) {
+		memcpy(out, word, i);
+		memcpy(out + i, word + i + 1, n - i - 1);
+		out[n - 1] = '\n';
+		out += n;
+	}
+	// through insertion
+	for (i = 0; i <= n; i++) {
+		for (j = 0; j < a; j++) {
+			memcpy(out, word, i);
+			out[i] = ALPHAB[j];
+			memcpy(out + i + 1, word + i, n - i);
+			out[n + 1] = '\n';
+			out += n + 2;
+		}
+	}
+	// through transposition of adjacent letters, if switched on
+	for (i = 0; transpose && i + 1 < n; i++) {
+		memcpy(out, word, n);
+		out[i] = word[i + 1];
+		out[i + 1] = word[i];
+		out[n] = '\n';
+		out += n + 1;
+	}
+	block->nout = out - block->out;
+}
+
+// Task 2 for the word on every line of 'block'. blank lines are skipped
+void scan_edits(Worker *worker, Block *block) {
+	const char *at = block->text, *end = block->text + block->len;
+	size_t len;
+
+	while (at < end) {
+		size_t step = next_line(at, end, &len);
+		block->nlines++;
+		if (len > 0) {
+			put_edits(block, at, len, worker->pipeline->transpositions);
+			block->words++;
+		}
+		at += step;
+	}
+}
+
+/*----------------------------------------------------------------------*/
+/* WORKER THREADS */
+
+void *pipe_worker(void *arg) {
+	Worker *worker = arg;
+	Pipeline *pipeline = worker->pipeline;
+
+	while (true) {
+		// wait for a block nobody has taken yet
+		pthread_mutex_lock(&pipeline->lock);
+		while (pipeline->ntaken == pipeline->nread && !pipeline->eof
+				&& !pipeline->stop) {
+			pthread_cond_wait(&pipeline->read, &pipeline->lock);
+		}
+		if (pipeline->stop || pipeline->ntaken == pipeline->nread) {
+			pthread_mutex_unlock(&pipeline->lock);
+			break;
+		}
+		Block *block =
+			&pipeline->blocks[pipeline->ntaken++ % pipeline->depth];
+		pthread_mutex_unlock(&pipeline->lock);
+
+		block->nout = 0;
+		block->nnotes = 0;
+		block->nlines = 0;
+		block->ends = false;
+		block->words = block->degraded = 0;
+		if (pipeline->op == PIPELINE_OP_DIST) {
+			scan_pairs(worker, block);
+		} else if (pipeline->op == PIPELINE_OP_EDITS) {
+			scan_edits(worker, block);
+		} else {
+			scan_words(pipeline->op, worker->index, block);
+		}
+
+		pthread_mutex_lock(&pipeline->lock);
+		block->done = true;
+		pthread_cond_broadcast(&pipeline->done);
+		pthread_mutex_unlock(&pipeline->lock);
+	}
+	return NULL;
+}
+
+/*----------------------------------------------------------------------*/
+/* WRITER */
+
+// write all of the 'n' buffers of 'iov' to 'fd'. returns false on failure
+bool writev_all(int fd, struct iovec *iov, int n) {
+	while (n > 0) {
+		ssize_t w = writev(fd, iov, n);
+		if (w < 0 && errno == EINTR) {
+			continue;
+		}
+		if (w < 0) {
+			return false;
+		}
+		// move past what was written
+		while (n > 0 && (size_t)w >= iov->iov_len) {
+			w -= iov->iov_len;
+			iov++;
+			n--;
+		}
+		if (n > 0) {
+			iov->iov_base = (char *)iov->iov_base + w;
+			iov->iov_len -= w;
+		}
+	}
+	return true;
+}
+
+// report the notes of 'block', whose lines follow 'first_line' lines
+void print_notes(const Block *block, long first_line) {
+	int i;
+	for (i = 0; i < block->nnotes; i++) {
+		const Note *note = &block->notes[i];
+		if (note->kind == NOTE_INVALID) {
+			fprintf(stderr, "warning: line %ld of input has invalid word "
+				"\"%.*s\". skipped.\n", first_line + note->line, note->len,
+				note->text);
+		} else if (note->kind == NOTE_PAIR) {
+			fprintf(stderr, "warning: line %ld of input is not a pair of "
+				"words \"%.*s\". skipped.\n", first_line + note->line,
+				note->len, note->text);
+		} else {
+			fprintf(stderr, "degraded: %.*s\n", note->len, note->text);
+		}
+	}
+}
+
+/* Writes the blocks out in order as workers finish them, as many at a time
+ * as are ready, until the end of the document
+ * returns 0, or -1 if the output could not be written
+ */
+int write_blocks(Pipeline *pipeline, int out, PipelineStats *stats) {
+	struct iovec iov[MAX_IOV];
+	long nlines = 0;	// lines of the document written out so far
+	int n, i;
+
+	while (true) {
+		pthread_mutex_lock(&pipeline->lock);
+		Block *next = &pipeline->blocks[pipeline->nwritten % pipeline->depth];
+		while (!next->done && !(pipeline->eof
+				&& pipeline->nwritten == pipeline->nread)) {
+			pthread_cond_wait(&pipeline->done, &pipeline->lock);
+		}
+		if (!next->done) {
+			pthread_mutex_unlock(&pipeline->lock);
+			return 0;
+		}
+		// every finished block in a row goes out together
+		for (n = 0; n < MAX_IOV && n < pipeline->depth
+				&& pipeline->nwritten + n < pipeline->nread
+				&& pipeline->blocks[(pipeline->nwritten + n)
+					% pipeline->depth].done; n++) {
+		}
+		pthread_mutex_unlock(&pipeline->lock);
+
+		// a block that ends the document is the last written
+		bool ends = false;
+		for (i = 0; i < n && !ends; i++) {
+			Block *block =
+				&pipeline->blocks[(pipeline->nwritten + i) % pipeline->depth];
+			iov[i].iov_base = block->out;
+			iov[i].iov_len = block->nout;
+			ends = block->ends;
+		}
+		n = i;
+		if (!writev_all(out, iov, n)) {
+			perror("error writing output");
+			return -1;
+		}
+		for (i = 0; i < n; i++) {
+			Block *block =
+				&pipeline->blocks[(pipeline->nwritten + i) % pipeline->depth];
+			print_notes(block, nlines);
+			nlines += block->nlines;
+			stats->words += block->words;
+			stats->degraded += block->degraded;
+		}
+
+		// hand the blocks back to the reader
+		pthread_mutex_lock(&pipeline->lock);
+		for (i = 0; i < n; i++) {
+			pipeline->blocks[(pipeline->nwritten + i)
+				% pipeline->depth].done = false;
+		}
+		pipeline->nwritten += n;
+		pthread_cond_broadcast(&pipeline->written);
+		pthread_mutex_unlock(&pipeline->lock);
+
+		if (ends) {
+			return 0;
+		}
+	}
+}
+
+/*----------------------------------------------------------------------*/
+/* RUNNING THE PIPELINE */
+
+int run_pipeline(SpellIndex *index, char op, int in, int out,
+		const PipelineOptions *options, PipelineStats *stats) {
+	int nworkers = options->workers > 0 ? options->workers : 1;
+	int i, status;
+
+	Pipeline pipeline = {
+		.op = op,
+		.transpositions = options->transpositions,
+		.in = in,
+		.depth = options->depth > 0 ? options->depth : 2 * nworkers,
+	};
+	// every worker needs a block of its own to work on
+	if (pipeline.depth < nworkers) {
+		pipeline.depth = nworkers;
+	}
+	pipeline.blocks = calloc(pipeline.depth, sizeof *pipeline.blocks);
+	assert(pipeline.blocks);
+	pthread_mutex_init(&pipeline.lock, NULL);
+	pthread_cond_init(&pipeline.read, NULL);
+	pthread_cond_init(&pipeline.done, NULL);
+	pthread_cond_init(&pipeline.written, NULL);
+
+	// the first worker uses the index itself, the others views of it
+	Worker *workers = malloc(nworkers * sizeof *workers);
+	assert(workers);
+	for (i = 0; i < nworkers; i++) {
+		workers[i].pipeline = &pipeline;
+		workers[i].index = i == 0 || !index ? index
+			: spell_index_view(index);
+		workers[i].rows = NULL;
+		workers[i].nrows = 0;
+	}
+
+	pthread_t reader;
+	int err = pthread_create(&reader, NULL, pipe_reader, &pipeline);
+	assert(err == 0);
+	for (i = 0; i < nworkers; i++) {
+		err = pthread_create(&workers[i].thread, NULL, pipe_worker,
+			&workers[i]);
+		assert(err == 0);
+	}
+
+	// this thread is the writer
+	stats->words = stats->degraded = 0;
+	status = write_blocks(&pipeline, out, stats);
+
+	// a document that ended early (or output that failed) leaves the
+	// reader waiting for a free block, or for input that may never come
+	pthread_mutex_lock(&pipeline.lock);
+	pipeline.stop = true;
+	pthread_cond_broadcast(&pipeline.read);
+	pthread_cond_broadcast(&pipeline.written);
+	pthread_mutex_unlock(&pipeline.lock);
+	pthread_cancel(reader);
+	pthread_join(reader, NULL);
+	for (i = 0; i < nworkers; i++) {
+		pthread_join(workers[i].thread, NULL);
+		if (i > 0 && index) {
+			spell_index_free(workers[i].index);
+		}
+		free(workers[i].rows);
+	}
+
+	if (pipeline.error) {
+		errno = pipeline.error;
+		perror("error reading document");
+		status = -1;
+	}
+
+	for (i = 0; i < pipeline.depth; i++) {
+		free(pipeline.blocks[i].text);
+		free(pipeline.blocks[i].out);
+		free(pipeline.blocks[i].notes);
+	}
+	free(pipeline.blocks);
+	free(pipeline.carry);
+	free(workers);
+	pthread_mutex_destroy(&pipeline.lock);
+	pthread_cond_destroy(&pipeline.read);
+	pthread_cond_destroy(&pipeline.done);
+	pthread_cond_destroy(&pipeline.written);
+	return status;
+}
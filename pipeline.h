@@ -0,0 +1,59 @@
+/* * * * * * *
+ * Module for pipelined Task 3/4, and bulk Task 1/2: a reader thread reads
+ * the input in large blocks of whole lines, workers check or correct a
+ * block at a time (or find the distances between the pairs of words of a
+ * block, or the edits of its words), and the writer puts their output back
+ * in order and writes it out with writev(). reading, working and writing
+ * overlap, instead of one after the other
+ *
+ * only a fixed number of blocks are ever in flight between the reader and
+ * the writer: once they are all taken, the reader waits for the writer to
+ * write one out (backpressure), so memory stays bounded however large the
+ * document is, and however slow the output
+ *
+ * the output is the same as Task 3/4's, as are the warnings about invalid
+ * lines (on stderr, in order, as each block is written out). bulk Task 1
+ * prints the distance of each line's pair of words ("word1 word2"), and
+ * bulk Task 2 the edits of each line's word, as Task 1/2 would for each
+ * of them in turn. blank lines are skipped
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "libspell.h"
+
+#define PIPELINE_OP_CHECK 'c'	// Task 3
+#define PIPELINE_OP_SPELL 's'	// Task 4
+#define PIPELINE_OP_DIST  'd'	// bulk Task 1
+#define PIPELINE_OP_EDITS 'e'	// bulk Task 2
+
+#define PIPELINE_BLOCK (256 << 10)	// bytes the reader reads into a block
+
+typedef struct {
+	int workers;	// worker threads. for Task 3/4, each one past the first
+					// works on a view of the index (see spell_index_view())
+	int depth;		// blocks in flight between the reader and the writer,
+					// at least one per worker. 0 for twice the workers
+	int transpositions;	// bulk Task 1/2: a swap of adjacent letters is a
+						// single edit
+} PipelineOptions;
+
+// what a run went through, for Task 4's budget report
+typedef struct {
+	long words;		// document words checked or corrected (or pairs or
+					// words of bulk Task 1/2)
+	long degraded;	// words that ran out of budget
+} PipelineStats;
+
+// check or correct (by 'op') the document read from file descriptor 'in'
+// against 'index', writing what Task 3/4 prints to file descriptor 'out'
+// and filling in 'stats' (or bulk Task 1/2, with no index: NULL). returns
+// 0, or -1 (with a message on stderr) if the document could not be read or
+// the output could not be written
+int run_pipeline(SpellIndex *index, char op, int in, int out,
+	const PipelineOptions *options, PipelineStats *stats);
+
+#endif
@@ -0,0 +1,291 @@
+/* * * * * * *
+ * Module for slab pools and per-query arenas
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+#define MAX_STATS  32			// distinct statistics records
+#define SLAB_SIZE  (64 << 10)	// bytes per slab
+#define ALIGNMENT  8			// every object and arena allocation
+
+#define ROUND_UP(X) (((X) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
+
+/*----------------------------------------------------------------------*/
+/* STATISTICS */
+
+// records are created under a lock, and updated with atomic adds, since
+// pools with the same name can live on different threads
+static AllocStats stats_records[MAX_STATS];
+static int nstats = 0;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+AllocStats *alloc_stats(const char *name) {
+	AllocStats *stats = NULL;
+	int i;
+
+	pthread_mutex_lock(&stats_lock);
+	for (i = 0; i < nstats; i++) {
+		if (strcmp(stats_records[i].name, name) == 0) {
+			stats = &stats_records[i];
+		}
+	}
+	if (!stats) {
+		assert(nstats < MAX_STATS);
+		stats = &stats_records[nstats++];
+		stats->name = name;
+	}
+	pthread_mutex_unlock(&stats_lock);
+	return stats;
+}
+
+// add 'delta' to a counter, and raise its peak if it is now higher
+void count_bytes(long *counter, long *peak, long delta) {
+	long now = __atomic_add_fetch(counter, delta, __ATOMIC_RELAXED);
+	long high = __atomic_load_n(peak, __ATOMIC_RELAXED);
+	while (now > high && !__atomic_compare_exchange_n(peak, &high, now,
+			0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+}
+
+void count_event(unsigned long *counter) {
+	__atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+}
+
+void fprint_alloc_stats(FILE *file) {
+	int i;
+	fprintf(file, "%-12s %12s %12s %12s %12s %12s\n", "allocator",
+		"allocs", "frees/resets", "peak in use", "peak held", "held now");
+	for (i = 0; i < nstats; i++) {
+		AllocStats *stats = &stats_records[i];
+		fprintf(file, "%-12s %12lu %12lu %12ld %12ld %12ld\n", stats->name,
+			stats->allocs, stats->frees, stats->peak_in_use,
+			stats->peak_reserved, stats->reserved);
+	}
+}
+
+
+/*----------------------------------------------------------------------*/
+/* SLAB POOLS */
+
+typedef struct slab Slab;
+struct slab {
+	Slab *next;
+	size_t size;		// bytes of data: SLAB_SIZE, or more for many objects
+	char data[];
+};
+
+typedef struct free_object FreeObject;
+struct free_object {
+	FreeObject *next;
+};
+
+struct slab_pool {
+	size_t size;		// object size, rounded up to the size class
+	FreeObject *free;	// objects given back, reused first
+	Slab *slabs;
+	char *next;			// unused space at the end of the newest slab
+	char *end;
+	AllocStats *stats;
+};
+
+SlabPool *new_slab_pool(size_t size, const char *name) {
+	SlabPool *pool = malloc(sizeof *pool);
+	assert(pool);
+
+	if (size < sizeof(FreeObject)) {
+		size = sizeof(FreeObject);
+	}
+	pool->size = ROUND_UP(size);
+	pool->free = NULL;
+	pool->slabs = NULL;
+	pool->next = pool->end = NULL;
+	pool->stats = alloc_stats(name);
+	return pool;
+}
+
+void free_slab_pool(SlabPool *pool) {
+	assert(pool != NULL);
+	Slab *slab = pool->slabs;
+	long held = 0;
+	while (slab) {
+		Slab *next = slab->next;
+		held += slab->size;
+		free(slab);
+		slab = next;
+	}
+
+	// whatever was still handed out goes with the slabs
+	long in_use = held - (pool->end - pool->next);
+	FreeObject *object;
+	for (object = pool->free; object; object = object->next) {
+		in_use -= pool->size;
+	}
+	count_bytes(&pool->stats->in_use, &pool->stats->peak_in_use, -in_use);
+	count_bytes(&pool->stats->reserved, &pool->stats->peak_reserved, -held);
+	free(pool);
+}
+
+void *slab_alloc(SlabPool *pool) {
+	void *object;
+
+	if (pool->free) {
+		object = pool->free;
+		pool->free = pool->free->next;
+	} else {
+		if (pool->next + pool->size > pool->end) {
+			// carve objects from a fresh slab
+			Slab *slab = malloc(sizeof *slab + SLAB_SIZE);
+			assert(slab);
+			slab->next = pool->slabs;
+			slab->size = SLAB_SIZE;
+			pool->slabs = slab;
+			pool->next = slab->data;
+			pool->end = slab->data + SLAB_SIZE / pool->size * pool->size;
+			count_bytes(&pool->stats->reserved, &pool->stats->peak_reserved,
+				SLAB_SIZE);
+			// the unusable tail of the slab counts as in use
+			count_bytes(&pool->stats->in_use, &pool->stats->peak_in_use,
+				SLAB_SIZE % pool->size);
+		}
+		object = pool->next;
+		pool->next += pool->size;
+	}
+
+	count_event(&pool->stats->allocs);
+	count_bytes(&pool->stats->in_use, &pool->stats->peak_in_use, pool->size);
+	return object;
+}
+
+void *slab_alloc_many(SlabPool *pool, size_t n) {
+	size_t size = n * pool->size;
+	Slab *slab = malloc(sizeof *slab + size);
+	assert(slab);
+
+	// the slab goes behind the newest one, which may still have room
+	if (pool->slabs) {
+		slab->next = pool->slabs->next;
+		pool->slabs->next = slab;
+	} else {
+		slab->next = NULL;
+		pool->slabs = slab;
+	}
+	slab->size = size;
+	__atomic_add_fetch(&pool->stats->allocs, n, __ATOMIC_RELAXED);
+	count_bytes(&pool->stats->reserved, &pool->stats->peak_reserved, size);
+	count_bytes(&pool->stats->in_use, &pool->stats->peak_in_use, size);
+	return slab->data;
+}
+
+void slab_free(SlabPool *pool, void *object) {
+	FreeObject *freed = object;
+	freed->next = pool->free;
+	pool->free = freed;
+
+	count_event(&pool->stats->frees);
+	count_bytes(&pool->stats->in_use, &pool->stats->peak_in_use,
+		-(long)pool->size);
+}
+
+
+/*----------------------------------------------------------------------*/
+/* PER-QUERY ARENAS */
+
+typedef struct chunk Chunk;
+struct chunk {
+	Chunk *next;
+	size_t size;
+	char data[];
+};
+
+struct arena {
+	size_t chunk_size;
+	Chunk *first;
+	Chunk *current;		// the chunk being filled
+	char *next;			// unused space in the current chunk
+	char *end;
+	long used;			// bytes handed out since the last reset
+	AllocStats *stats;
+};
+
+Arena *new_arena(size_t chunk_size, const char *name) {
+	Arena *arena = malloc(sizeof *arena);
+	assert(arena);
+	arena->chunk_size = chunk_size;
+	arena->first = arena->current = NULL;
+	arena->next = arena->end = NULL;
+	arena->used = 0;
+	arena->stats = alloc_stats(name);
+	return arena;
+}
+
+void free_arena(Arena *arena) {
+	assert(arena != NULL);
+	long held = 0;
+	Chunk *chunk = arena->first;
+	while (chunk) {
+		Chunk *next = chunk->next;
+		held += chunk->size;
+		free(chunk);
+		chunk = next;
+	}
+	count_bytes(&arena->stats->in_use, &arena->stats->peak_in_use,
+		-arena->used);
+	count_bytes(&arena->stats->reserved, &arena->stats->peak_reserved, -held);
+	free(arena);
+}
+
+void *arena_alloc(Arena *arena, size_t n) {
+	n = ROUND_UP(n);
+	if (!arena->current || arena->next + n > arena->end) {
+		// move on to the next chunk kept from an earlier query, or add one
+		Chunk *chunk = arena->current ? arena->current->next : arena->first;
+		while (chunk && chunk->size < n) {
+			chunk = chunk->next;
+		}
+		if (!chunk) {
+			size_t size = n > arena->chunk_size ? n : arena->chunk_size;
+			chunk = malloc(sizeof *chunk + size);
+			assert(chunk);
+			chunk->size = size;
+			// new chunks go right after the current one
+			if (arena->current) {
+				chunk->next = arena->current->next;
+				arena->current->next = chunk;
+			} else {
+				chunk->next = arena->first;
+				arena->first = chunk;
+			}
+			count_bytes(&arena->stats->reserved,
+				&arena->stats->peak_reserved, size);
+		}
+		arena->current = chunk;
+		arena->next = chunk->data;
+		arena->end = chunk->data + chunk->size;
+	}
+
+	void *memory = arena->next;
+	arena->next += n;
+	arena->used += n;
+	count_event(&arena->stats->allocs);
+	count_bytes(&arena->stats->in_use, &arena->stats->peak_in_use, n);
+	return memory;
+}
+
+void arena_reset(Arena *arena) {
+	arena->current = NULL;
+	arena->next = arena->end = NULL;
+	count_event(&arena->stats->frees);
+	count_bytes(&arena->stats->in_use, &arena->stats->peak_in_use,
+		-arena->used);
+	arena->used = 0;
+}
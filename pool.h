@@ -0,0 +1,73 @@
+/* * * * * * *
+ * Module for the allocators behind the small, short-lived objects of the
+ * program: slab pools hand out fixed-size objects (list nodes, hash table
+ * buckets) carved from large slabs, and arenas hand out memory for a single
+ * query that is all released at once, in O(1), when the query is done
+ *
+ * every pool and arena counts its traffic in a named statistics record,
+ * which can be printed at the end of a run
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdio.h>
+#include <stddef.h>
+
+// allocation statistics, shared by every pool or arena with the same name
+typedef struct {
+	const char *name;
+	unsigned long allocs;		// objects (or arena allocations) handed out
+	unsigned long frees;		// objects given back (or arena resets)
+	long in_use;				// bytes currently handed out
+	long peak_in_use;
+	long reserved;				// bytes currently held in slabs or chunks
+	long peak_reserved;
+} AllocStats;
+
+// the statistics record named 'name', created on first use
+AllocStats *alloc_stats(const char *name);
+
+// print every statistics record
+void fprint_alloc_stats(FILE *file);
+
+
+/* * *
+ * SLAB POOLS
+ */
+
+typedef struct slab_pool SlabPool;
+
+// a pool of objects of 'size' bytes (rounded up to its size class)
+SlabPool *new_slab_pool(size_t size, const char *name);
+
+// free the pool, and every object still allocated from it
+void free_slab_pool(SlabPool *pool);
+
+void *slab_alloc(SlabPool *pool);
+void slab_free(SlabPool *pool, void *object);
+
+// 'n' objects at once, back to back in a slab of their own. each of them
+// can be given back with slab_free(), like any other object of the pool
+void *slab_alloc_many(SlabPool *pool, size_t n);
+
+
+/* * *
+ * PER-QUERY ARENAS
+ */
+
+typedef struct arena Arena;
+
+Arena *new_arena(size_t chunk_size, const char *name);
+void free_arena(Arena *arena);
+
+// 'n' bytes, valid until the arena is next reset
+void *arena_alloc(Arena *arena, size_t n);
+
+// release everything allocated since the last reset, in O(1): the chunks
+// are kept and refilled by the next query
+void arena_reset(Arena *arena);
+
+#endif
@@ -0,0 +1,615 @@
+/* * * * * * *
+ * Module for the spelling daemon: a long-running server that loads the
+ * dictionary index once and answers check/correct requests from many
+ * clients over a Unix domain socket, and the thin client that talks to it
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+
+#include "server.h"
+#include "libspell.h"
+
+#define MAX_PAYLOAD    (16 << 20)	// larger requests drop the connection
+#define MAX_PENDING    (4 * MAX_PAYLOAD)	// unsent output that stops a client
+#define MAX_EVENTS     64			// epoll events handled per wakeup
+#define READ_CHUNK     65536		// bytes read from a socket at a time
+#define CLIENT_BATCH   4096			// words sent per request by the client
+#define SERVER_BATCH   1024			// words handed to the library at a time
+#define ACCEPT_BACKOFF 100			// ms before retrying a failed accept
+
+#define HEADER_LEN     4	// u32 payload length
+#define REQUEST_HEAD   5	// u8 op, u32 nwords
+#define WORD_HEAD      2	// u16 word length
+
+/*----------------------------------------------------------------------*/
+/* GROWABLE BYTE BUFFERS */
+
+void buffer_reserve(Buffer *buf, size_t extra) {
+	if (buf->len + extra <= buf->cap) {
+		return;
+	}
+	// reclaim consumed space at the front before growing
+	if (buf->off > 0) {
+		memmove(buf->data, buf->data + buf->off, buf->len - buf->off);
+		buf->len -= buf->off;
+		buf->off = 0;
+		if (buf->len + extra <= buf->cap) {
+			return;
+		}
+	}
+	size_t cap = buf->cap ? buf->cap : READ_CHUNK;
+	while (cap < buf->len + extra) {
+		cap *= 2;
+	}
+	buf->data = realloc(buf->data, cap);
+	assert(buf->data);
+	buf->cap = cap;
+}
+
+void buffer_append(Buffer *buf, const void *data, size_t n) {
+	buffer_reserve(buf, n);
+	memcpy(buf->data + buf->len, data, n);
+	buf->len += n;
+}
+
+void buffer_append_u32(Buffer *buf, uint32_t value) {
+	buffer_append(buf, &value, sizeof value);
+}
+
+void buffer_append_word(Buffer *buf, const char *word, size_t n) {
+	uint16_t len = n;
+	buffer_append(buf, &len, sizeof len);
+	buffer_append(buf, word, n);
+}
+
+void free_buffer(Buffer *buf) {
+	free(buf->data);
+	buf->data = NULL;
+	buf->len = buf->off = buf->cap = 0;
+}
+
+/*----------------------------------------------------------------------*/
+/* ANSWERING REQUESTS */
+
+/* Appends the result of one word to a response
+ */
+void append_result(Buffer *out, uint8_t status, const char *word, size_t n) {
+	buffer_append(out, &status, sizeof status);
+	buffer_append_word(out, word, n);
+}
+
+/* Answers the batch of 'nwords' words with operation 'op', appending their
+ * results to 'out'
+ */
+void answer_batch(SpellIndex *index, char op, SpellWord *words, int nwords,
+		Buffer *out) {
+	int ranks[SERVER_BATCH];
+	SpellResult results[SERVER_BATCH];
+	int i;
+
+	if (op == SERVER_OP_CHECK) {
+		spell_check_batch(index, words, nwords, ranks);
+		for (i = 0; i < nwords; i++) {
+			append_result(out,
+				ranks[i] != SPELL_NONE ? SERVER_CORRECT : SERVER_UNKNOWN,
+				words[i].ptr, words[i].len);
+		}
+		return;
+	}
+
+	spell_correct_batch(index, words, nwords, results);
+	for (i = 0; i < nwords; i++) {
+		if (!results[i].word) {
+			append_result(out, SERVER_UNKNOWN, words[i].ptr, words[i].len);
+		} else {
+			append_result(out,
+				results[i].dist == 0 ? SERVER_CORRECT : SERVER_CORRECTED,
+				results[i].word, results[i].len);
+		}
+	}
+}
+
+/* Answers one request 'payload' of 'plen' bytes against 'index', appending
+ * the response frame to 'out'. the words are looked up in place, in
+ * batches. returns false if the request is malformed
+ */
+bool answer_request(SpellIndex *index, const char *payload, size_t plen,
+		Buffer *out) {
+	SpellWord words[SERVER_BATCH];
+	uint32_t nwords, i;
+	uint16_t len;
+	int nbatch = 0;
+
+	if (plen < REQUEST_HEAD) {
+		return false;
+	}
+	char op = payload[0];
+	if (op != SERVER_OP_CHECK && op != SERVER_OP_SPELL) {
+		return false;
+	}
+	memcpy(&nwords, payload + 1, sizeof nwords);
+
+	// each request is a document of its own, with a fresh budget
+	spell_index_reset_budget(index);
+
+	// leave room for the response header, filled in once the size is known.
+	// it is found from the front of the unsent output, which appending may
+	// move back to the start of the buffer
+	size_t start = out->len - out->off;
+	buffer_append_u32(out, 0);
+	buffer_append_u32(out, nwords);
+
+	size_t pos = REQUEST_HEAD;
+	for (i = 0; i < nwords; i++) {
+		if (pos + WORD_HEAD > plen) {
+			return false;
+		}
+		memcpy(&len, payload + pos, sizeof len);
+		pos += WORD_HEAD;
+		if (len > SPELL_MAX_WORD_LEN || pos + len > plen) {
+			return false;
+		}
+		words[nbatch].ptr = payload + pos;
+		words[nbatch].len = len;
+		nbatch++;
+		pos += len;
+
+		if (nbatch == SERVER_BATCH) {
+			answer_batch(index, op, words, nbatch, out);
+			nbatch = 0;
+		}
+	}
+	answer_batch(index, op, words, nbatch, out);
+
+	uint32_t rlen = out->len - out->off - start - HEADER_LEN;
+	memcpy(out->data + out->off + start, &rlen, sizeof rlen);
+	return true;
+}
+
+/*----------------------------------------------------------------------*/
+/* SERVER */
+
+typedef struct {
+	int fd;
+	Buffer in;
+	Buffer out;
+} Client;
+
+static volatile sig_atomic_t stopping = 0;
+
+void stop_server(int sig) {
+	stopping = 1;
+}
+
+void set_nonblocking(int fd) {
+	int flags = fcntl(fd, F_GETFL, 0);
+	fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+void close_client(int epfd, Client *client) {
+	epoll_ctl(epfd, EPOLL_CTL_DEL, client->fd, NULL);
+	close(client->fd);
+	free_buffer(&client->in);
+	free_buffer(&client->out);
+	free(client);
+}
+
+/* Returns 1 if the first unanswered request frame of 'in' is all there, 0
+ * if not yet, or -1 if its header asks for more than MAX_PAYLOAD bytes
+ */
+int pending_frame(Buffer *in) {
+	uint32_t plen;
+	if (in->len - in->off < HEADER_LEN) {
+		return 0;
+	}
+	memcpy(&plen, in->data + in->off, sizeof plen);
+	if (plen > MAX_PAYLOAD) {
+		return -1;
+	}
+	return in->len - in->off >= HEADER_LEN + plen;
+}
+
+// whether a client has more output waiting than it is allowed: it isn't
+// read from or answered until the socket takes some of it
+bool backlogged(const Buffer *out) {
+	return out->len - out->off > MAX_PENDING;
+}
+
+/* Writes as much pending output as the socket accepts, and only asks epoll
+ * for writability while some output is still pending (or a request held
+ * back by a backlog is waiting to be answered), and for readability while
+ * the client isn't backlogged
+ * returns false if the connection failed
+ */
+bool flush_client(int epfd, Client *client) {
+	Buffer *out = &client->out;
+	while (out->off < out->len) {
+		ssize_t n = write(client->fd, out->data + out->off,
+			out->len - out->off);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			return false;
+		}
+		out->off += n;
+	}
+	if (out->off == out->len) {
+		out->off = out->len = 0;
+	}
+
+	struct epoll_event ev = { .data.ptr = client };
+	ev.events = (backlogged(out) ? 0 : EPOLLIN)
+		| (out->len > 0 || pending_frame(&client->in) == 1 ? EPOLLOUT : 0);
+	epoll_ctl(epfd, EPOLL_CTL_MOD, client->fd, &ev);
+	return true;
+}
+
+/* Reads from a client until a request frame is complete (or nothing more is
+ * available), and answers every complete request in its input. a client
+ * sending faster than it's answered is left to epoll to come back to, so
+ * its input never holds more than one frame and a chunk, and one reading
+ * slower than it's answered stops being read from and answered once its
+ * output is backlogged
+ * returns false if the connection should be closed
+ */
+bool serve_client(SpellIndex *index, Client *client) {
+	Buffer *in = &client->in;
+	bool open = true;
+	int frame = 0;
+
+	while (!backlogged(&client->out) && (frame = pending_frame(in)) == 0) {
+		buffer_reserve(in, READ_CHUNK);
+		ssize_t n = read(client->fd, in->data + in->len, READ_CHUNK);
+		if (n > 0) {
+			in->len += n;
+			continue;
+		}
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+			// client hung up, but still answer what it already sent
+			open = false;
+		}
+		break;
+	}
+
+	// answer every complete request frame, until the output is backlogged
+	uint32_t plen;
+	while (!backlogged(&client->out) && (frame = pending_frame(in)) == 1) {
+		memcpy(&plen, in->data + in->off, sizeof plen);
+		if (!answer_request(index, in->data + in->off + HEADER_LEN, plen,
+				&client->out)) {
+			return false;
+		}
+		in->off += HEADER_LEN + plen;
+	}
+	if (frame < 0) {
+		return false;
+	}
+	if (in->off == in->len) {
+		in->off = in->len = 0;
+	} else if (in->off > 0) {
+		// move a partial frame to the front, so the buffer stays bounded
+		memmove(in->data, in->data + in->off, in->len - in->off);
+		in->len -= in->off;
+		in->off = 0;
+	}
+	return open || client->out.len > 0;
+}
+
+/* Accepts every pending connection on 'lfd', and adds it to 'epfd'
+ * returns false (with a message on stderr) if accepting failed for want of
+ * descriptors or memory, after leaving 'lfd' out of the wait
+ */
+bool accept_clients(int epfd, int lfd) {
+	for (;;) {
+		int cfd = accept(lfd, NULL, NULL);
+		if (cfd < 0) {
+			if (errno == EINTR || errno == ECONNABORTED || errno == EPROTO) {
+				// that connection is gone, but others may be waiting
+				continue;
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return true;
+			}
+			perror("error accepting client");
+			struct epoll_event lev = { .events = 0, .data.ptr = NULL };
+			epoll_ctl(epfd, EPOLL_CTL_MOD, lfd, &lev);
+			return false;
+		}
+		set_nonblocking(cfd);
+		Client *client = calloc(1, sizeof *client);
+		assert(client);
+		client->fd = cfd;
+		struct epoll_event cev = { .events = EPOLLIN, .data.ptr = client };
+		epoll_ctl(epfd, EPOLL_CTL_ADD, cfd, &cev);
+	}
+}
+
+/* Makes way for a socket at 'addr': nothing there is fine, a socket no
+ * server answers on is removed as stale, and anything else (a live server's
+ * socket, or a file that is not a socket) is left alone
+ * returns false (with a message on stderr) if the path can't be used
+ */
+bool claim_socket_path(const struct sockaddr_un *addr) {
+	const char *path = addr->sun_path;
+	struct stat st;
+	if (lstat(path, &st) < 0) {
+		if (errno == ENOENT) {
+			return true;
+		}
+		perror("error checking socket path");
+		return false;
+	}
+	if (!S_ISSOCK(st.st_mode)) {
+		fprintf(stderr, "error: \"%s\" exists and is not a socket\n", path);
+		return false;
+	}
+
+	// only a socket nobody is listening on may be replaced
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("error creating socket");
+		return false;
+	}
+	int status = connect(fd, (const struct sockaddr *)addr, sizeof *addr);
+	int err = errno;
+	close(fd);
+	if (status < 0 && err == ECONNREFUSED) {
+		if (unlink(path) < 0) {
+			perror("error removing stale socket");
+			return false;
+		}
+		return true;
+	}
+	fprintf(stderr, "error: socket \"%s\" is already in use\n", path);
+	return false;
+}
+
+int run_server(SpellIndex *index, char *path) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof addr.sun_path) {
+		fprintf(stderr, "error: socket path \"%s\" is too long\n", path);
+		return 1;
+	}
+	strcpy(addr.sun_path, path);
+
+	int lfd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (lfd < 0) {
+		perror("error creating socket");
+		return 1;
+	}
+	if (!claim_socket_path(&addr)) {
+		close(lfd);
+		return 1;
+	}
+	// remember what was bound, so that shutdown only removes our own socket
+	struct stat bound;
+	if (bind(lfd, (struct sockaddr *)&addr, sizeof addr) < 0
+			|| listen(lfd, SOMAXCONN) < 0 || lstat(path, &bound) < 0) {
+		perror("error binding socket");
+		close(lfd);
+		return 1;
+	}
+	set_nonblocking(lfd);
+
+	int epfd = epoll_create1(0);
+	assert(epfd >= 0);
+	struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+	epoll_ctl(epfd, EPOLL_CTL_ADD, lfd, &ev);
+
+	// stop cleanly on interrupt, and survive clients that hang up early
+	struct sigaction sa = { .sa_handler = stop_server };
+	sigemptyset(&sa.sa_mask);
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	signal(SIGPIPE, SIG_IGN);
+
+	// out of descriptors (or memory), the listening socket stays readable
+	// but can't be accepted from: it is left out of the wait until a client
+	// leaves, or for ACCEPT_BACKOFF ms
+	bool listening = true;
+
+	struct epoll_event events[MAX_EVENTS];
+	while (!stopping) {
+		int nready = epoll_wait(epfd, events, MAX_EVENTS,
+			listening ? -1 : ACCEPT_BACKOFF);
+		bool resume = nready == 0;
+		if (nready < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			perror("error waiting for clients");
+			break;
+		}
+
+		int i;
+		for (i = 0; i < nready; i++) {
+			Client *client = events[i].data.ptr;
+
+			if (!client) {
+				// the listening socket: accept every pending connection
+				listening = accept_clients(epfd, lfd);
+				continue;
+			}
+
+			bool ok = true;
+			// writability may also mean a backlog cleared, and requests
+			// held back are waiting
+			if (events[i].events & (EPOLLIN | EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+				ok = serve_client(index, client);
+			}
+			if (ok) {
+				ok = flush_client(epfd, client);
+			}
+			if (!ok || (client->out.len == 0
+					&& (events[i].events & (EPOLLHUP | EPOLLERR)))) {
+				close_client(epfd, client);
+				resume = true;
+			}
+		}
+		if (!listening && resume) {
+			struct epoll_event lev = { .events = EPOLLIN, .data.ptr = NULL };
+			epoll_ctl(epfd, EPOLL_CTL_MOD, lfd, &lev);
+			listening = true;
+		}
+
+		// corrections learned while answering go out to the memo file
+		// now, so that other runs see them before this one stops
+		spell_index_save(index);
+	}
+
+	close(epfd);
+	close(lfd);
+	struct stat now;
+	if (lstat(path, &now) == 0 && now.st_dev == bound.st_dev
+			&& now.st_ino == bound.st_ino) {
+		unlink(path);
+	}
+	return 0;
+}
+
+/*----------------------------------------------------------------------*/
+/* CLIENT */
+
+bool write_all(int fd, const char *data, size_t n) {
+	while (n > 0) {
+		ssize_t w = write(fd, data, n);
+		if (w < 0 && errno == EINTR) {
+			continue;
+		}
+		if (w <= 0) {
+			return false;
+		}
+		data += w;
+		n -= w;
+	}
+	return true;
+}
+
+bool read_all(int fd, char *data, size_t n) {
+	while (n > 0) {
+		ssize_t r = read(fd, data, n);
+		if (r < 0 && errno == EINTR) {
+			continue;
+		}
+		if (r <= 0) {
+			return false;
+		}
+		data += r;
+		n -= r;
+	}
+	return true;
+}
+
+/* Prints every result of one response payload, in Task 3/4 format
+ */
+bool print_response(const char *payload, size_t plen) {
+	uint32_t nwords, i;
+	uint16_t len;
+	size_t pos = sizeof nwords;
+
+	if (plen < pos) {
+		return false;
+	}
+	memcpy(&nwords, payload, sizeof nwords);
+	for (i = 0; i < nwords; i++) {
+		if (pos + 1 + WORD_HEAD > plen) {
+			return false;
+		}
+		uint8_t status = payload[pos];
+		memcpy(&len, payload + pos + 1, sizeof len);
+		pos += 1 + WORD_HEAD;
+		if (pos + len > plen) {
+			return false;
+		}
+		printf("%.*s%s\n", len, payload + pos,
+			status == SERVER_UNKNOWN ? "?" : "");
+		pos += len;
+	}
+	return true;
+}
+
+int run_client(char *path, char op, List *document) {
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	if (strlen(path) >= sizeof addr.sun_path) {
+		fprintf(stderr, "error: socket path \"%s\" is too long\n", path);
+		return 1;
+	}
+	strcpy(addr.sun_path, path);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof addr) < 0) {
+		perror("error connecting to server");
+		if (fd >= 0) {
+			close(fd);
+		}
+		return 1;
+	}
+
+	Buffer req = { 0 };
+	Buffer resp = { 0 };
+	int status = 0;
+
+	Node *curr_node = document->head;
+	while (curr_node) {
+		// pack the next batch of words into one request
+		req.len = 0;
+		buffer_append_u32(&req, 0);
+		buffer_append(&req, &op, 1);
+		buffer_append_u32(&req, 0);
+
+		uint32_t nwords = 0;
+		while (curr_node && nwords < CLIENT_BATCH) {
+			char *word = curr_node->data;
+			buffer_append_word(&req, word, strlen(word));
+			nwords++;
+			curr_node = curr_node->next;
+		}
+		uint32_t plen = req.len - HEADER_LEN;
+		memcpy(req.data, &plen, sizeof plen);
+		memcpy(req.data + HEADER_LEN + 1, &nwords, sizeof nwords);
+
+		if (!write_all(fd, req.data, req.len)
+				|| !read_all(fd, (char *)&plen, sizeof plen)) {
+			fprintf(stderr, "error: lost connection to server\n");
+			status = 1;
+			break;
+		}
+		resp.len = 0;
+		buffer_reserve(&resp, plen);
+		if (!read_all(fd, resp.data, plen)
+				|| !print_response(resp.data, plen)) {
+			fprintf(stderr, "error: bad response from server\n");
+			status = 1;
+			break;
+		}
+	}
+
+	free_buffer(&req);
+	free_buffer(&resp);
+	close(fd);
+	return status;
+}
@@ -0,0 +1,67 @@
+/* * * * * * *
+ * Module for the spelling daemon: a long-running server that loads the
+ * dictionary index once and answers check/correct requests from many
+ * clients over a Unix domain socket, and the thin client that talks to it
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ *
+ * protocol (all integers in host byte order, the socket is local):
+ *   request:  u32 payload length | u8 op | u32 nwords | nwords * word
+ *   response: u32 payload length | u32 nwords | nwords * (u8 status, word)
+ *   word:     u16 length | length bytes (no terminating '\0')
+ *
+ * op is SERVER_OP_CHECK (Task 3) or SERVER_OP_SPELL (Task 4). each result
+ * word is the correction (or the word itself) when status is
+ * SERVER_CORRECT or SERVER_CORRECTED, and the original word when status is
+ * SERVER_UNKNOWN. any number of requests may be sent back to back, they
+ * are answered in order
+ */
+
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "list.h"
+#include "libspell.h"
+
+#define SERVER_OP_CHECK 'c'
+#define SERVER_OP_SPELL 's'
+
+#define SERVER_CORRECT   0	// the word is in the dictionary
+#define SERVER_CORRECTED 1	// a correction was found
+#define SERVER_UNKNOWN   2	// the word is misspelled with no correction
+
+// serve requests against 'index' (built once, and kept warm for every
+// client) on a socket bound at 'path' until interrupted (SIGINT or
+// SIGTERM). returns 0 on a clean shutdown
+int run_server(SpellIndex *index, char *path);
+
+// send the words of 'document' to the server at 'path' in batches, using
+// operation 'op', and print the results in the same format as Task 3/4
+// returns 0 on success
+int run_client(char *path, char op, List *document);
+
+// a growable byte buffer, consumed from the front (also used for the
+// frames of the shard processes, see shards.h)
+typedef struct {
+	char *data;
+	size_t len;		// bytes held
+	size_t off;		// bytes already consumed from the front
+	size_t cap;
+} Buffer;
+
+void buffer_reserve(Buffer *buf, size_t extra);
+void buffer_append(Buffer *buf, const void *data, size_t n);
+void buffer_append_u32(Buffer *buf, uint32_t value);
+void buffer_append_word(Buffer *buf, const char *word, size_t n);
+void free_buffer(Buffer *buf);
+
+// write or read exactly 'n' bytes of a blocking file descriptor. returns
+// false on an error, or if the other end hung up first
+bool write_all(int fd, const char *data, size_t n);
+bool read_all(int fd, char *data, size_t n);
+
+#endif
@@ -0,0 +1,601 @@
+/* * * * * * *
+ * Module for a dictionary split between shard processes, and the
+ * coordinator that scatters queries to them and gathers their answers
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "shards.h"
+#include "server.h"
+
+#define MAX_GAP      3		// the largest distance of a correction
+#define MAX_LENGTHS  (SPELL_MAX_WORD_LEN + 2)	// lengths told apart
+#define SHARD_BATCH  1024	// words a shard hands to the library at a time
+#define MAX_PAYLOAD  (64 << 20)	// larger frames mean a broken shard
+
+#define HEADER_LEN   4	// u32 payload length
+#define REQUEST_HEAD 5	// u8 op, u32 nwords
+#define WORD_HEAD    2	// u16 word length
+#define RESULT_HEAD  9	// i32 rank, i32 dist, u8 degraded
+
+// the coordinator's side of one shard process
+typedef struct {
+	pid_t pid;
+	int fd;				// the coordinator's end of the socketpair
+	int lo, hi;			// the shortest and the longest word of the shard
+	uint32_t *ranks;	// the dictionary rank of each of the shard's words
+	uint32_t nwords;
+
+	// the request of the current round, and the batch words it holds
+	Buffer request;
+	int *sent;
+	int nsent;
+} Shard;
+
+struct shards {
+	Shard *shards;
+	int nshards;
+	Buffer response;	// the response being read
+	Buffer text;		// the corrections of the last batch
+	int batch_size;		// room in every shard's 'sent'
+};
+
+// the best answer for one word of a batch so far
+typedef struct {
+	int rank;		// in the whole dictionary, or SPELL_NONE
+	int dist;		// or SPELL_NONE
+	size_t at;		// where its word starts in the text of the batch
+	size_t len;
+	int degraded;	// a shard ran out of budget on the word
+} Best;
+
+/*----------------------------------------------------------------------*/
+/* HELPER FUNCTION PROTOTYPES */
+int split_lengths(List *dictionary, int nshards, int *lo, int *hi);
+void run_shard(List *dictionary, int lo, int hi, const SpellOptions *options,
+	int fd);
+bool answer_shard_request(SpellIndex *index, const char *payload,
+	size_t plen, Buffer *out);
+bool rank_shards(Shards *shards, int nwords);
+int length_gap(Shard *shard, size_t len);
+bool can_beat(Shard *shard, int gap, Best *best);
+void add_to_request(Shards *shards, Shard *shard, char op, int i,
+	const SpellWord *word);
+bool exchange(Shards *shards, Best *best);
+bool scatter_gather(Shards *shards, char op, const SpellWord *words,
+	int nwords, Best *best);
+bool read_frame(int fd, Buffer *buf, uint32_t *plen);
+
+/*----------------------------------------------------------------------*/
+/* STARTING AND STOPPING SHARDS */
+
+Shards *start_shards(List *dictionary, int nshards,
+		const SpellOptions *options) {
+	int lo[MAX_LENGTHS], hi[MAX_LENGTHS];
+	int s, t, fds[2];
+
+	if (nshards > MAX_LENGTHS) {
+		nshards = MAX_LENGTHS;
+	}
+	Shards *shards = calloc(1, sizeof *shards);
+	assert(shards);
+	shards->nshards = split_lengths(dictionary, nshards, lo, hi);
+	shards->shards = calloc(shards->nshards ? shards->nshards : 1,
+		sizeof(Shard));
+	assert(shards->shards);
+
+	// a shard that dies shows up as a failed read or write, not a signal
+	signal(SIGPIPE, SIG_IGN);
+	fflush(stdout);
+	fflush(stderr);
+
+	for (s = 0; s < shards->nshards; s++) {
+		Shard *shard = &shards->shards[s];
+		shard->lo = lo[s];
+		shard->hi = hi[s];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+			perror("error creating shard socket");
+			shards->nshards = s;
+			stop_shards(shards);
+			return NULL;
+		}
+		shard->pid = fork();
+		if (shard->pid < 0) {
+			perror("error starting shard process");
+			close(fds[0]);
+			close(fds[1]);
+			shards->nshards = s;
+			stop_shards(shards);
+			return NULL;
+		}
+		if (shard->pid == 0) {
+			// the shard only keeps its own end of its own socket, so
+			// that every other shard sees the coordinator hang up
+			for (t = 0; t < s; t++) {
+				close(shards->shards[t].fd);
+			}
+			close(fds[0]);
+			run_shard(dictionary, lo[s], hi[s], options, fds[1]);
+			_exit(EXIT_SUCCESS);
+		}
+		close(fds[1]);
+		shard->fd = fds[0];
+	}
+
+	if (!rank_shards(shards, dictionary->size)) {
+		fprintf(stderr, "error: a shard process failed to start\n");
+		stop_shards(shards);
+		return NULL;
+	}
+	return shards;
+}
+
+void stop_shards(Shards *shards) {
+	int s;
+	// closing its socket tells a shard to exit
+	for (s = 0; s < shards->nshards; s++) {
+		close(shards->shards[s].fd);
+	}
+	for (s = 0; s < shards->nshards; s++) {
+		Shard *shard = &shards->shards[s];
+		waitpid(shard->pid, NULL, 0);
+		free(shard->ranks);
+		free(shard->sent);
+		free_buffer(&shard->request);
+	}
+	free_buffer(&shards->response);
+	free_buffer(&shards->text);
+	free(shards->shards);
+	free(shards);
+}
+
+int shards_count(Shards *shards) {
+	return shards->nshards;
+}
+
+/* Splits the word lengths of 'dictionary' into (up to) 'nshards' ranges
+ * [lo[s], hi[s]], in increasing order, holding about as many words each:
+ * a range ends once the words up to it make up their share of the whole.
+ * returns how many ranges there are (none for an empty dictionary)
+ */
+int split_lengths(List *dictionary, int nshards, int *lo, int *hi) {
+	long counts[MAX_LENGTHS] = { 0 }, total = 0, seen = 0;
+	int len, n = 0;
+
+	Node *curr_node;
+	for (curr_node = dictionary->head; curr_node;
+			curr_node = curr_node->next) {
+		len = strlen(curr_node->data);
+		counts[len < MAX_LENGTHS ? len : MAX_LENGTHS - 1]++;
+		total++;
+	}
+	for (len = 0; len < MAX_LENGTHS; len++) {
+		if (counts[len] == 0) {
+			continue;
+		}
+		if (n == 0 || seen >= total * n / nshards) {
+			lo[n++] = len;
+		}
+		hi[n - 1] = len;
+		seen += counts[len];
+	}
+	// the last range takes in any longer word too
+	if (n > 0) {
+		hi[n - 1] = hi[n - 1] == MAX_LENGTHS - 1 ? INT32_MAX : hi[n - 1];
+	}
+	return n;
+}
+
+/*----------------------------------------------------------------------*/
+/* SHARD PROCESSES */
+
+/* The whole life of a shard process: index the words of 'dictionary' of
+ * 'lo' to 'hi' letters, tell the coordinator where each one first occurs,
+ * and answer its requests until it hangs up
+ */
+void run_shard(List *dictionary, int lo, int hi, const SpellOptions *options,
+		int fd) {
+	int i, j, n = 0, nbatch, ranks[SHARD_BATCH];
+	uint32_t position = 0, ndistinct = 0;
+
+	SpellWord *words = malloc(sizeof(SpellWord) * (dictionary->size + 1));
+	uint32_t *positions = malloc(sizeof(uint32_t) * (dictionary->size + 1));
+	assert(words && positions);
+	Node *curr_node;
+	for (curr_node = dictionary->head; curr_node;
+			curr_node = curr_node->next, position++) {
+		int len = strlen(curr_node->data);
+		if (len >= lo && len <= hi) {
+			words[n].ptr = curr_node->data;
+			words[n].len = len;
+			positions[n++] = position;
+		}
+	}
+
+	SpellIndex *index = spell_index_build_threads(words, n, options->threads);
+	SpellOptions shard_options = *options;
+	shard_options.memo = NULL;
+	spell_index_configure(index, &shard_options);
+
+	// a word is the first occurrence of its text if its rank is the next
+	// one: the positions of those, in rank order, overwrite the list
+	for (i = 0; i < n; i += SHARD_BATCH) {
+		nbatch = n - i < SHARD_BATCH ? n - i : SHARD_BATCH;
+		spell_check_batch(index, words + i, nbatch, ranks);
+		for (j = 0; j < nbatch; j++) {
+			if (ranks[j] == (int)ndistinct) {
+				positions[ndistinct++] = positions[i + j];
+			}
+		}
+	}
+	free(words);
+
+	bool ok = write_all(fd, (char *)&ndistinct, sizeof ndistinct)
+		&& write_all(fd, (char *)positions, sizeof(uint32_t) * ndistinct);
+	free(positions);
+
+	Buffer request = { 0 }, response = { 0 };
+	uint32_t plen;
+	while (ok && read_frame(fd, &request, &plen)) {
+		response.len = 0;
+		ok = answer_shard_request(index, request.data, plen, &response)
+			&& write_all(fd, response.data, response.len);
+	}
+
+	free_buffer(&request);
+	free_buffer(&response);
+	spell_index_free(index);
+	close(fd);
+}
+
+/* Answers the request 'payload' of 'plen' bytes against the shard's index,
+ * appending the response frame to 'out'. returns false if it is malformed
+ */
+bool answer_shard_request(SpellIndex *index, const char *payload,
+		size_t plen, Buffer *out) {
+	SpellWord words[SHARD_BATCH];
+	SpellResult results[SHARD_BATCH];
+	int ranks[SHARD_BATCH];
+	uint32_t nwords, i;
+	uint16_t len;
+	int j, nbatch = 0;
+
+	if (plen < REQUEST_HEAD) {
+		return false;
+	}
+	char op = payload[0];
+	if (op != SHARDS_OP_CHECK && op != SHARDS_OP_SPELL) {
+		return false;
+	}
+	memcpy(&nwords, payload + 1, sizeof nwords);
+
+	// room for the header, filled in once the size is known
+	buffer_append_u32(out, 0);
+
+	size_t pos = REQUEST_HEAD;
+	for (i = 0; i < nwords; i++) {
+		if (pos + WORD_HEAD > plen) {
+			return false;
+		}
+		memcpy(&len, payload + pos, sizeof len);
+		pos += WORD_HEAD;
+		if (pos + len > plen) {
+			return false;
+		}
+		words[nbatch].ptr = payload + pos;
+		words[nbatch].len = len;
+		nbatch++;
+		pos += len;
+
+		if (nbatch < SHARD_BATCH && i + 1 < nwords) {
+			continue;
+		}
+		if (op == SHARDS_OP_CHECK) {
+			spell_check_batch(index, words, nbatch, ranks);
+		} else {
+			spell_correct_batch(index, words, nbatch, results);
+		}
+		for (j = 0; j < nbatch; j++) {
+			int32_t rank = op == SHARDS_OP_CHECK ? ranks[j] : results[j].rank;
+			int32_t dist = op == SHARDS_OP_CHECK ? 0 : results[j].dist;
+			uint8_t degraded = op == SHARDS_OP_SPELL && results[j].degraded;
+			buffer_append(out, &rank, sizeof rank);
+			buffer_append(out, &dist, sizeof dist);
+			buffer_append(out, &degraded, sizeof degraded);
+			if (op == SHARDS_OP_SPELL && results[j].word) {
+				buffer_append_word(out, results[j].word, results[j].len);
+			} else {
+				buffer_append_word(out, "", 0);
+			}
+		}
+		nbatch = 0;
+	}
+
+	uint32_t rlen = out->len - HEADER_LEN;
+	memcpy(out->data, &rlen, sizeof rlen);
+	return true;
+}
+
+/* Reads the next frame from 'fd' into 'buf' (from its start), and its
+ * payload length into '*plen'. returns false at the end of the input, or
+ * on an error
+ */
+bool read_frame(int fd, Buffer *buf, uint32_t *plen) {
+	if (!read_all(fd, (char *)plen, sizeof *plen) || *plen > MAX_PAYLOAD) {
+		return false;
+	}
+	buf->len = buf->off = 0;
+	buffer_reserve(buf, *plen);
+	buf->len = *plen;
+	return read_all(fd, buf->data, *plen);
+}
+
+/*----------------------------------------------------------------------*/
+/* RANKS */
+
+/* Reads where the first occurrence of each word of every shard is in the
+ * dictionary (of 'nwords' words), and ranks them: the rank of a word is
+ * the number of first occurrences before its own, across all the shards.
+ * returns false if a shard failed
+ */
+bool rank_shards(Shards *shards, int nwords) {
+	size_t nblocks = (size_t)nwords / 64 + 1, b;
+	uint64_t *first = calloc(nblocks, sizeof(uint64_t));
+	uint32_t *before = malloc(sizeof(uint32_t) * nblocks);
+	assert(first && before);
+	uint32_t i, p;
+	int s;
+	bool ok = true;
+
+	for (s = 0; ok && s < shards->nshards; s++) {
+		Shard *shard = &shards->shards[s];
+		ok = read_all(shard->fd, (char *)&shard->nwords, sizeof(uint32_t))
+			&& shard->nwords <= (uint32_t)nwords;
+		if (!ok) {
+			break;
+		}
+		shard->ranks = malloc(sizeof(uint32_t) * (shard->nwords + 1));
+		assert(shard->ranks);
+		ok = read_all(shard->fd, (char *)shard->ranks,
+			sizeof(uint32_t) * shard->nwords);
+		for (i = 0; ok && i < shard->nwords; i++) {
+			p = shard->ranks[i];
+			ok = p < (uint32_t)nwords;
+			if (ok) {
+				first[p / 64] |= (uint64_t)1 << (p % 64);
+			}
+		}
+	}
+
+	// the first occurrences before each block of 64 positions
+	uint32_t count = 0;
+	for (b = 0; b < nblocks; b++) {
+		before[b] = count;
+		count += __builtin_popcountll(first[b]);
+	}
+	for (s = 0; ok && s < shards->nshards; s++) {
+		Shard *shard = &shards->shards[s];
+		for (i = 0; i < shard->nwords; i++) {
+			p = shard->ranks[i];
+			shard->ranks[i] = before[p / 64] + __builtin_popcountll(
+				first[p / 64] & (((uint64_t)1 << (p % 64)) - 1));
+		}
+	}
+	free(first);
+	free(before);
+	return ok;
+}
+
+/*----------------------------------------------------------------------*/
+/* SCATTERING AND GATHERING */
+
+/* How many letters a word of 'len' letters is away from the lengths of a
+ * shard: none if they take it in
+ */
+int length_gap(Shard *shard, size_t len) {
+	if ((long)len < shard->lo) {
+		return shard->lo - (long)len;
+	}
+	if ((long)len > shard->hi) {
+		return (long)len - shard->hi;
+	}
+	return 0;
+}
+
+/* Returns whether a shard 'gap' letters away might hold a better answer
+ * than 'best': each of its words is at least 'gap' edits away, and ranked
+ * no earlier than its first
+ */
+bool can_beat(Shard *shard, int gap, Best *best) {
+	if (gap > MAX_GAP || shard->nwords == 0) {
+		return false;
+	}
+	if (best->dist == SPELL_NONE) {
+		return true;
+	}
+	return gap < best->dist
+		|| (gap == best->dist && shard->ranks[0] < (uint32_t)best->rank);
+}
+
+/* Adds word 'i' of the batch to a shard's request of this round
+ */
+void add_to_request(Shards *shards, Shard *shard, char op, int i,
+		const SpellWord *word) {
+	if (shard->nsent == 0) {
+		shard->request.len = 0;
+		buffer_append_u32(&shard->request, 0);
+		buffer_append(&shard->request, &op, 1);
+		buffer_append_u32(&shard->request, 0);
+	}
+	if (!shard->sent) {
+		shard->sent = malloc(sizeof(int) * shards->batch_size);
+		assert(shard->sent);
+	}
+	buffer_append_word(&shard->request, word->ptr, word->len);
+	shard->sent[shard->nsent++] = i;
+}
+
+/* Sends every shard its request of this round, then reads every response,
+ * keeping any answer better than the best so far. returns false if a shard
+ * failed
+ */
+bool exchange(Shards *shards, Best *best) {
+	int s, j;
+	bool ok = true;
+
+	// every request goes out before any response is read, so the shards
+	// all work at once
+	for (s = 0; ok && s < shards->nshards; s++) {
+		Shard *shard = &shards->shards[s];
+		if (shard->nsent == 0) {
+			continue;
+		}
+		uint32_t plen = shard->request.len - HEADER_LEN;
+		uint32_t nsent = shard->nsent;
+		memcpy(shard->request.data, &plen, sizeof plen);
+		memcpy(shard->request.data + HEADER_LEN + 1, &nsent, sizeof nsent);
+		ok = write_all(shard->fd, shard->request.data, shard->request.len);
+	}
+
+	for (s = 0; ok && s < shards->nshards; s++) {
+		Shard *shard = &shards->shards[s];
+		if (shard->nsent == 0) {
+			continue;
+		}
+		uint32_t plen;
+		ok = read_frame(shard->fd, &shards->response, &plen);
+		const char *payload = shards->response.data;
+		size_t pos = 0;
+
+		for (j = 0; ok && j < shard->nsent; j++) {
+			int32_t rank, dist;
+			uint16_t len;
+			ok = pos + RESULT_HEAD + WORD_HEAD <= plen;
+			if (!ok) {
+				break;
+			}
+			memcpy(&rank, payload + pos, sizeof rank);
+			memcpy(&dist, payload + pos + 4, sizeof dist);
+			Best *word = &best[shard->sent[j]];
+			word->degraded |= payload[pos + 8];
+			memcpy(&len, payload + pos + RESULT_HEAD, sizeof len);
+			pos += RESULT_HEAD + WORD_HEAD;
+			ok = pos + len <= plen && rank < (int32_t)shard->nwords;
+			if (!ok || rank < 0) {
+				pos += len;
+				continue;
+			}
+
+			// the lowest distance wins, and then the earliest rank
+			int global = shard->ranks[rank];
+			if (word->dist == SPELL_NONE || dist < word->dist
+					|| (dist == word->dist && global < word->rank)) {
+				word->rank = global;
+				word->dist = dist;
+				word->at = shards->text.len;
+				word->len = len;
+				buffer_reserve(&shards->text, len + 1);
+				memcpy(shards->text.data + shards->text.len, payload + pos,
+					len);
+				shards->text.data[shards->text.len + len] = '\0';
+				shards->text.len += len + 1;
+			}
+			pos += len;
+		}
+		shard->nsent = 0;
+	}
+	if (!ok) {
+		fprintf(stderr, "error: lost a shard process\n");
+	}
+	return ok;
+}
+
+/* Runs the rounds of a batch: every word goes to the shards 0, 1, 2 and
+ * then 3 letters away (only the first for 'check'), as long as they can
+ * still beat its best answer so far
+ */
+bool scatter_gather(Shards *shards, char op, const SpellWord *words,
+		int nwords, Best *best) {
+	int i, s, gap;
+	int max_gap = op == SHARDS_OP_CHECK ? 0 : MAX_GAP;
+
+	if (nwords > shards->batch_size) {
+		// every shard's list of sent words grows to the new batch size
+		for (s = 0; s < shards->nshards; s++) {
+			free(shards->shards[s].sent);
+			shards->shards[s].sent = NULL;
+		}
+		shards->batch_size = nwords;
+	}
+	shards->text.len = shards->text.off = 0;
+	for (i = 0; i < nwords; i++) {
+		Best none = { SPELL_NONE, SPELL_NONE, 0, 0, 0 };
+		best[i] = none;
+	}
+
+	for (gap = 0; gap <= max_gap; gap++) {
+		bool any = false;
+		for (i = 0; i < nwords; i++) {
+			for (s = 0; s < shards->nshards; s++) {
+				Shard *shard = &shards->shards[s];
+				if (length_gap(shard, words[i].len) == gap
+						&& can_beat(shard, gap, &best[i])) {
+					add_to_request(shards, shard, op, i, &words[i]);
+					any = true;
+				}
+			}
+		}
+		if (any && !exchange(shards, best)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool shards_check_batch(Shards *shards, const SpellWord *words, int nwords,
+		int *ranks) {
+	Best *best = malloc(sizeof(Best) * (nwords + 1));
+	assert(best);
+	int i;
+
+	bool ok = scatter_gather(shards, SHARDS_OP_CHECK, words, nwords, best);
+	for (i = 0; ok && i < nwords; i++) {
+		ranks[i] = best[i].rank;
+	}
+	free(best);
+	return ok;
+}
+
+bool shards_correct_batch(Shards *shards, const SpellWord *words,
+		int nwords, SpellResult *results) {
+	Best *best = malloc(sizeof(Best) * (nwords + 1));
+	assert(best);
+	int i;
+
+	bool ok = scatter_gather(shards, SHARDS_OP_SPELL, words, nwords, best);
+	// the text has stopped moving now
+	for (i = 0; ok && i < nwords; i++) {
+		results[i].rank = best[i].rank;
+		results[i].dist = best[i].dist;
+		results[i].word = best[i].rank == SPELL_NONE ? NULL
+			: shards->text.data + best[i].at;
+		results[i].len = best[i].len;
+		results[i].degraded = best[i].degraded;
+	}
+	free(best);
+	return ok;
+}
@@ -0,0 +1,69 @@
+/* * * * * * *
+ * Module for a dictionary split between shard processes: the words are
+ * split into ranges of lengths holding about as many words each, and each
+ * range is indexed by a worker process of its own (forked, and talked to
+ * over a socketpair), so that no one process holds the whole index
+ *
+ * a coordinator sends the document words out a batch at a time, and keeps
+ * the best answer of each by (distance, rank). a word is sent first to the
+ * shard whose lengths take in its own, and then to those g letters away,
+ * for g = 1, 2 and 3 in turn. the words of a shard g letters away are all
+ * at least g edits away, so a shard is only sent the words it can still
+ * beat: those whose best answer so far is further than g edits away, or
+ * exactly g away and later in the dictionary than the shard's first word.
+ * an exact lookup only ever goes to a single shard
+ *
+ * every word keeps its rank in the whole dictionary: a shard indexes its
+ * words in dictionary order, and tells the coordinator where the first
+ * occurrence of each one is in the dictionary, from which it is ranked
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ *
+ * protocol (all integers in host byte order, over each shard's socket):
+ *   ranks:    u32 nwords | nwords * u32 position (sent once, when built)
+ *   request:  u32 payload length | u8 op | u32 nwords | nwords * word
+ *   response: u32 payload length | nwords * (i32 rank, i32 dist,
+ *             u8 degraded, word)
+ *   word:     u16 length | length bytes (no terminating '\0')
+ *
+ * op is SHARDS_OP_CHECK (Task 3: the rank only, with distance 0 and an
+ * empty word) or SHARDS_OP_SPELL (Task 4: the correction). ranks are the
+ * shard's own, and -1 when there is no word
+ */
+
+#ifndef SHARDS_H
+#define SHARDS_H
+
+#include <stdbool.h>
+
+#include "list.h"
+#include "libspell.h"
+
+#define SHARDS_OP_CHECK 'c'
+#define SHARDS_OP_SPELL 's'
+
+typedef struct shards Shards;
+
+// split the words of 'dictionary' between (up to) 'nshards' shard
+// processes, each indexing its words with 'options' (but no memo file),
+// and wait for them all to be built. returns NULL, with a message on
+// stderr, if one of them can't be started
+Shards *start_shards(List *dictionary, int nshards,
+	const SpellOptions *options);
+
+// stop the shard processes, and wait for them to exit
+void stop_shards(Shards *shards);
+
+// the number of shard processes running (fewer than asked for if there
+// are fewer word lengths in the dictionary)
+int shards_count(Shards *shards);
+
+// spell_check_batch() and spell_correct_batch() over the whole dictionary.
+// the words of the corrections belong to 'shards', until its next batch.
+// return false, with a message on stderr, if a shard process failed
+bool shards_check_batch(Shards *shards, const SpellWord *words, int nwords,
+	int *ranks);
+bool shards_correct_batch(Shards *shards, const SpellWord *words,
+	int nwords, SpellResult *results);
+
+#endif
@@ -11,19 +11,25 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
 #include <assert.h>
 
 #include "spell.h"
-#include "hashtbl.h"
+#include "libspell.h"
+#include "pipeline.h"
+#include "tokens.h"
+#include "join.h"
+#include "align.h"
+#include "shards.h"
 
-#define DEF_FREQ 1	// sets a default frequency for the hash table
+#define BATCH_SIZE 1024	// document words handed to the library at a time
+#define TABLE_CELLS (1 << 22)	// largest Task 1 table allocated whole
 
-// store important values of a possible corrected word, for Task 4
-typedef struct {
-	char *word;	
-	int pos;	// stores the position of the corrected word in the dictionary
-	int corr;	// flag that indicates whether a corrected word is found
-} possibleword;
+// settings for the indexes built by the tasks (set from the command line)
+SpellOptions spell_options = SPELL_DEFAULT_OPTIONS;
+const char *spell_base = NULL;
+const char *spell_overlay = NULL;
 
 /*----------------------------------------------------------------------*/
 /* DEFINING FUNCTIONS */
@@ -31,16 +37,17 @@ typedef struct {
 
 /*----------------------------------------------------------------------*/
 /* HELPER FUNCTION PROTOTYPES */
-List *generate_edit(char *word);
-void correction_hash(List *editlist, HashTable *table, possibleword *cword);
-void correction_lookup(List *dictionary, char *wword, possibleword *cword, int edist);
-void free_editword(List *editlist);
-int editdistance(char *word1, char *word2, int editd);
+int next_batch(Node **curr_node, SpellWord *words);
+void read_overlay(SpellIndex *index, const char *path);
+bool match_case(const char *original, size_t len, const char *word,
+	char *out);
+char **list_words(List *list, int *nwords);
 
 /*----------------------------------------------------------------------*/
 /* TASK 1 */
 /* Finds the minimum Levenshtein edit distance between 'word1' 
  * and 'word2', through substitutions, deletions or insertions
+ * (and transpositions of adjacent letters, if they are switched on)
  */
 void print_edit_distance(char *word1, char *word2) {
 	int n=strlen(word1);
@@ -49,6 +56,13 @@ void print_edit_distance(char *word1, char *word2) {
 	int i, j, sub_cost=0;
 	int edist;
 
+	// a table too large to allocate whole is filled in a column at a time
+	if ((size_t)(n+1)*(m+1) > TABLE_CELLS) {
+		printf("%ld\n", align_distance(word1, n, word2, m,
+			spell_options.transpositions));
+		return;
+	}
+
 	// allocating memory for the 2D array
 	edit = (int **)malloc(sizeof(int*)*(n+1));
 	assert(edit);
@@ -80,6 +94,12 @@ void print_edit_distance(char *word1, char *word2) {
 			// finding the minimum edit distance 
 			// either by substitution, insertion or deletion
 			edist = MIN(edit[i-1][j-1]+sub_cost, MIN(edit[i-1][j] + 1, edit[i][j-1] + 1));
+
+			// or by swapping two adjacent letters (optimal string alignment)
+			if (spell_options.transpositions && i>1 && j>1
+					&& word1[i-1]==word2[j-2] && word1[i-2]==word2[j-1]) {
+				edist = MIN(edist, edit[i-2][j-2] + 1);
+			}
 			edit[i][j]=edist;
 		}
 	}
@@ -92,10 +112,18 @@ void print_edit_distance(char *word1, char *word2) {
 	free(edit);
 }
 
+/* Task 1, followed by a script of the edits turning 'word1' into 'word2'
+ * (see align.h), found in memory linear in their lengths
+ */
+void print_edit_script(char *word1, char *word2) {
+	print_alignment(word1, strlen(word1), word2, strlen(word2),
+		spell_options.transpositions, stdout);
+}
+
 /*----------------------------------------------------------------------*/
 /* TASK 2 */
 /* Enumerating all possible edits within a Levenshtein edit distance
- * of 1 from 'word'
+ * of 1 from 'word' (plus the n-1 transpositions, if switched on)
  */
 void print_all_edits(char *word) {
 	char *ALPHAB="abcdefghijklmnopqrstuvwxyz";
@@ -122,6 +150,11 @@ void print_all_edits(char *word) {
 			printf("\n");
 		}
 	}
+	// through transposition of adjacent letters, if switched on
+	for (i=0; spell_options.transpositions && i<n-1; i++) {
+		printf("%.*s%c%c%.*s", i, word, word[i+1], word[i], n-i-2, word+i+2);
+		printf("\n");
+	}
 }
 
 /*----------------------------------------------------------------------*/
@@ -130,40 +163,33 @@ void print_all_edits(char *word) {
  * that is, if it's a correctly spelled word
  */
 void print_checked(List *dictionary, List *document) {
-	char *word;
+	int ranks[BATCH_SIZE];
+	SpellWord words[BATCH_SIZE];
+	int i, nwords;
 
-	// initialise hash table
-	HashTable *table = new_hash_table(dictionary->size);
+	// store the dictionary inside a hash table (or map a base index)
+	SpellIndex *index = open_spell_index(dictionary);
 
-	// store the dictionary inside a hash table
-	Node *curr_node = dictionary->head;
+	// search whether the document words are inside the dictionary,
+	// a batch at a time
+	Node *curr_node = document->head;
 	while (curr_node) {
-		word = curr_node->data;
+		nwords = next_batch(&curr_node, words);
+		spell_check_batch(index, words, nwords, ranks);
 
-		// checks if the word already exists in the hash table
-		if (! hash_table_has(table, word)) {
-			hash_table_put(table, curr_node->data, DEF_FREQ);
-		}
-		// skips if the word already exists
-		curr_node = curr_node->next;
-	}
-
-	// search whether the document words are inside the dictionary
-	curr_node = document->head;
-	while (curr_node) {
-		word = curr_node->data;
-		if (hash_table_has(table, word)) {
-			printf("%s\n", word);
-		}
-		// the word is incorrectly spelled
-		else {
-			printf("%s?\n", word);
+		for (i=0; i<nwords; i++) {
+			if (ranks[i] != SPELL_NONE) {
+				printf("%s\n", words[i].ptr);
+			}
+			// the word is incorrectly spelled
+			else {
+				printf("%s?\n", words[i].ptr);
+			}
 		}
-		curr_node = curr_node->next;
 	}
 
 	// frees all the memory, halleluya!
-	free_hash_table(table);
+	spell_index_free(index);
 }
 
 /*----------------------------------------------------------------------*/
@@ -173,264 +199,413 @@ void print_checked(List *dictionary, List *document) {
  * with a Levenshtein edit distance of 1, 2 or 3
  */
 void print_corrected(List *dictionary, List *document) {
-	char *word;
-	int order=0;
-
-	// initialise hash table
-	HashTable *table = new_hash_table(dictionary->size);
+	SpellResult results[BATCH_SIZE];
+	SpellWord words[BATCH_SIZE];
+	int i, nwords, total=0, ndegraded=0;
 
 	// create a hash table to store the dictionary words
-	Node *curr_node = dictionary->head;
-	while (curr_node) {
-		word = curr_node->data;
-
-		// checks if the word already exists in the hash table
-		if (! hash_table_has(table, word)) {
-			hash_table_put(table, curr_node->data, order);
-			order++;
-		}
-		// skips if the word already exists
-		curr_node = curr_node->next;
-	}
-
-	// initialise some variables
-	possibleword cword;
-	cword.corr=0;
-	cword.pos=dictionary->size;
-	char *wword, *word2, *finalword;
-	List *editlist1, *editlist2;
-	Node *curr_edit1;
+	SpellIndex *index = open_spell_index(dictionary);
 
 	// search for a corrected word for every word in the document
-	curr_node = document->head;
+	Node *curr_node = document->head;
 	while (curr_node) {
-		cword.corr=0;
-		cword.pos=dictionary->size;
-		wword = curr_node->data;
-
-		//--- CASE 1: Correctly spelled word ---//
-		if (hash_table_has(table, wword)) {
-			// stores the final corrected word
-			finalword=hash_table_get_key(table, wword);
-			cword.corr=1;
-		}
+		nwords = next_batch(&curr_node, words);
+		spell_correct_batch(index, words, nwords, results);
 
-		//--- CASE 2: One edit-distance away ---//
-		if (!cword.corr) {
-			// generate the list of 1 edit distance words
-			editlist1 = generate_edit(wword);
-		
-			// searches for the corrected version of the word
-			correction_hash(editlist1, table, &cword);
-			
-			// stores the final corrected word
-			if (cword.corr) {
-				finalword = cword.word;
+		// prints the corrected word
+		for (i=0; i<nwords; i++) {
+			if (results[i].word) {
+				printf("%s\n", results[i].word);
 			}
-
-			//--- CASE 3: Two edit-distance away ---//
-			if (!cword.corr) {				
-				curr_edit1 = editlist1->head;
-
-				// for each 1 edit dist word, search for another 1 edit dist words
-				while (curr_edit1) {
-					word2 = curr_edit1->data;
-
-					// generate the list of 2 edit distance words
-					editlist2 = generate_edit(word2);
-					
-					// searches for the corrected version of the word
-					correction_hash(editlist2, table, &cword);
-				
-					// stores the final corrected word
-					if (cword.corr) {
-						finalword = cword.word;
-					}
-					// frees the list everytime it's generated, awesome!
-					free_editword(editlist2);
-					free_list(editlist2);
-					curr_edit1 = curr_edit1->next;
-				}
+			else {
+				printf("%s?\n", words[i].ptr);
 			}
-			// keeps on free-ing memories, hooray!
-			free_editword(editlist1);
-			free_list(editlist1);
-		}
 
-		//--- CASE 4: Three edit-distance away ---//
-		if (!cword.corr) {
-			// perform a direct lookup
-			correction_lookup(dictionary, wword, &cword, 3);
-			// stores the final corrected word
-			if (cword.corr) {
-				finalword=cword.word;
+			// words that ran out of budget are listed on stderr
+			if (results[i].degraded) {
+				fprintf(stderr, "degraded: %s\n", words[i].ptr);
+				ndegraded++;
 			}
 		}
-
-		// prints the corrected word
-		if (cword.corr) {
-			printf("%s\n", finalword);
-		}
-		else {
-			printf("%s?\n", wword);
-		}
-		curr_node = curr_node->next;
+		total += nwords;
+	}
+	if (spell_options.word_budget || spell_options.doc_budget) {
+		fprintf(stderr, "budget: %d of %d words degraded\n", ndegraded,
+			total);
 	}
 
 	// frees the memory allocated for the huge table, yippee!
-	free_hash_table(table);
+	spell_index_free(index);
 }
 
 /*----------------------------------------------------------------------*/
-/* SOME HELPER FUNCTIONS */
-
+/* BULK TASK 1 / TASK 2 */
+/* Task 1 for every pair of words (op 'd'), or Task 2 for every word (op
+ * 'e'), one per line of 'input', through a pipeline of 'nworkers' workers
+ * with 'depth' blocks in flight (0 for the default). the output goes out
+ * in the order of the input, in large writes
+ * returns 0, or -1 if the input could not be read or the output written
+ */
+int print_bulk(FILE *input, char op, int nworkers, int depth) {
+	PipelineOptions options = { nworkers, depth,
+		spell_options.transpositions };
+	PipelineStats stats;
+
+	fflush(stdout);
+	return run_pipeline(NULL, op, fileno(input), fileno(stdout), &options,
+		&stats);
+}
 
-/* Finds the corrected word that shows first in the dictionary, by comparing 
- * a list of 1 edit distance words to a hash table of dictionary words  
+/*----------------------------------------------------------------------*/
+/* SIMILARITY JOIN */
+/* Every pair of a word of 'left' and a word of 'right' within edit
+ * distance k, as "left right distance" lines in the order of 'right' (and
+ * then of 'left'), with the right words split between 'nthreads' threads
  */
-void correction_hash(List *editlist, HashTable *table, possibleword *cword) {
-	Node *curr_word=editlist->head;
-	while (curr_word) {
-
-		// a corrected word is found
-		if (hash_table_has(table, curr_word->data)) {
-
-			// finds the corrected word that shows up first in the dictionary
-			if (hash_table_get_val(table, curr_word->data) <= cword->pos) {
-				// store some values of the corrected word
-				cword->word = hash_table_get_key(table, curr_word->data);
-				cword->pos = hash_table_get_val(table, curr_word->data);
-				cword->corr=1;
-			}
-		}
-		curr_word = curr_word->next;
+void print_join(List *left, List *right, int k, int nthreads) {
+	int nleft, nright;
+	char **lwords = list_words(left, &nleft);
+	char **rwords = list_words(right, &nright);
+
+	run_join(lwords, nleft, rwords, nright, k,
+		spell_options.transpositions, nthreads, stdout);
+
+	free(lwords);
+	free(rwords);
+}
+
+// the words of 'list' as an array, in order
+char **list_words(List *list, int *nwords) {
+	*nwords = list_size(list);
+	char **words = malloc(sizeof(char *) * (*nwords > 0 ? *nwords : 1));
+	assert(words);
+	Node *curr_node = list->head;
+	int i;
+	for (i = 0; i < *nwords; i++) {
+		words[i] = curr_node->data;
+		curr_node = curr_node->next;
 	}
+	return words;
 }
 
-/* Finds the corrected word that shows first in the dictionary, by iterating 
- * through the whole dictionary and comparing it to the wrong word,
- * with a given specific edit distance
+/*----------------------------------------------------------------------*/
+/* PIPELINED TASK 3 / TASK 4 */
+/* Task 3 or Task 4 (by 'op'), streaming 'document' through a pipeline of
+ * 'nworkers' correction workers with 'depth' blocks in flight (0 for the
+ * default). a budget for the whole document can only be spent in document
+ * order, so it leaves a single worker
+ * returns 0, or -1 if the document could not be read or the output written
  */
-void correction_lookup(List *dictionary, char *wword, possibleword *cword, int edist) {
-	// iterates through the whole dictionary
-	Node *curr_word=dictionary->head;
-	while (curr_word) {
-		
-		// compares it's edit distance
-		if (editdistance(curr_word->data, wword, edist)) {
-			// a corrected word is found
-			cword->word = curr_word->data;
-			cword->corr=1;
-			break;
-		}
-		curr_word = curr_word->next;
+int print_pipelined(List *dictionary, FILE *document, char op, int nworkers,
+		int depth) {
+	PipelineOptions options = { nworkers, depth, 0 };
+	PipelineStats stats;
+
+	if (spell_options.doc_budget) {
+		options.workers = 1;
 	}
+	SpellIndex *index = open_spell_index(dictionary);
+
+	// whatever stdout holds already goes out ahead of the pipeline's output
+	fflush(stdout);
+	int status = run_pipeline(index, op, fileno(document), fileno(stdout),
+		&options, &stats);
+	if (op == PIPELINE_OP_SPELL
+			&& (spell_options.word_budget || spell_options.doc_budget)) {
+		fprintf(stderr, "budget: %ld of %ld words degraded\n", stats.degraded,
+			stats.words);
+	}
+
+	spell_index_free(index);
+	return status;
 }
 
-/* Generates a list of all words that is 1 edit distance away from 'word'
+/*----------------------------------------------------------------------*/
+/* SHARDED TASK 3 / TASK 4 */
+/* Task 3 or Task 4 (by 'op'), with 'dictionary' split between 'nshards'
+ * shard processes by word length, each holding the index of its own words
+ * only, and the document words sent to them a batch at a time
+ * returns 0, or -1 if the shards could not be started or one failed
  */
-List *generate_edit(char *word) {
-	char *ALPHAB="abcdefghijklmnopqrstuvwxyz";
-	int i,j;
-	int n=strlen(word);		
-	int a=strlen(ALPHAB);
+int print_sharded(List *dictionary, List *document, char op, int nshards) {
+	SpellResult results[BATCH_SIZE];
+	SpellWord words[BATCH_SIZE];
+	int ranks[BATCH_SIZE];
+	int i, nwords, total=0, ndegraded=0;
+	bool ok = true;
+
+	// each shard needs the words themselves, and has no memo of its own
+	if (spell_base || spell_overlay || spell_options.memo) {
+		fprintf(stderr, "error: a sharded dictionary can't use a base index, "
+			"overlay or memo file\n");
+		return -1;
+	}
+	Shards *shards = start_shards(dictionary, nshards, &spell_options);
+	if (!shards) {
+		return -1;
+	}
 
-	// create a list of words 
-	List *editlist=new_list();
-	char *editword;
+	Node *curr_node = document->head;
+	while (ok && curr_node) {
+		nwords = next_batch(&curr_node, words);
+		if (op == PIPELINE_OP_CHECK) {
+			ok = shards_check_batch(shards, words, nwords, ranks);
+		} else {
+			ok = shards_correct_batch(shards, words, nwords, results);
+		}
 
-	// through substitution
-	for (i=0; i<n; i++) {
-		for (j=0; j<a; j++) {
-			// allocate enough memory to store the edited word
-			editword = (char *)malloc(sizeof(char)*(strlen(word)+1));
-			assert(editword);
-			sprintf(editword, "%.*s%c%.*s", i, word, ALPHAB[j], n-i-1, word+i+1); 
-			list_add_end(editlist, editword);
+		for (i=0; ok && i<nwords; i++) {
+			if (op == PIPELINE_OP_CHECK) {
+				printf("%s%s\n", words[i].ptr,
+					ranks[i] != SPELL_NONE ? "" : "?");
+				continue;
+			}
+			if (results[i].word) {
+				printf("%s\n", results[i].word);
+			} else {
+				printf("%s?\n", words[i].ptr);
+			}
+			if (results[i].degraded) {
+				fprintf(stderr, "degraded: %s\n", words[i].ptr);
+				ndegraded++;
+			}
 		}
+		total += nwords;
 	}
-	// through deletion
-	for (i=0; i<n; i++) {
-		editword = (char *)malloc(sizeof(char)*(strlen(word)));
-		assert(editword);
-		sprintf(editword, "%.*s%.*s", i, word, n-i-1, word+i+1);
-		list_add_end(editlist, editword);
+	if (ok && op == PIPELINE_OP_SPELL
+			&& (spell_options.word_budget || spell_options.doc_budget)) {
+		fprintf(stderr, "budget: %d of %d words degraded\n", ndegraded,
+			total);
 	}
-	// through insertion
-	for (i=0; i<n+1; i++) {
-		for (j=0; j<a; j++) {
-			editword = (char *)malloc(sizeof(char)*(strlen(word)+2));
-			assert(editword);
-			sprintf(editword, "%.*s%c%.*s", i, word, ALPHAB[j], n-i, word+i);
-			list_add_end(editlist, editword);
+
+	stop_shards(shards);
+	return ok ? 0 : -1;
+}
+
+/*----------------------------------------------------------------------*/
+/* TOP-K SUGGESTIONS */
+/* Prints the 'k' best corrections within edit distance 'maxdist' of every
+ * word inside 'document', best first, as "word: first second ..."
+ */
+void print_suggestions(List *dictionary, List *document, int k, int maxdist) {
+	SpellResult *results = malloc(sizeof(SpellResult)*(k>0 ? k : 1));
+	assert(results);
+	SpellWord word;
+	int i, nfound;
+
+	SpellIndex *index = open_spell_index(dictionary);
+
+	Node *curr_node = document->head;
+	while (curr_node) {
+		word.ptr = curr_node->data;
+		word.len = strlen(curr_node->data);
+		nfound = spell_suggest(index, &word, k, maxdist, results);
+
+		printf("%s:", word.ptr);
+		for (i=0; i<nfound; i++) {
+			printf(" %s", results[i].word);
 		}
+		printf("\n");
+		curr_node = curr_node->next;
 	}
-	return editlist;
+
+	spell_index_free(index);
+	free(results);
 }
 
-/* Frees the memory allocated for the edited words list
+/*----------------------------------------------------------------------*/
+/* CORRECTING PROSE IN PLACE */
+/* Prints the 'len' bytes of prose at 'text' with every misspelled word
+ * that has a correction replaced by it, and every other byte unchanged.
+ * words are looked up folded to lowercase, and their corrections take
+ * the case of the original: all lowercase, capitalised, or all capitals
+ * (a word in any other case, or with non-ASCII letters, is left alone)
  */
-void free_editword(List *editlist) {
-	Node *curr_node = editlist->head;
-	while (curr_node) {	
-		free(curr_node->data);
-		curr_node=curr_node->next;
+void print_fixed(List *dictionary, const char *text, size_t len) {
+	SpellResult results[BATCH_SIZE];
+	SpellWord words[BATCH_SIZE];
+	Token tokens[BATCH_SIZE];
+	char fixed[SPELL_MAX_WORD_LEN + 1];
+	size_t pos=0, done=0, i, ntokens;
+	int nwords;
+
+	SpellIndex *index = open_spell_index(dictionary);
+
+	// a folded copy of the whole text: a word is at the same offset in
+	// both, so the library reads the words straight out of it
+	char *folded = malloc(len > 0 ? len : 1);
+	assert(folded);
+	fold_ascii(text, len, folded);
+
+	while ((ntokens = next_tokens(text, len, &pos, tokens, BATCH_SIZE)) > 0) {
+		nwords = 0;
+		for (i=0; i<ntokens; i++) {
+			if (tokens[i].ascii) {
+				words[nwords].ptr = folded + tokens[i].offset;
+				words[nwords].len = tokens[i].len;
+				nwords++;
+			}
+		}
+		spell_correct_batch(index, words, nwords, results);
+
+		// copy everything up to each corrected word, then the correction
+		nwords = 0;
+		for (i=0; i<ntokens; i++) {
+			if (!tokens[i].ascii) {
+				continue;
+			}
+			SpellResult *result = &results[nwords++];
+			if (result->dist > 0 && result->len <= SPELL_MAX_WORD_LEN
+					&& match_case(text + tokens[i].offset,
+					tokens[i].len, result->word, fixed)) {
+				fwrite(text + done, 1, tokens[i].offset - done, stdout);
+				fputs(fixed, stdout);
+				done = tokens[i].offset + tokens[i].len;
+			}
+		}
 	}
+	fwrite(text + done, 1, len - done, stdout);
+
+	free(folded);
+	spell_index_free(index);
 }
 
-/* Finds the edit distance between 'word1' and 'word2', and checks whether
- * it is equal to the required edit distance 'editd'
+/* Writes 'word' into 'out' in the case of 'original' ('len' bytes):
+ * lowercase, capitalised or all capitals
+ * returns false if 'original' is in none of those cases
  */
-int editdistance(char *word1, char *word2, int editd) {
-	int n=strlen(word1);
-	int m=strlen(word2);
-	int **edit;
-	int i, j, sub_cost=0;
-	int edist, match=0;
+bool match_case(const char *original, size_t len, const char *word,
+		char *out) {
+	size_t i, nupper=0;
+	for (i=0; i<len; i++) {
+		nupper += original[i] >= 'A' && original[i] <= 'Z';
+	}
+	bool first_upper = original[0] >= 'A' && original[0] <= 'Z';
+	bool all_upper = nupper == len && len > 1;
+	if (nupper > 1 && !all_upper) {
+		return false;
+	}
+	if (nupper == 1 && !first_upper) {
+		return false;
+	}
 
-	// allocating memory for the 2D array
-	edit = (int **)malloc(sizeof(int*)*(n+1));
-	assert(edit);
-	for (i=0; i<n+1; i++) {
-		edit[i] = (int *)malloc(sizeof(int)*(m+1));
-		assert(edit[i]);
+	for (i=0; word[i]; i++) {
+		out[i] = word[i];
+		if ((all_upper || (i == 0 && first_upper))
+				&& word[i] >= 'a' && word[i] <= 'z') {
+			out[i] = word[i] - 'a' + 'A';
+		}
 	}
+	out[i] = '\0';
+	return true;
+}
 
-	// fill in the known values for word 1
-	for (i=0; i<n+1; i++) {
-		edit[i][0]=i;
+/*----------------------------------------------------------------------*/
+/* INDEXES */
+/* Builds the index the tasks use: from the words of 'dictionary', or by
+ * mapping the base index file 'spell_base', with the overlay words of
+ * 'spell_overlay' on top, and 'spell_options' applied
+ */
+SpellIndex *open_spell_index(List *dictionary) {
+	SpellIndex *index;
+	if (spell_base) {
+		index = spell_index_open_base(spell_base);
+		if (!index) {
+			exit(EXIT_FAILURE);
+		}
+	} else {
+		index = spell_index_build_list(dictionary, spell_options.threads);
 	}
-	// fill in the known values for word 2
-	for (j=0; j<m+1; j++) {
-		edit[0][j]=j;
+	if (spell_overlay) {
+		read_overlay(index, spell_overlay);
 	}
+	// a memo file that can't be opened only loses its speed-up
+	spell_index_configure(index, &spell_options);
+	return index;
+}
 
-	// fill in the rest of the table
-	for (i=1; i<n+1; i++) {
-		for (j=1; j<m+1; j++) {
-			
-			// determine whether there is a substitute cost
-			if (word1[i-1]==word2[j-1]) {
-				sub_cost=0;
-			} else {
-				sub_cost=1;
-			}
-
-			// finding the minimum edit distance 
-			// either by substitution, insertion or deletion
-			edist = MIN(edit[i-1][j-1]+sub_cost, MIN(edit[i-1][j] + 1, edit[i][j-1] + 1));
-			edit[i][j]=edist;
+/* Adds the words of the overlay file at 'path' to 'index': one word per
+ * line, optionally followed by the base rank it goes before (if not, it
+ * goes after every base word). the words are added all at once, as the
+ * index re-sorts its overlay on every addition
+ */
+void read_overlay(SpellIndex *index, const char *path) {
+	char line[SPELL_MAX_WORD_LEN + 32], word[SPELL_MAX_WORD_LEN + 1];
+	int position, nread, lines_read = 0;
+	int i, nwords = 0, size = BATCH_SIZE;
+
+	SpellWord *words = malloc(sizeof *words * size);
+	int *positions = malloc(sizeof *positions * size);
+	assert(words && positions);
+
+	FILE *file = fopen(path, "r");
+	if (!file) {
+		perror("error opening overlay file");
+		exit(EXIT_FAILURE);
+	}
+	while (fgets(line, sizeof line, file)) {
+		lines_read++;
+		nread = sscanf(line, "%255s %d", word, &position);
+		if (nread < 1) {
+			continue;
+		}
+		if (nread == 1) {
+			position = INT_MAX;
+		}
+		if (position < 0) {
+			fprintf(stderr, "warning: line %d of overlay has a negative "
+				"position. skipped.\n", lines_read);
+			continue;
+		}
+		if (nwords == size) {
+			size *= 2;
+			words = realloc(words, sizeof *words * size);
+			positions = realloc(positions, sizeof *positions * size);
+			assert(words && positions);
 		}
+		char *copy = malloc(strlen(word) + 1);
+		assert(copy);
+		strcpy(copy, word);
+		words[nwords].ptr = copy;
+		words[nwords].len = strlen(word);
+		positions[nwords++] = position;
 	}
+	fclose(file);
 
-	// checks if the edit distance matches the required 'editd'
-	if (edit[n][m]==editd) {
-		match=1;
+	spell_index_add_overlay(index, words, positions, nwords);
+	for (i=0; i<nwords; i++) {
+		free((char *)words[i].ptr);
 	}
-	// frees all the memory allocated, finally!
-	for (i=0; i<n+1; i++) {
-		free(edit[i]);
+	free(words);
+	free(positions);
+}
+
+/* Writes the words of 'dictionary' to 'path' as a base index file, which
+ * the other tasks can then map in place of the dictionary
+ */
+void write_base_index(List *dictionary, char *path) {
+	SpellIndex *index = spell_index_build_list(dictionary,
+		spell_options.threads);
+	int status = spell_index_save_base(index, path);
+	spell_index_free(index);
+	if (status != 0) {
+		exit(EXIT_FAILURE);
 	}
-	free(edit);
-	return match;
-}
\ No newline at end of file
+}
+
+/*----------------------------------------------------------------------*/
+/* SOME HELPER FUNCTIONS */
+
+/* Fills 'words' with up to BATCH_SIZE words of a list, starting from
+ * '*curr_node' and advancing it past them. returns the number of words
+ */
+int next_batch(Node **curr_node, SpellWord *words) {
+	int nwords=0;
+	while (*curr_node && nwords<BATCH_SIZE) {
+		words[nwords].ptr = (*curr_node)->data;
+		words[nwords].len = strlen((*curr_node)->data);
+		nwords++;
+		*curr_node = (*curr_node)->next;
+	}
+	return nwords;
+}
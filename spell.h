@@ -8,7 +8,11 @@
 #ifndef SPELL_H
 #define SPELL_H
 
+#include <stdio.h>
+#include <stddef.h>
+
 #include "list.h"
+#include "libspell.h"
 
 /*                         DO NOT CHANGE THIS FILE
  * 
@@ -32,4 +36,55 @@ void print_checked(List *dictionary, List *document);
 // see Assignment Task 4: Spelling correction
 void print_corrected(List *dictionary, List *document);
 
+// extension: settings used for the dictionary indexes of all tasks
+extern SpellOptions spell_options;
+
+// extension: a base index file that the tasks map instead of indexing the
+// dictionary list (NULL for none), and a file of overlay words to add on
+// top of the dictionary (NULL for none)
+extern const char *spell_base;
+extern const char *spell_overlay;
+
+// extension: the dictionary index used by all tasks, set up from the
+// settings above. exits with a message if one of the files can't be used
+SpellIndex *open_spell_index(List *dictionary);
+
+// extension: Task 1 for each pair of words (op 'd', see pipeline.h), or
+// Task 2 for each word (op 'e'), one per line of 'input', with 'nworkers'
+// workers and 'depth' blocks in flight (0 for the default). returns 0, or
+// -1 on an I/O error
+int print_bulk(FILE *input, char op, int nworkers, int depth);
+
+// extension: Task 1, followed by the edits turning 'word1' into 'word2',
+// a line per run of the same edit (see align.h)
+void print_edit_script(char *word1, char *word2);
+
+// extension: every pair of a word of 'left' and one of 'right' within edit
+// distance k, as "left right distance" lines, in the order of 'right' and
+// then of 'left', found by 'nthreads' threads
+void print_join(List *left, List *right, int k, int nthreads);
+
+// extension: Task 3 or Task 4 (op 'c' or 's', see pipeline.h) with the
+// document streamed through a pipeline of 'nworkers' correction workers and
+// 'depth' blocks in flight (0 for the default). returns 0, or -1 on an I/O
+// error
+int print_pipelined(List *dictionary, FILE *document, char op, int nworkers,
+	int depth);
+
+// extension: Task 3 or Task 4 (op 'c' or 's', see pipeline.h) with
+// 'dictionary' split between 'nshards' shard processes by word length (see
+// shards.h). returns 0, or -1 if a shard could not be started or failed
+int print_sharded(List *dictionary, List *document, char op, int nshards);
+
+// extension: print the 'len' bytes of raw prose at 'text' with each
+// misspelled word replaced by its correction, in the case of the original
+void print_fixed(List *dictionary, const char *text, size_t len);
+
+// extension: write 'dictionary' to 'path' as a base index file
+void write_base_index(List *dictionary, char *path);
+
+// extension: the k best corrections of each word, within edit distance
+// maxdist, ordered by distance and then by dictionary rank
+void print_suggestions(List *dictionary, List *document, int k, int maxdist);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,429 @@
+/* * * * * * *
+ * Module for a string interning arena: every distinct string is stored
+ * exactly once, '\0'-terminated and packed back to back in large blocks,
+ * and is named by a dense 32-bit id
+ *
+ * an arena can also be written out as a flat image, and used read-only
+ * straight from that image once it is mapped back into memory
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "strarena.h"
+#include "hashtbl.h"
+
+#define BLOCK_SIZE (1 << 20)	// bytes per block of packed strings
+
+// 'n' rounded up to a multiple of 8, as every part of an image is
+#define PADDED(N) (((N) + 7) / 8 * 8)
+
+#define COPY_CHUNK 4096	// strings a worker copies before taking more
+
+#define FNV_BASIS 0x811c9dc5u
+#define FNV_PRIME 0x01000193u
+
+// hint that 'addr' will be read soon, if the compiler supports it
+#ifdef __GNUC__
+#define PREFETCH(addr) __builtin_prefetch(addr)
+#else
+#define PREFETCH(addr) ((void)(addr))
+#endif
+
+// strings are packed into a chain of blocks. a block is never moved once
+// allocated, so the hash table can point straight at the stored strings
+typedef struct block Block;
+struct block {
+	Block *prev;
+	size_t size;
+	size_t used;
+	char text[];
+};
+
+struct str_arena {
+	Block *block;		// the block being filled (the latest one)
+	size_t bytes;		// bytes used by the strings, across all blocks
+
+	char **strings;		// the stored strings, indexed by id
+	uint32_t *lens;
+	uint32_t count;
+	uint32_t capacity;
+
+	HashTable *table;	// maps each stored string to its id
+
+	// a mapped arena has none of the above but the count: everything is
+	// read from its image instead
+	const char *text;			// the strings back to back, or NULL
+	const uint32_t *offsets;	// where each string starts (and one past
+								// the last)
+	const uint32_t *slots;		// open addressing: id + 1, or 0 if empty
+	uint32_t mask;				// slots - 1
+};
+
+// strings being copied into their places in the blocks by workers
+typedef struct {
+	StrArena *arena;
+	const char *const *strs;
+	uint32_t first;		// id of the first string
+	uint32_t n;
+	uint32_t next;		// the next chunk to copy
+} BulkCopy;
+
+// the head of an arena image. the offsets, the slots and the text follow
+typedef struct {
+	uint32_t count;
+	uint32_t bits;		// the image has 2^bits slots
+	uint64_t text_len;
+} ImageHead;
+
+/*----------------------------------------------------------------------*/
+/* HELPER FUNCTION PROTOTYPES */
+char *reserve_space(StrArena *arena, size_t n);
+void claim_space(StrArena *arena, size_t n);
+void reserve_ids(StrArena *arena, uint32_t n);
+void bulk_copy_job(void *arg, int worker);
+uint32_t string_hash(const char *str);
+uint32_t mapped_find(StrArena *arena, const char *str);
+bool write_padding(size_t n, FILE *file);
+
+/*----------------------------------------------------------------------*/
+/* ARENA CREATION/DELETION */
+
+StrArena *new_str_arena(int nstrings) {
+	StrArena *arena = malloc(sizeof *arena);
+	assert(arena);
+
+	if (nstrings < 1) {
+		nstrings = 1;
+	}
+	arena->block = NULL;
+	arena->bytes = 0;
+
+	arena->count = 0;
+	arena->capacity = nstrings;
+	arena->strings = malloc(sizeof(char *)*arena->capacity);
+	arena->lens = malloc(sizeof(uint32_t)*arena->capacity);
+	assert(arena->strings && arena->lens);
+
+	// the table stores pointers into the blocks rather than its own copies
+	arena->table = new_hash_table_shared_keys(nstrings);
+	arena->text = NULL;
+	arena->offsets = arena->slots = NULL;
+	arena->mask = 0;
+	return arena;
+}
+
+void free_str_arena(StrArena *arena) {
+	assert(arena != NULL);
+	Block *block = arena->block;
+	while (block) {
+		Block *prev = block->prev;
+		free(block);
+		block = prev;
+	}
+	if (arena->table) {
+		free_hash_table(arena->table);
+	}
+	free(arena->strings);
+	free(arena->lens);
+	free(arena);
+}
+
+/*----------------------------------------------------------------------*/
+/* INTERNING */
+
+/* Returns space for 'n' bytes at the end of the current block, starting a
+ * new block if it is full. the space is only claimed by claim_space()
+ */
+char *reserve_space(StrArena *arena, size_t n) {
+	Block *block = arena->block;
+	if (!block || block->used + n > block->size) {
+		size_t size = n > BLOCK_SIZE ? n : BLOCK_SIZE;
+		block = malloc(sizeof *block + size);
+		assert(block);
+		block->prev = arena->block;
+		block->size = size;
+		block->used = 0;
+		arena->block = block;
+	}
+	return block->text + block->used;
+}
+
+void claim_space(StrArena *arena, size_t n) {
+	arena->block->used += n;
+	arena->bytes += n;
+}
+
+uint32_t str_arena_intern(StrArena *arena, const char *str, size_t len,
+		int *added) {
+	assert(arena->text == NULL);
+
+	// copy the string to the end of the arena first, so that it can be
+	// looked up as a '\0'-terminated string. the copy is only kept if the
+	// string wasn't there already
+	char *copy = reserve_space(arena, len + 1);
+	memcpy(copy, str, len);
+	copy[len] = '\0';
+
+	if (hash_table_has(arena->table, copy)) {
+		if (added) {
+			*added = 0;
+		}
+		return hash_table_get_val(arena->table, copy);
+	}
+	claim_space(arena, len + 1);
+
+	reserve_ids(arena, 1);
+	uint32_t id = arena->count++;
+	arena->strings[id] = copy;
+	arena->lens[id] = len;
+	hash_table_put(arena->table, copy, id);
+
+	if (added) {
+		*added = 1;
+	}
+	return id;
+}
+
+// make room for 'n' more ids
+void reserve_ids(StrArena *arena, uint32_t n) {
+	if (arena->count + n <= arena->capacity) {
+		return;
+	}
+	while (arena->count + n > arena->capacity) {
+		arena->capacity *= 2;
+	}
+	arena->strings = realloc(arena->strings, sizeof(char *)*arena->capacity);
+	arena->lens = realloc(arena->lens, sizeof(uint32_t)*arena->capacity);
+	assert(arena->strings && arena->lens);
+}
+
+uint32_t str_arena_add_all(StrArena *arena, const char *const *strs,
+		const size_t *lens, uint32_t n, Workers *workers) {
+	assert(arena->text == NULL);
+	uint32_t first = arena->count, i;
+
+	// lay the strings out first, where interning them one at a time would
+	// have, and copy them into place after
+	reserve_ids(arena, n);
+	for (i = 0; i < n; i++) {
+		arena->strings[first + i] = reserve_space(arena, lens[i] + 1);
+		arena->lens[first + i] = lens[i];
+		claim_space(arena, lens[i] + 1);
+	}
+	arena->count += n;
+
+	BulkCopy copy = { arena, strs, first, n, 0 };
+	if (workers) {
+		workers_run(workers, bulk_copy_job, &copy);
+	} else {
+		bulk_copy_job(&copy, 0);
+	}
+	hash_table_put_all(arena->table, arena->strings + first, n, first,
+		workers);
+	return first;
+}
+
+// copy strings a chunk at a time, until there are none left
+void bulk_copy_job(void *arg, int worker) {
+	BulkCopy *copy = arg;
+	uint32_t i, start, end;
+
+	for (;;) {
+		start = __atomic_fetch_add(&copy->next, COPY_CHUNK, __ATOMIC_RELAXED);
+		if (start >= copy->n) {
+			break;
+		}
+		end = copy->n - start < COPY_CHUNK ? copy->n : start + COPY_CHUNK;
+		for (i = start; i < end; i++) {
+			uint32_t id = copy->first + i;
+			memcpy(copy->arena->strings[id], copy->strs[i],
+				copy->arena->lens[id]);
+			copy->arena->strings[id][copy->arena->lens[id]] = '\0';
+		}
+	}
+}
+
+uint32_t str_arena_find(StrArena *arena, char *str) {
+	if (arena->text) {
+		return mapped_find(arena, str);
+	}
+	if (hash_table_has(arena->table, str)) {
+		return hash_table_get_val(arena->table, str);
+	}
+	return STR_ARENA_NONE;
+}
+
+void str_arena_find_batch(StrArena *arena, char **strs, int n, uint32_t *ids) {
+	// ids and table values are the same size, so ids doubles as the output
+	int *values = (int *)ids;
+	int i;
+	if (arena->text) {
+		// fetch every home slot first, so the misses overlap
+		for (i = 0; i < n; i++) {
+			ids[i] = string_hash(strs[i]) & arena->mask;
+			PREFETCH(&arena->slots[ids[i]]);
+		}
+		for (i = 0; i < n; i++) {
+			ids[i] = mapped_find(arena, strs[i]);
+		}
+		return;
+	}
+	hash_table_get_batch(arena->table, strs, n, values, -1);
+	for (i = 0; i < n; i++) {
+		ids[i] = values[i] < 0 ? STR_ARENA_NONE : (uint32_t)values[i];
+	}
+}
+
+void str_arena_freeze(StrArena *arena) {
+	// a mapped arena is never written to
+	if (!arena->text) {
+		hash_table_freeze(arena->table);
+	}
+}
+
+/*----------------------------------------------------------------------*/
+/* ACCESSING STORED STRINGS */
+
+char *str_arena_get(StrArena *arena, uint32_t id) {
+	assert(id < arena->count);
+	if (arena->text) {
+		return (char *)arena->text + arena->offsets[id];
+	}
+	return arena->strings[id];
+}
+
+size_t str_arena_len(StrArena *arena, uint32_t id) {
+	assert(id < arena->count);
+	if (arena->text) {
+		return arena->offsets[id + 1] - arena->offsets[id] - 1;
+	}
+	return arena->lens[id];
+}
+
+uint32_t str_arena_count(StrArena *arena) {
+	return arena->count;
+}
+
+size_t str_arena_bytes(StrArena *arena) {
+	return arena->bytes;
+}
+
+/*----------------------------------------------------------------------*/
+/* IMAGES */
+
+uint32_t string_hash(const char *str) {
+	uint32_t hash = FNV_BASIS;
+	while (*str) {
+		hash = (hash ^ (unsigned char)*str++) * FNV_PRIME;
+	}
+	return hash;
+}
+
+// find 'str' in the slots of a mapped arena, probing linearly
+uint32_t mapped_find(StrArena *arena, const char *str) {
+	uint32_t slot = string_hash(str) & arena->mask;
+	while (arena->slots[slot]) {
+		uint32_t id = arena->slots[slot] - 1;
+		if (id < arena->count
+				&& strcmp(arena->text + arena->offsets[id], str) == 0) {
+			return id;
+		}
+		slot = (slot + 1) & arena->mask;
+	}
+	return STR_ARENA_NONE;
+}
+
+// write zeroes after 'n' bytes, up to a multiple of 8 bytes
+bool write_padding(size_t n, FILE *file) {
+	static const char zeroes[8];
+	size_t npad = (8 - n % 8) % 8;
+	return fwrite(zeroes, 1, npad, file) == npad;
+}
+
+bool str_arena_write(StrArena *arena, FILE *file) {
+	ImageHead head = { arena->count, 1, 0 };
+	uint32_t id;
+
+	// at most half the slots are used
+	while (((uint64_t)1 << head.bits) < 2 * (uint64_t)arena->count) {
+		head.bits++;
+	}
+	uint32_t nslots = (uint32_t)1 << head.bits;
+	size_t noffsets = (size_t)arena->count + 1;
+	uint32_t *offsets = malloc(sizeof(uint32_t) * noffsets);
+	uint32_t *slots = calloc(nslots, sizeof(uint32_t));
+	assert(offsets && slots);
+
+	for (id = 0; id < arena->count; id++) {
+		offsets[id] = head.text_len;
+		head.text_len += str_arena_len(arena, id) + 1;
+
+		uint32_t slot = string_hash(str_arena_get(arena, id)) & (nslots - 1);
+		while (slots[slot]) {
+			slot = (slot + 1) & (nslots - 1);
+		}
+		slots[slot] = id + 1;
+	}
+	offsets[arena->count] = head.text_len;
+
+	bool ok = head.text_len <= UINT32_MAX
+		&& fwrite(&head, sizeof head, 1, file) == 1
+		&& fwrite(offsets, sizeof(uint32_t), noffsets, file) == noffsets
+		&& write_padding(sizeof(uint32_t) * noffsets, file)
+		&& fwrite(slots, sizeof(uint32_t), nslots, file) == nslots
+		&& write_padding(sizeof(uint32_t) * nslots, file);
+	for (id = 0; ok && id < arena->count; id++) {
+		size_t len = str_arena_len(arena, id) + 1;
+		ok = fwrite(str_arena_get(arena, id), 1, len, file) == len;
+	}
+	ok = ok && write_padding(head.text_len, file);
+
+	free(offsets);
+	free(slots);
+	return ok;
+}
+
+StrArena *str_arena_map(const char *data, size_t len) {
+	ImageHead head;
+	if (len < sizeof head) {
+		return NULL;
+	}
+	memcpy(&head, data, sizeof head);
+	if (head.bits >= 32) {
+		return NULL;
+	}
+	size_t noffsets = (size_t)head.count + 1;
+	size_t nslots = (size_t)1 << head.bits;
+	size_t offsets_at = sizeof head;
+	size_t slots_at = offsets_at + PADDED(sizeof(uint32_t) * noffsets);
+	size_t text_at = slots_at + PADDED(sizeof(uint32_t) * nslots);
+	if (text_at + head.text_len > len || nslots < noffsets) {
+		return NULL;
+	}
+
+	StrArena *arena = malloc(sizeof *arena);
+	assert(arena);
+	arena->block = NULL;
+	arena->bytes = head.text_len;
+	arena->strings = NULL;
+	arena->lens = NULL;
+	arena->count = arena->capacity = head.count;
+	arena->table = NULL;
+	arena->text = data + text_at;
+	arena->offsets = (const uint32_t *)(data + offsets_at);
+	arena->slots = (const uint32_t *)(data + slots_at);
+	arena->mask = nslots - 1;
+
+	// every string must end inside the text, so that lookups stay in it
+	if (arena->offsets[head.count] != head.text_len || (head.count > 0
+			&& arena->text[head.text_len - 1] != '\0')) {
+		free(arena);
+		return NULL;
+	}
+	return arena;
+}
@@ -0,0 +1,74 @@
+/* * * * * * *
+ * Module for a string interning arena: every distinct string is stored
+ * exactly once, '\0'-terminated and packed back to back in large blocks,
+ * and is named by a dense 32-bit id (0, 1, 2, ... in order of first
+ * appearance). the ids can be shared by any index built over the strings
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#ifndef STRARENA_H
+#define STRARENA_H
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "workers.h"
+
+#define STR_ARENA_NONE UINT32_MAX	// id returned for an unknown string
+
+typedef struct str_arena StrArena;
+
+// create an empty arena, with room for around 'nstrings' strings
+StrArena *new_str_arena(int nstrings);
+void free_str_arena(StrArena *arena);
+
+// intern the 'len' bytes at 'str' (which need not be '\0'-terminated),
+// returning the id of the stored copy. a string already in the arena keeps
+// its id and is not stored again. if 'added' is not NULL, it is set to
+// whether the string was new
+uint32_t str_arena_intern(StrArena *arena, const char *str, size_t len,
+	int *added);
+
+// intern 'n' strings at once ('lens[i]' bytes at 'strs[i]'), none of them
+// in the arena yet nor repeated, and return the id of the first: the rest
+// follow it in order. they are copied and put in the table by 'workers'
+// (or the calling thread alone if NULL)
+uint32_t str_arena_add_all(StrArena *arena, const char *const *strs,
+	const size_t *lens, uint32_t n, Workers *workers);
+
+// the id of the '\0'-terminated string 'str', or STR_ARENA_NONE
+uint32_t str_arena_find(StrArena *arena, char *str);
+
+// the ids of 'n' '\0'-terminated strings at once (ids[i] for strs[i]),
+// overlapping their memory accesses. doesn't modify the arena
+void str_arena_find_batch(StrArena *arena, char **strs, int n, uint32_t *ids);
+
+// the stored string with id 'id', and its length
+char *str_arena_get(StrArena *arena, uint32_t id);
+size_t str_arena_len(StrArena *arena, uint32_t id);
+
+// the number of distinct strings stored
+uint32_t str_arena_count(StrArena *arena);
+
+// the number of bytes used to store the strings themselves
+size_t str_arena_bytes(StrArena *arena);
+
+// stop the arena changing under lookups, so that several threads can find
+// strings in it at once. nothing more can be interned into it
+void str_arena_freeze(StrArena *arena);
+
+// write the arena to 'file' as a flat image (host byte order, a multiple
+// of 8 bytes long) holding the strings and a table to find them by.
+// returns false on a write error
+bool str_arena_write(StrArena *arena, FILE *file);
+
+// a read-only arena over the image of 'len' bytes at 'data' (8-byte
+// aligned), as written by str_arena_write(). nothing can be interned into
+// it, and the image must stay in place until the arena is freed. returns
+// NULL if the image is malformed
+StrArena *str_arena_map(const char *data, size_t len);
+
+#endif
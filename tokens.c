@@ -0,0 +1,148 @@
+/* * * * * * *
+ * Module for splitting raw prose into words, 16 bytes at a time
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#include <stdint.h>
+
+#include "tokens.h"
+
+#if defined(__SSE2__) && !defined(TOKENS_SCALAR)
+#include <emmintrin.h>
+#define TOKENS_SSE2
+#endif
+
+#define CHUNK 16	// bytes classified at a time
+
+// the index of the lowest set bit of a non-zero 'x'
+#ifdef __GNUC__
+#define LOWEST_BIT(x) __builtin_ctz(x)
+#else
+#define LOWEST_BIT(x) lowest_bit(x)
+#endif
+
+/*----------------------------------------------------------------------*/
+/* HELPER FUNCTION PROTOTYPES */
+int lowest_bit(uint32_t x);
+void classify(const char *bytes, size_t n, uint32_t *word, uint32_t *high);
+
+/*----------------------------------------------------------------------*/
+/* CLASSIFYING BYTES */
+
+int lowest_bit(uint32_t x) {
+	int i = 0;
+	while (!(x & 1)) {
+		x >>= 1;
+		i++;
+	}
+	return i;
+}
+
+/* Classifies the first 'n' (at most CHUNK) of 'bytes': bit i of '*word' is
+ * set if byte i belongs in a word, and bit i of '*high' if it is not ASCII
+ * bits from 'n' on are clear
+ */
+void classify(const char *bytes, size_t n, uint32_t *word, uint32_t *high) {
+#ifdef TOKENS_SSE2
+	if (n == CHUNK) {
+		__m128i v = _mm_loadu_si128((const __m128i *)bytes);
+		// setting bit 5 turns capitals into lowercase. non-ASCII bytes are
+		// negative as signed bytes, so they fail the letter test
+		__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		__m128i letter = _mm_and_si128(
+			_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+			_mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+		*high = _mm_movemask_epi8(v);
+		*word = _mm_movemask_epi8(letter) | *high;
+		return;
+	}
+#endif
+	size_t i;
+	*word = *high = 0;
+	for (i = 0; i < n; i++) {
+		unsigned char c = bytes[i] | 0x20;
+		if (bytes[i] & 0x80) {
+			*high |= 1u << i;
+			*word |= 1u << i;
+		} else if (c >= 'a' && c <= 'z') {
+			*word |= 1u << i;
+		}
+	}
+}
+
+void fold_ascii(const char *text, size_t len, char *out) {
+	size_t i = 0;
+#ifdef TOKENS_SSE2
+	for (; i + CHUNK <= len; i += CHUNK) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(text + i));
+		__m128i capital = _mm_and_si128(
+			_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+			_mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+		v = _mm_add_epi8(v, _mm_and_si128(capital, _mm_set1_epi8(0x20)));
+		_mm_storeu_si128((__m128i *)(out + i), v);
+	}
+#endif
+	for (; i < len; i++) {
+		out[i] = text[i] >= 'A' && text[i] <= 'Z' ? text[i] + 0x20 : text[i];
+	}
+}
+
+/*----------------------------------------------------------------------*/
+/* FINDING WORDS */
+
+size_t next_tokens(const char *text, size_t len, size_t *pos, Token *tokens,
+		size_t max) {
+	size_t ntokens = 0, start = 0, i;
+	bool in_word = false, high_seen = false;
+	uint32_t word, high;
+
+	// each chunk is walked from one word boundary to the next, a whole
+	// run of word (or separator) bytes at a time
+	for (i = *pos; i < len && ntokens < max; i += CHUNK) {
+		size_t n = len - i < CHUNK ? len - i : CHUNK;
+		classify(text + i, n, &word, &high);
+
+		uint32_t from = 0;	// bits below this one are dealt with
+		while (from < CHUNK) {
+			uint32_t ahead = (uint32_t)0xFFFF << from & 0xFFFF;
+			if (in_word) {
+				uint32_t ends = ~word & ahead;
+				uint32_t end = ends ? LOWEST_BIT(ends) : CHUNK;
+				high_seen |= (high & ahead & (((uint32_t)1 << end) - 1)) != 0;
+				if (!ends) {
+					break;
+				}
+				tokens[ntokens].offset = start;
+				tokens[ntokens].len = i + end - start;
+				tokens[ntokens].ascii = !high_seen;
+				ntokens++;
+				in_word = false;
+				from = end;
+				if (ntokens == max) {
+					*pos = i + end;
+					return ntokens;
+				}
+			} else {
+				uint32_t starts = word & ahead;
+				if (!starts) {
+					break;
+				}
+				from = LOWEST_BIT(starts);
+				start = i + from;
+				in_word = true;
+				high_seen = false;
+			}
+		}
+	}
+
+	// a word running up to the end of the text
+	if (in_word) {
+		tokens[ntokens].offset = start;
+		tokens[ntokens].len = len - start;
+		tokens[ntokens].ascii = !high_seen;
+		ntokens++;
+	}
+	*pos = len;
+	return ntokens;
+}
@@ -0,0 +1,41 @@
+/* * * * * * *
+ * Module for splitting raw prose (UTF-8 or plain ASCII text) into words:
+ * a word is a run of ASCII letters and non-ASCII bytes (so that a UTF-8
+ * letter never splits a word in two), and any other byte (whitespace,
+ * digits, punctuation) separates words. words are named by their byte
+ * offsets in the text, so that corrections can be written back in place
+ *
+ * 16 bytes are classified at a time with SSE2 where the compiler has it,
+ * and one at a time otherwise (or if TOKENS_SCALAR is defined)
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#ifndef TOKENS_H
+#define TOKENS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#define TOKEN_BATCH 1024	// words a caller finds at a time
+
+// one word of a text
+typedef struct {
+	size_t offset;	// of its first byte
+	size_t len;
+	bool ascii;		// it is all ASCII letters, so it can be looked up
+					// once folded to lowercase
+} Token;
+
+// copy the 'len' bytes at 'text' to 'out', with ASCII capitals folded to
+// lowercase. every other byte is copied as it is, so offsets carry over
+void fold_ascii(const char *text, size_t len, char *out);
+
+// find the next (up to) 'max' words of the 'len' bytes at 'text', starting
+// from offset '*pos', and store them in 'tokens'. '*pos' is moved past the
+// last word found, so that the next call carries on from there. returns
+// the number of words found: 0 once there are no more
+size_t next_tokens(const char *text, size_t len, size_t *pos, Token *tokens,
+	size_t max);
+
+#endif
@@ -0,0 +1,387 @@
+/* * * * * * *
+ * Module for a trigram inverted index
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "trigrams.h"
+
+#define Q 3				// letters in a gram
+#define PAD 0			// the letter padding either end of a word
+#define INIT_BITS 10	// a table starts with 2^INIT_BITS slots
+#define INIT_BYTES 8	// starting room of a posting list
+#define NO_LIST 0		// slot with no posting list
+
+#define MIN(X,Y) (((X)<(Y))? (X):(Y)) // finds the minimum value between X and Y
+#define MAX(X,Y) (((X)>(Y))? (X):(Y)) // finds the maximum value between X and Y
+
+// the ranks of the words holding a trigram: each is stored as the
+// difference from the one before (0 for a trigram a word holds twice), 7
+// bits to a byte, lowest first, with the top bit set on all but the last
+typedef struct {
+	uint8_t *bytes;
+	size_t len;
+	size_t size;
+	uint32_t last;	// the last rank added
+} Postings;
+
+struct trigrams {
+	// open addressing over the trigrams: slot s holds trigram grams[s],
+	// whose posting list is lists[slots[s] - 1], or NO_LIST
+	uint32_t *grams;
+	uint32_t *slots;
+	int bits;		// there are 2^bits slots
+	Postings *lists;
+	uint32_t nlists;
+	uint32_t lists_size;
+
+	uint32_t *lens;	// of each word, by rank
+	uint32_t nwords;
+	uint32_t lens_size;
+};
+
+struct trigram_scratch {
+	uint32_t *counts;	// by rank: the trigrams a word shares with the query
+	uint32_t *touched;	// ranks with a count, then the candidates
+	uint32_t size;		// room in both
+	uint32_t *grams;	// the trigrams of the query
+	size_t grams_size;
+};
+
+/*----------------------------------------------------------------------*/
+/* HELPER FUNCTION PROTOTYPES */
+size_t word_grams(const char *word, size_t len, uint32_t *grams);
+uint32_t gram_slot(const Trigrams *trigrams, uint32_t gram);
+int gram_shard(uint32_t gram, int nshards);
+Postings *find_postings(const Trigrams *trigrams, uint32_t gram);
+Postings *add_postings(Trigrams *trigrams, uint32_t gram);
+Postings *insert_postings(Trigrams *trigrams, uint32_t gram, Postings list);
+void grow_gram_slots(Trigrams *trigrams);
+void postings_add(Postings *list, uint32_t rank);
+void trigrams_add_length(Trigrams *trigrams, uint32_t rank, size_t len);
+int compare_ranks(const void *a, const void *b);
+void count_shared(const Postings *list, uint32_t in_query,
+	TrigramScratch *scratch, uint32_t *ntouched, long *work);
+
+/*----------------------------------------------------------------------*/
+/* INDEX CREATION/DELETION */
+
+Trigrams *new_trigrams(void) {
+	Trigrams *trigrams = malloc(sizeof *trigrams);
+	assert(trigrams);
+	trigrams->bits = INIT_BITS;
+	trigrams->grams = malloc(sizeof(uint32_t) << INIT_BITS);
+	trigrams->slots = calloc((size_t)1 << INIT_BITS, sizeof(uint32_t));
+	assert(trigrams->grams && trigrams->slots);
+	trigrams->lists = NULL;
+	trigrams->nlists = trigrams->lists_size = 0;
+	trigrams->lens = NULL;
+	trigrams->nwords = trigrams->lens_size = 0;
+	return trigrams;
+}
+
+void free_trigrams(Trigrams *trigrams) {
+	uint32_t i;
+	for (i = 0; i < trigrams->nlists; i++) {
+		free(trigrams->lists[i].bytes);
+	}
+	free(trigrams->lists);
+	free(trigrams->grams);
+	free(trigrams->slots);
+	free(trigrams->lens);
+	free(trigrams);
+}
+
+/* Writes the len+2 trigrams of 'word' (padded at either end) to 'grams',
+ * each as three bytes of an integer, and returns how many there are
+ */
+size_t word_grams(const char *word, size_t len, uint32_t *grams) {
+	uint32_t gram = PAD << 8 | PAD;
+	size_t i;
+	for (i = 0; i < len + Q - 1; i++) {
+		uint32_t c = i < len ? (unsigned char)word[i] : PAD;
+		gram = (gram << 8 | c) & 0xFFFFFF;
+		grams[i] = gram;
+	}
+	return len + Q - 1;
+}
+
+/*----------------------------------------------------------------------*/
+/* ADDING WORDS */
+
+uint32_t gram_slot(const Trigrams *trigrams, uint32_t gram) {
+	return (gram * 2654435761u) >> (32 - trigrams->bits);
+}
+
+// the posting list of 'gram', or NULL if no word holds it
+Postings *find_postings(const Trigrams *trigrams, uint32_t gram) {
+	uint32_t mask = ((uint32_t)1 << trigrams->bits) - 1;
+	uint32_t slot = gram_slot(trigrams, gram);
+	while (trigrams->slots[slot] != NO_LIST) {
+		if (trigrams->grams[slot] == gram) {
+			return &trigrams->lists[trigrams->slots[slot] - 1];
+		}
+		slot = (slot + 1) & mask;
+	}
+	return NULL;
+}
+
+// the posting list of 'gram', new and empty if no word held it yet
+Postings *add_postings(Trigrams *trigrams, uint32_t gram) {
+	Postings *list = find_postings(trigrams, gram);
+	if (list) {
+		return list;
+	}
+
+	Postings empty = { NULL, 0, INIT_BYTES, 0 };
+	empty.bytes = malloc(empty.size);
+	assert(empty.bytes);
+	return insert_postings(trigrams, gram, empty);
+}
+
+// give 'gram' (which has no posting list yet) the posting list 'list'
+Postings *insert_postings(Trigrams *trigrams, uint32_t gram, Postings list) {
+	// at most half of the slots are used
+	if (2 * (trigrams->nlists + 1) > (uint32_t)1 << trigrams->bits) {
+		grow_gram_slots(trigrams);
+	}
+	if (trigrams->nlists == trigrams->lists_size) {
+		trigrams->lists_size = trigrams->lists_size
+			? 2 * trigrams->lists_size : 256;
+		trigrams->lists = realloc(trigrams->lists,
+			sizeof(Postings) * trigrams->lists_size);
+		assert(trigrams->lists);
+	}
+	trigrams->lists[trigrams->nlists++] = list;
+
+	uint32_t mask = ((uint32_t)1 << trigrams->bits) - 1;
+	uint32_t slot = gram_slot(trigrams, gram);
+	while (trigrams->slots[slot] != NO_LIST) {
+		slot = (slot + 1) & mask;
+	}
+	trigrams->grams[slot] = gram;
+	trigrams->slots[slot] = trigrams->nlists;
+	return &trigrams->lists[trigrams->nlists - 1];
+}
+
+// double the slots, and put every trigram back in its new one
+void grow_gram_slots(Trigrams *trigrams) {
+	uint32_t *grams = trigrams->grams, *slots = trigrams->slots;
+	uint32_t nslots = (uint32_t)1 << trigrams->bits, i;
+
+	trigrams->bits++;
+	trigrams->grams = malloc(sizeof(uint32_t) << trigrams->bits);
+	trigrams->slots = calloc((size_t)1 << trigrams->bits, sizeof(uint32_t));
+	assert(trigrams->grams && trigrams->slots);
+	uint32_t mask = ((uint32_t)1 << trigrams->bits) - 1;
+	for (i = 0; i < nslots; i++) {
+		if (slots[i] == NO_LIST) {
+			continue;
+		}
+		uint32_t slot = gram_slot(trigrams, grams[i]);
+		while (trigrams->slots[slot] != NO_LIST) {
+			slot = (slot + 1) & mask;
+		}
+		trigrams->grams[slot] = grams[i];
+		trigrams->slots[slot] = slots[i];
+	}
+	free(grams);
+	free(slots);
+}
+
+void postings_add(Postings *list, uint32_t rank) {
+	uint32_t delta = rank - list->last;
+
+	// a 32-bit delta takes at most 5 bytes
+	if (list->len + 5 > list->size) {
+		list->size *= 2;
+		list->bytes = realloc(list->bytes, list->size);
+		assert(list->bytes);
+	}
+	while (delta >= 0x80) {
+		list->bytes[list->len++] = (delta & 0x7F) | 0x80;
+		delta >>= 7;
+	}
+	list->bytes[list->len++] = delta;
+	list->last = rank;
+}
+
+void trigrams_add(Trigrams *trigrams, uint32_t rank, const char *word,
+		size_t len) {
+	trigrams_add_shard(trigrams, rank, word, len, 0, 1);
+}
+
+// the shard of 'gram', from other bits of its hash than its slot
+int gram_shard(uint32_t gram, int nshards) {
+	return ((gram * 2654435761u) >> 8) % nshards;
+}
+
+void trigrams_add_shard(Trigrams *trigrams, uint32_t rank, const char *word,
+		size_t len, int shard, int nshards) {
+	if (shard == 0) {
+		trigrams_add_length(trigrams, rank, len);
+	}
+
+	uint32_t *grams = malloc(sizeof(uint32_t) * (len + Q - 1));
+	assert(grams);
+	size_t ngrams = word_grams(word, len, grams), i;
+	for (i = 0; i < ngrams; i++) {
+		if (nshards == 1 || gram_shard(grams[i], nshards) == shard) {
+			postings_add(add_postings(trigrams, grams[i]), rank);
+		}
+	}
+	free(grams);
+}
+
+// record that the word of rank 'rank' is 'len' bytes long
+void trigrams_add_length(Trigrams *trigrams, uint32_t rank, size_t len) {
+	assert(rank >= trigrams->nwords);
+	if (rank >= trigrams->lens_size) {
+		trigrams->lens_size = MAX(2 * trigrams->lens_size, rank + 1);
+		trigrams->lens = realloc(trigrams->lens,
+			sizeof(uint32_t) * trigrams->lens_size);
+		assert(trigrams->lens);
+	}
+	trigrams->lens[rank] = len;
+	trigrams->nwords = rank + 1;
+}
+
+void trigrams_merge(Trigrams *trigrams, Trigrams *shard) {
+	uint32_t nslots = (uint32_t)1 << shard->bits, i;
+	for (i = 0; i < nslots; i++) {
+		if (shard->slots[i] != NO_LIST) {
+			assert(!find_postings(trigrams, shard->grams[i]));
+			insert_postings(trigrams, shard->grams[i],
+				shard->lists[shard->slots[i] - 1]);
+		}
+	}
+	// the lists' bytes now belong to 'trigrams'
+	free(shard->lists);
+	free(shard->grams);
+	free(shard->slots);
+	free(shard->lens);
+	free(shard);
+}
+
+/*----------------------------------------------------------------------*/
+/* FINDING CANDIDATES */
+
+TrigramScratch *new_trigram_scratch(void) {
+	TrigramScratch *scratch = malloc(sizeof *scratch);
+	assert(scratch);
+	scratch->counts = scratch->touched = NULL;
+	scratch->size = 0;
+	scratch->grams = NULL;
+	scratch->grams_size = 0;
+	return scratch;
+}
+
+void free_trigram_scratch(TrigramScratch *scratch) {
+	free(scratch->counts);
+	free(scratch->touched);
+	free(scratch->grams);
+	free(scratch);
+}
+
+int compare_ranks(const void *a, const void *b) {
+	uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+	return (x > y) - (x < y);
+}
+
+/* Adds the trigram of 'list' to the count of every word holding it: as
+ * many times as the word holds it, but no more than 'in_query', the times
+ * the query does
+ */
+void count_shared(const Postings *list, uint32_t in_query,
+		TrigramScratch *scratch, uint32_t *ntouched, long *work) {
+	uint32_t rank = 0, run = 0, current = 0;
+	size_t at = 0;
+
+	while (at < list->len) {
+		uint32_t delta = 0;
+		int shift = 0;
+		while (list->bytes[at] & 0x80) {
+			delta |= (uint32_t)(list->bytes[at++] & 0x7F) << shift;
+			shift += 7;
+		}
+		delta |= (uint32_t)list->bytes[at++] << shift;
+		rank += delta;
+		(*work)++;
+
+		// a run of the same rank ends at a non-zero delta
+		if (run > 0 && delta != 0) {
+			if (scratch->counts[current] == 0) {
+				scratch->touched[(*ntouched)++] = current;
+			}
+			scratch->counts[current] += MIN(run, in_query);
+			run = 0;
+		}
+		current = rank;
+		run++;
+	}
+	if (run > 0) {
+		if (scratch->counts[current] == 0) {
+			scratch->touched[(*ntouched)++] = current;
+		}
+		scratch->counts[current] += MIN(run, in_query);
+	}
+}
+
+int trigrams_candidates(const Trigrams *trigrams, TrigramScratch *scratch,
+		const char *word, size_t len, int k, bool transpose,
+		const uint32_t **ranks, long *work) {
+	long per_edit = transpose ? Q + 1 : Q;
+	uint32_t ntouched = 0, ncands = 0, i;
+	size_t ngrams, g, h;
+
+	// the shortest words it could be matched with must share a trigram
+	if ((long)len + Q - 1 - k * per_edit <= 0) {
+		return -1;
+	}
+
+	if (scratch->size < trigrams->nwords) {
+		free(scratch->counts);
+		free(scratch->touched);
+		scratch->size = trigrams->nwords;
+		scratch->counts = calloc(scratch->size, sizeof(uint32_t));
+		scratch->touched = malloc(sizeof(uint32_t) * scratch->size);
+		assert(scratch->counts && scratch->touched);
+	}
+	if (scratch->grams_size < len + Q - 1) {
+		scratch->grams_size = len + Q - 1;
+		scratch->grams = realloc(scratch->grams,
+			sizeof(uint32_t) * scratch->grams_size);
+		assert(scratch->grams);
+	}
+
+	// each distinct trigram of the query, with how many times it holds it
+	ngrams = word_grams(word, len, scratch->grams);
+	qsort(scratch->grams, ngrams, sizeof(uint32_t), compare_ranks);
+	for (g = 0; g < ngrams; g = h) {
+		for (h = g + 1; h < ngrams && scratch->grams[h] == scratch->grams[g];
+				h++) {
+		}
+		Postings *list = find_postings(trigrams, scratch->grams[g]);
+		if (list) {
+			count_shared(list, h - g, scratch, &ntouched, work);
+		}
+	}
+
+	// the count filter, and the length filter. every count goes back to 0
+	for (i = 0; i < ntouched; i++) {
+		uint32_t rank = scratch->touched[i];
+		long other = trigrams->lens[rank];
+		long need = MAX((long)len, other) + Q - 1 - k * per_edit;
+		if (labs(other - (long)len) <= k && scratch->counts[rank] >= need) {
+			scratch->touched[ncands++] = rank;
+		}
+		scratch->counts[rank] = 0;
+	}
+	qsort(scratch->touched, ncands, sizeof(uint32_t), compare_ranks);
+	*ranks = scratch->touched;
+	return ncands;
+}
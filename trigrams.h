@@ -0,0 +1,61 @@
+/* * * * * * *
+ * Module for a trigram inverted index: every trigram of every dictionary
+ * word (with two pad letters at either end, so "cat" has "##c", "#ca",
+ * "cat", "at$" and "t$$") maps to the ranks of the words holding it, in
+ * increasing order, stored as variable-length byte deltas
+ *
+ * a word within k edits of another shares at least max(n, m) + 2 - 3k of
+ * its trigrams (an edit changes at most 3 of them, and a transposition at
+ * most 4), so counting the trigrams each word shares with the query, one
+ * posting list at a time, leaves a short list of candidates to verify in
+ * place of the whole dictionary
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#ifndef TRIGRAMS_H
+#define TRIGRAMS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct trigrams Trigrams;
+
+// the counts of one query at a time, on one thread
+typedef struct trigram_scratch TrigramScratch;
+
+Trigrams *new_trigrams(void);
+void free_trigrams(Trigrams *trigrams);
+
+// add the word of rank 'rank' ('len' bytes at 'word'). words must be added
+// in increasing order of rank
+void trigrams_add(Trigrams *trigrams, uint32_t rank, const char *word,
+	size_t len);
+
+// the same for one of 'nshards' shards of the trigrams: only the word's
+// trigrams that fall in shard 'shard' are added. every shard can be built
+// on a thread of its own, into an index of its own, and then merged. the
+// index of shard 0 also records the lengths of the words, so the other
+// shards are merged into it
+void trigrams_add_shard(Trigrams *trigrams, uint32_t rank, const char *word,
+	size_t len, int shard, int nshards);
+
+// move the posting lists of 'shard' (of different trigrams) into
+// 'trigrams', and free 'shard'
+void trigrams_merge(Trigrams *trigrams, Trigrams *shard);
+
+TrigramScratch *new_trigram_scratch(void);
+void free_trigram_scratch(TrigramScratch *scratch);
+
+// the ranks of every word that may be within 'k' edits (transpositions
+// being one edit with 'transpose') of the 'len' bytes at 'word', in
+// increasing order, in '*ranks' (which belongs to 'scratch' until its next
+// query). the posting list entries read are added to '*work'. returns how
+// many there are, or -1 if the word is too short for the filter to rule any
+// word out (every word of a close enough length is a candidate)
+int trigrams_candidates(const Trigrams *trigrams, TrigramScratch *scratch,
+	const char *word, size_t len, int k, bool transpose,
+	const uint32_t **ranks, long *work);
+
+#endif
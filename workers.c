@@ -0,0 +1,155 @@
+/* * * * * * *
+ * Module for a pool of worker threads
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <assert.h>
+#include <pthread.h>
+
+#include "workers.h"
+
+typedef struct {
+	Workers *workers;
+	int number;
+} Worker;
+
+struct workers {
+	int nworkers;
+	pthread_t *threads;
+	Worker *worker;
+
+	pthread_mutex_t lock;
+	pthread_cond_t start;	// signalled when a new job (or shutdown) begins
+	pthread_cond_t done;	// signalled when the last worker finishes a job
+
+	WorkerJob job;
+	void *arg;
+	unsigned long generation;	// counts jobs, so workers spot a new one
+	int running;				// threads still busy with the current job
+	bool stopping;
+};
+
+/*----------------------------------------------------------------------*/
+/* WORKER THREADS */
+
+void *worker_main(void *data) {
+	Worker *self = data;
+	Workers *workers = self->workers;
+	unsigned long seen = 0;
+
+	pthread_mutex_lock(&workers->lock);
+	for (;;) {
+		while (workers->generation == seen && !workers->stopping) {
+			pthread_cond_wait(&workers->start, &workers->lock);
+		}
+		if (workers->stopping) {
+			break;
+		}
+		seen = workers->generation;
+		WorkerJob job = workers->job;
+		void *arg = workers->arg;
+		pthread_mutex_unlock(&workers->lock);
+
+		job(arg, self->number);
+
+		pthread_mutex_lock(&workers->lock);
+		if (--workers->running == 0) {
+			pthread_cond_signal(&workers->done);
+		}
+	}
+	pthread_mutex_unlock(&workers->lock);
+	return NULL;
+}
+
+/*----------------------------------------------------------------------*/
+/* POOL CREATION/DELETION */
+
+Workers *new_workers(int nworkers) {
+	Workers *workers = malloc(sizeof *workers);
+	assert(workers);
+
+	if (nworkers < 1) {
+		nworkers = 1;
+	}
+	workers->nworkers = nworkers;
+	workers->threads = malloc(sizeof(pthread_t)*nworkers);
+	workers->worker = malloc(sizeof(Worker)*nworkers);
+	assert(workers->threads && workers->worker);
+
+	pthread_mutex_init(&workers->lock, NULL);
+	pthread_cond_init(&workers->start, NULL);
+	pthread_cond_init(&workers->done, NULL);
+	workers->job = NULL;
+	workers->arg = NULL;
+	workers->generation = 0;
+	workers->running = 0;
+	workers->stopping = false;
+
+	// worker 0 is whoever calls workers_run()
+	int i;
+	for (i = 1; i < nworkers; i++) {
+		workers->worker[i].workers = workers;
+		workers->worker[i].number = i;
+		int err = pthread_create(&workers->threads[i], NULL, worker_main,
+			&workers->worker[i]);
+		assert(err == 0);
+	}
+	return workers;
+}
+
+void free_workers(Workers *workers) {
+	assert(workers != NULL);
+
+	pthread_mutex_lock(&workers->lock);
+	workers->stopping = true;
+	pthread_cond_broadcast(&workers->start);
+	pthread_mutex_unlock(&workers->lock);
+
+	int i;
+	for (i = 1; i < workers->nworkers; i++) {
+		pthread_join(workers->threads[i], NULL);
+	}
+	pthread_mutex_destroy(&workers->lock);
+	pthread_cond_destroy(&workers->start);
+	pthread_cond_destroy(&workers->done);
+	free(workers->threads);
+	free(workers->worker);
+	free(workers);
+}
+
+int workers_count(Workers *workers) {
+	return workers->nworkers;
+}
+
+/*----------------------------------------------------------------------*/
+/* RUNNING JOBS */
+
+void workers_run(Workers *workers, WorkerJob job, void *arg) {
+	if (workers->nworkers == 1) {
+		job(arg, 0);
+		return;
+	}
+
+	pthread_mutex_lock(&workers->lock);
+	workers->job = job;
+	workers->arg = arg;
+	workers->running = workers->nworkers - 1;
+	workers->generation++;
+	pthread_cond_broadcast(&workers->start);
+	pthread_mutex_unlock(&workers->lock);
+
+	// the caller does its share too
+	job(arg, 0);
+
+	pthread_mutex_lock(&workers->lock);
+	while (workers->running > 0) {
+		pthread_cond_wait(&workers->done, &workers->lock);
+	}
+	pthread_mutex_unlock(&workers->lock);
+}
@@ -0,0 +1,27 @@
+/* * * * * * *
+ * Module for a pool of worker threads: the threads are started once, and
+ * then run one job at a time, all together, for as long as the pool lives
+ *
+ * created by Leonardo Linardi, 855915 <llinardi@student.unimelb.edu.au>
+ */
+
+#ifndef WORKERS_H
+#define WORKERS_H
+
+typedef struct workers Workers;
+
+// a job: called once on every worker, with the job's argument and the
+// worker's number (0 to nworkers-1). workers split up the work themselves
+typedef void (*WorkerJob)(void *arg, int worker);
+
+// start a pool of 'nworkers' workers. the caller of workers_run() counts as
+// worker 0, so only nworkers-1 threads are started
+Workers *new_workers(int nworkers);
+void free_workers(Workers *workers);
+
+int workers_count(Workers *workers);
+
+// run 'job' on every worker, and wait for all of them to finish
+void workers_run(Workers *workers, WorkerJob job, void *arg);
+
+#endif